@@ -0,0 +1,65 @@
+/**
+ * @file sysy_host.c
+ * @author UnnamedOrange
+ * @brief SysY runtime library for running x86-64 output on the host.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+static struct timeval start_time;
+static long long total_us;
+static int is_timer_registered;
+
+int getint(void)
+{
+    int ret = 0;
+    if (scanf("%d", &ret) != 1)
+        return 0;
+    return ret;
+}
+int getch(void) { return getchar(); }
+int getarray(int a[])
+{
+    int n = getint();
+    for (int i = 0; i < n; i++)
+        a[i] = getint();
+    return n;
+}
+void putint(int a) { printf("%d", a); }
+void putch(int a) { putchar(a); }
+void putarray(int n, int a[])
+{
+    printf("%d:", n);
+    for (int i = 0; i < n; i++)
+        printf(" %d", a[i]);
+    putchar('\n');
+}
+
+static void print_total_time(void)
+{
+    // 与 libsysy 相同，在退出时输出总计时。
+    long long us = total_us;
+    fprintf(stderr, "TOTAL: %lldH-%lldM-%lldS-%lldus\n", us / 3600000000LL,
+            us / 60000000LL % 60, us / 1000000LL % 60, us % 1000000LL);
+}
+void starttime(void)
+{
+    if (!is_timer_registered)
+    {
+        atexit(print_total_time);
+        is_timer_registered = 1;
+    }
+    gettimeofday(&start_time, NULL);
+}
+void stoptime(void)
+{
+    struct timeval stop_time;
+    gettimeofday(&stop_time, NULL);
+    total_us += (stop_time.tv_sec - start_time.tv_sec) * 1000000LL +
+                (stop_time.tv_usec - start_time.tv_usec);
+}
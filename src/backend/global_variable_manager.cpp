@@ -13,16 +13,41 @@ using namespace compiler;
 
 global_variable_manager::global_variable_manager() { clear(); }
 
-void global_variable_manager::clear() { variable_to_name.clear(); }
+void global_variable_manager::clear()
+{
+    variable_to_name.clear();
+    variable_to_gp_offset.clear();
+    small_data_size = 0;
+}
 void global_variable_manager::alloc(variable_t variable_id,
                                     const std::string& name)
 {
     variable_to_name[variable_id] = name;
 }
+std::optional<int> global_variable_manager::alloc_small(
+    variable_t variable_id, const std::string& name, size_t size)
+{
+    alloc(variable_id, name);
+    if (small_data_size + size > 2 * gp_bias)
+        return std::nullopt; // 超出了 gp 的寻址范围。
+    int offset = static_cast<int>(small_data_size) - gp_bias;
+    variable_to_gp_offset[variable_id] = offset;
+    small_data_size += size;
+    return offset;
+}
 size_t global_variable_manager::count(variable_t variable_id) const
 {
     return variable_to_name.count(variable_id);
 }
+size_t global_variable_manager::count_small(variable_t variable_id) const
+{
+    return variable_to_gp_offset.count(variable_id);
+}
+int global_variable_manager::gp_offset(variable_t variable_id) const
+{
+    return variable_to_gp_offset.at(variable_id);
+}
+size_t global_variable_manager::small_size() const { return small_data_size; }
 const std::string& global_variable_manager::at(variable_t variable_id) const
 {
     return variable_to_name.at(variable_id);
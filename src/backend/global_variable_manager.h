@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include <optional>
 #include <string>
 #include <unordered_map>
 
@@ -20,7 +21,8 @@ namespace compiler
 {
     /**
      * @brief Global variable manager for backend.
-     * Saving names of global variables.
+     * Saving names of global variables, and offsets of global variables in
+     * the small data section, which are accessed relative to gp.
      */
     class global_variable_manager
     {
@@ -34,6 +36,17 @@ namespace compiler
     private:
         // 变量地址到变量名的映射。
         std::unordered_map<variable_t, std::string> variable_to_name;
+        // 小数据段中的变量到相对 gp 的偏移量的映射。
+        std::unordered_map<variable_t, int> variable_to_gp_offset;
+        // 小数据段的大小。
+        size_t small_data_size;
+
+    public:
+        /**
+         * @brief gp points to this offset of the small data section,
+         * so that the 12-bit signed offsets cover 4 KiB.
+         */
+        inline static constexpr int gp_bias = 2048;
 
     public:
         global_variable_manager();
@@ -47,10 +60,33 @@ namespace compiler
          * @brief Register a global variable.
          */
         void alloc(variable_t variable_id, const std::string& name);
+        /**
+         * @brief Register a global variable in the small data section.
+         * If the small data section is full, the variable is registered as a
+         * normal global variable.
+         *
+         * @return std::optional<int> The offset of the variable relative to
+         * gp, or std::nullopt if the small data section is full.
+         */
+        std::optional<int> alloc_small(variable_t variable_id,
+                                       const std::string& name, size_t size);
         /**
          * @brief Check whether a variable ID exists in the manager.
          */
         size_t count(variable_t variable_id) const;
+        /**
+         * @brief Check whether a variable is in the small data section.
+         */
+        size_t count_small(variable_t variable_id) const;
+        /**
+         * @brief Query the offset of a variable in the small data section
+         * relative to gp.
+         */
+        int gp_offset(variable_t variable_id) const;
+        /**
+         * @brief Get size of the small data section.
+         */
+        size_t small_size() const;
         /**
          * @brief Query the name of a global variable.
          */
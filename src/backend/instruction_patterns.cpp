@@ -0,0 +1,232 @@
+/**
+ * @file instruction_patterns.cpp
+ * @author UnnamedOrange
+ * @brief Instruction patterns for instruction selection.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "instruction_patterns.h"
+
+#if defined(COMPILER_LINK_KOOPA)
+
+#include <bit>
+#include <cassert>
+#include <climits>
+
+#include <fmt/core.h>
+
+using namespace compiler;
+
+namespace
+{
+    bool fits_imm12(int64_t imm) { return -2048 <= imm && imm < 2048; }
+    bool has_zba(const riscv_target_t& target) { return target.zba; }
+
+    // 立即数的约束。
+    bool is_imm12(int32_t imm) { return fits_imm12(imm); }
+    bool is_negated_imm12(int32_t imm) { return fits_imm12(-int64_t(imm)); }
+    bool is_imm12_minus_1(int32_t imm) { return fits_imm12(int64_t(imm) + 1); }
+    bool is_zero(int32_t imm) { return !imm; }
+    bool is_shift_amount(int32_t imm) { return 0 <= imm && imm < 32; }
+    bool is_power_of_2(int32_t imm)
+    {
+        return imm > 0 && std::has_single_bit(uint32_t(imm));
+    }
+    bool is_zba_multiplier(int32_t imm)
+    {
+        return bool(split_zba_multiplier(imm));
+    }
+    bool is_unshifted_zba_multiplier(int32_t imm)
+    {
+        auto split = split_zba_multiplier(imm);
+        return split && !split->second;
+    }
+
+    bool is_commutative(koopa_raw_binary_op_t op)
+    {
+        switch (op)
+        {
+        case KOOPA_RBO_ADD:
+        case KOOPA_RBO_MUL:
+        case KOOPA_RBO_AND:
+        case KOOPA_RBO_OR:
+        case KOOPA_RBO_XOR:
+        case KOOPA_RBO_EQ:
+        case KOOPA_RBO_NOT_EQ:
+            return true;
+        default:
+            return false;
+        }
+    }
+    /**
+     * @brief Number of instructions loading a literal to a register.
+     * 0 is read from the zero register.
+     */
+    int literal_cost(std::optional<int32_t> literal)
+    {
+        return literal && *literal ? 1 : 0;
+    }
+} // namespace
+
+std::optional<std::pair<int, int>> compiler::split_zba_multiplier(
+    int32_t multiplier)
+{
+    if (multiplier <= 0)
+        return std::nullopt;
+    int shift = 0;
+    while (!(multiplier & 1))
+    {
+        multiplier >>= 1;
+        shift++;
+    }
+    for (int scale = 1; scale <= 3; scale++)
+        if (multiplier == (1 << scale) + 1)
+            return std::make_pair(scale, shift);
+    return std::nullopt;
+}
+
+const std::vector<binary_pattern_t>& compiler::binary_patterns()
+{
+    // 每个运算都有寄存器与寄存器的模式，保证总能选出一个模式。
+    // 乘除法的代价按其较长的延迟估计。
+    static const std::vector<binary_pattern_t> patterns{
+        // 寄存器与寄存器。
+        {KOOPA_RBO_ADD, false, nullptr, nullptr, 1, "    add {x}, {y}, {z}\n"},
+        {KOOPA_RBO_SUB, false, nullptr, nullptr, 1, "    sub {x}, {y}, {z}\n"},
+        {KOOPA_RBO_MUL, false, nullptr, nullptr, 3, "    mul {x}, {y}, {z}\n"},
+        {KOOPA_RBO_DIV, false, nullptr, nullptr, 10, "    div {x}, {y}, {z}\n"},
+        {KOOPA_RBO_MOD, false, nullptr, nullptr, 10, "    rem {x}, {y}, {z}\n"},
+        {KOOPA_RBO_LT, false, nullptr, nullptr, 1, "    slt {x}, {y}, {z}\n"},
+        {KOOPA_RBO_GT, false, nullptr, nullptr, 1, "    sgt {x}, {y}, {z}\n"},
+        {KOOPA_RBO_LE, false, nullptr, nullptr, 2,
+         "    sgt {x}, {y}, {z}\n    seqz {x}, {x}\n"},
+        {KOOPA_RBO_GE, false, nullptr, nullptr, 2,
+         "    slt {x}, {y}, {z}\n    seqz {x}, {x}\n"},
+        {KOOPA_RBO_EQ, false, nullptr, nullptr, 2,
+         "    xor {x}, {y}, {z}\n    seqz {x}, {x}\n"},
+        {KOOPA_RBO_NOT_EQ, false, nullptr, nullptr, 2,
+         "    xor {x}, {y}, {z}\n    snez {x}, {x}\n"},
+        {KOOPA_RBO_AND, false, nullptr, nullptr, 1, "    and {x}, {y}, {z}\n"},
+        {KOOPA_RBO_OR, false, nullptr, nullptr, 1, "    or {x}, {y}, {z}\n"},
+        {KOOPA_RBO_XOR, false, nullptr, nullptr, 1, "    xor {x}, {y}, {z}\n"},
+        {KOOPA_RBO_SHL, false, nullptr, nullptr, 1, "    sll {x}, {y}, {z}\n"},
+        {KOOPA_RBO_SHR, false, nullptr, nullptr, 1, "    srl {x}, {y}, {z}\n"},
+        {KOOPA_RBO_SAR, false, nullptr, nullptr, 1, "    sra {x}, {y}, {z}\n"},
+
+        // 寄存器与立即数。
+        {KOOPA_RBO_ADD, true, nullptr, is_imm12, 1,
+         "    addi {x}, {y}, {imm}\n"},
+        {KOOPA_RBO_SUB, true, nullptr, is_negated_imm12, 1,
+         "    addi {x}, {y}, {neg_imm}\n"},
+        {KOOPA_RBO_AND, true, nullptr, is_imm12, 1,
+         "    andi {x}, {y}, {imm}\n"},
+        {KOOPA_RBO_OR, true, nullptr, is_imm12, 1, "    ori {x}, {y}, {imm}\n"},
+        {KOOPA_RBO_XOR, true, nullptr, is_imm12, 1,
+         "    xori {x}, {y}, {imm}\n"},
+        {KOOPA_RBO_LT, true, nullptr, is_imm12, 1,
+         "    slti {x}, {y}, {imm}\n"},
+        // y <= imm 即 y < imm + 1。
+        {KOOPA_RBO_LE, true, nullptr, is_imm12_minus_1, 1,
+         "    slti {x}, {y}, {imm_plus_1}\n"},
+        {KOOPA_RBO_GE, true, nullptr, is_imm12, 2,
+         "    slti {x}, {y}, {imm}\n    xori {x}, {x}, 1\n"},
+        {KOOPA_RBO_EQ, true, nullptr, is_zero, 1, "    seqz {x}, {y}\n"},
+        {KOOPA_RBO_EQ, true, nullptr, is_imm12, 2,
+         "    xori {x}, {y}, {imm}\n    seqz {x}, {x}\n"},
+        {KOOPA_RBO_NOT_EQ, true, nullptr, is_zero, 1, "    snez {x}, {y}\n"},
+        {KOOPA_RBO_NOT_EQ, true, nullptr, is_imm12, 2,
+         "    xori {x}, {y}, {imm}\n    snez {x}, {x}\n"},
+        {KOOPA_RBO_SHL, true, nullptr, is_shift_amount, 1,
+         "    slli {x}, {y}, {imm}\n"},
+        {KOOPA_RBO_SHR, true, nullptr, is_shift_amount, 1,
+         "    srli {x}, {y}, {imm}\n"},
+        {KOOPA_RBO_SAR, true, nullptr, is_shift_amount, 1,
+         "    srai {x}, {y}, {imm}\n"},
+        {KOOPA_RBO_MUL, true, nullptr, is_power_of_2, 1,
+         "    slli {x}, {y}, {log2_imm}\n"},
+
+        // Zba：y * (2^scale + 1) * 2^shift = ((y << scale) + y) << shift。
+        {KOOPA_RBO_MUL, true, has_zba, is_unshifted_zba_multiplier, 1,
+         "    sh{zba_scale}add {x}, {y}, {y}\n"},
+        {KOOPA_RBO_MUL, true, has_zba, is_zba_multiplier, 2,
+         "    sh{zba_scale}add {x}, {y}, {y}\n"
+         "    slli {x}, {x}, {zba_shift}\n"},
+    };
+    return patterns;
+}
+
+binary_tiling_t compiler::select_binary_pattern(const riscv_target_t& target,
+                                                koopa_raw_binary_op_t op,
+                                                std::optional<int32_t> lhs,
+                                                std::optional<int32_t> rhs)
+{
+    binary_tiling_t ret{nullptr, false, INT_MAX};
+    for (const auto& pattern : binary_patterns())
+    {
+        if (pattern.op != op ||
+            (pattern.is_available && !pattern.is_available(target)))
+            continue;
+        for (bool is_swapped : {false, true})
+        {
+            if (is_swapped && !is_commutative(op))
+                continue;
+            auto left = is_swapped ? rhs : lhs;
+            auto right = is_swapped ? lhs : rhs;
+            int cost = pattern.cost + literal_cost(left);
+            if (pattern.has_immediate)
+            {
+                if (!right || !pattern.accepts(*right))
+                    continue;
+            }
+            else
+                cost += literal_cost(right);
+            // 代价相同时选择表中靠前的模式。
+            if (cost < ret.cost)
+                ret = {&pattern, is_swapped, cost};
+        }
+    }
+    assert(ret.pattern);
+    return ret;
+}
+
+std::string compiler::emit_binary_pattern(const binary_pattern_t& pattern,
+                                          const std::string& x,
+                                          const std::string& y,
+                                          const std::string& z, int32_t imm)
+{
+    auto split = split_zba_multiplier(imm).value_or(std::make_pair(0, 0));
+    return fmt::format(
+        fmt::runtime(pattern.code), fmt::arg("x", x), fmt::arg("y", y),
+        fmt::arg("z", z), fmt::arg("imm", imm),
+        fmt::arg("neg_imm", -int64_t(imm)),
+        fmt::arg("imm_plus_1", int64_t(imm) + 1),
+        fmt::arg("log2_imm", std::countr_zero(uint32_t(imm))),
+        fmt::arg("zba_scale", split.first),
+        fmt::arg("zba_shift", split.second));
+}
+
+std::optional<std::string_view> compiler::compare_branch_of(
+    koopa_raw_binary_op_t op)
+{
+    switch (op)
+    {
+    case KOOPA_RBO_LT:
+        return "blt";
+    case KOOPA_RBO_GT:
+        return "bgt";
+    case KOOPA_RBO_LE:
+        return "ble";
+    case KOOPA_RBO_GE:
+        return "bge";
+    case KOOPA_RBO_EQ:
+        return "beq";
+    case KOOPA_RBO_NOT_EQ:
+        return "bne";
+    default:
+        return std::nullopt;
+    }
+}
+
+#endif
@@ -0,0 +1,120 @@
+/**
+ * @file instruction_patterns.h
+ * @author UnnamedOrange
+ * @brief Instruction patterns for instruction selection.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(COMPILER_LINK_KOOPA)
+#include <koopa.h>
+#endif
+
+#include "koopa_to_riscv.h"
+
+namespace compiler
+{
+#if defined(COMPILER_LINK_KOOPA)
+    /**
+     * @brief Pattern covering a binary instruction with RISC-V instructions.
+     * Supporting a new target extension only needs new patterns.
+     */
+    struct binary_pattern_t
+    {
+        koopa_raw_binary_op_t op;
+        /**
+         * @brief Whether the right operand is encoded as an immediate instead
+         * of a register.
+         */
+        bool has_immediate;
+        /**
+         * @brief Check whether the target supports the pattern. nullptr means
+         * the base ISA.
+         */
+        bool (*is_available)(const riscv_target_t& target);
+        /**
+         * @brief Check whether the immediate can be encoded. Only used if the
+         * pattern has an immediate.
+         */
+        bool (*accepts)(int32_t imm);
+        /**
+         * @brief Estimated cycles. Each instruction costs 1 except
+         * multiplication and division, which are slower.
+         */
+        int cost;
+        /**
+         * @brief Instructions in fmt format. Available arguments: {x} the
+         * result register, {y} {z} the operand registers, {imm} the right
+         * operand, {neg_imm} -imm, {imm_plus_1} imm + 1, {log2_imm} log2(imm),
+         * and {zba_scale} {zba_shift} from split_zba_multiplier(imm).
+         */
+        std::string_view code;
+    };
+
+    /**
+     * @brief Tiling of a binary instruction chosen by select_binary_pattern.
+     */
+    struct binary_tiling_t
+    {
+        const binary_pattern_t* pattern;
+        /**
+         * @brief Whether the operands of a commutative instruction are
+         * swapped to match the pattern.
+         */
+        bool is_swapped;
+        /**
+         * @brief Estimated cycles, including the instructions loading
+         * literals to registers.
+         */
+        int cost;
+    };
+
+    /**
+     * @brief Split a multiplier into (2^scale + 1) * 2^shift, where scale is
+     * 1, 2 or 3, so that the multiplication can be done by sh1add/sh2add/
+     * sh3add of Zba and an optional slli.
+     *
+     * @return std::optional<std::pair<int, int>> The scale and the shift.
+     */
+    std::optional<std::pair<int, int>> split_zba_multiplier(int32_t multiplier);
+
+    /**
+     * @brief Get the pattern table of binary instructions.
+     */
+    const std::vector<binary_pattern_t>& binary_patterns();
+    /**
+     * @brief Choose the pattern of least cost for a binary instruction.
+     *
+     * @param lhs The left operand if it is a literal.
+     * @param rhs The right operand if it is a literal.
+     */
+    binary_tiling_t select_binary_pattern(const riscv_target_t& target,
+                                          koopa_raw_binary_op_t op,
+                                          std::optional<int32_t> lhs,
+                                          std::optional<int32_t> rhs);
+    /**
+     * @brief Generate the instructions of a pattern.
+     */
+    std::string emit_binary_pattern(const binary_pattern_t& pattern,
+                                     const std::string& x,
+                                     const std::string& y,
+                                     const std::string& z, int32_t imm);
+    /**
+     * @brief Get the conditional branch instruction that compares two
+     * registers as a binary instruction does, if any.
+     * A comparison used only by the following branch is fused into it.
+     */
+    std::optional<std::string_view> compare_branch_of(
+        koopa_raw_binary_op_t op);
+#endif
+} // namespace compiler
@@ -0,0 +1,347 @@
+/**
+ * @file koopa_to_c.cpp
+ * @author UnnamedOrange
+ * @brief Compile Koopa IR to C.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "koopa_to_c.h"
+
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+
+#include <fmt/core.h>
+
+#include <ir/koopa_program.h>
+#include <job_budget.hpp>
+
+using namespace compiler;
+using namespace compiler::ir;
+
+namespace
+{
+    /**
+     * @brief Parsed signature of "fun" or "decl".
+     */
+    struct signature_t
+    {
+        std::string name;
+        std::vector<std::string> parameter_types;
+        bool returns_value{};
+    };
+
+    /**
+     * @brief Parse e.g. "@f(@x: i32, *i32): i32" after "fun " or "decl ".
+     */
+    signature_t parse_signature(std::string_view str)
+    {
+        signature_t ret;
+        auto open = str.find('(');
+        auto close = str.rfind(')');
+        if (open == std::string_view::npos || close == std::string_view::npos)
+            throw std::runtime_error(
+                fmt::format("[Error] Invalid Koopa IR: {}.", str));
+        auto name_begin = str.find('@');
+        ret.name = str.substr(name_begin + 1, open - name_begin - 1);
+        auto parameters = str.substr(open + 1, close - open - 1);
+        while (!parameters.empty())
+        {
+            auto pos = parameters.find(',');
+            auto parameter = parameters.substr(0, pos);
+            // 函数定义中的参数带有名称。
+            if (auto colon = parameter.find(':');
+                colon != std::string_view::npos)
+                parameter = parameter.substr(colon + 1);
+            ret.parameter_types.push_back(parameter.find('*') ==
+                                                  std::string_view::npos
+                                              ? "int"
+                                              : "int *");
+            if (pos == std::string_view::npos)
+                break;
+            parameters = parameters.substr(pos + 1);
+        }
+        ret.returns_value =
+            str.substr(close + 1).find(':') != std::string_view::npos;
+        return ret;
+    }
+
+    /**
+     * @brief Get the parameter list of a prototype, e.g. "int, int *".
+     */
+    std::string parameter_list(const signature_t& signature)
+    {
+        std::string ret;
+        for (size_t i = 0; i < signature.parameter_types.size(); i++)
+            ret += fmt::format("{}{}", i ? ", " : "",
+                               signature.parameter_types[i]);
+        return ret.empty() ? "void" : ret;
+    }
+
+    std::string c_literal(int32_t literal)
+    {
+        // -2147483648 在 C 中是对 2147483648 取负，其类型不是 int。
+        if (literal == std::numeric_limits<int32_t>::min())
+            return "(-2147483647 - 1)";
+        return std::to_string(literal);
+    }
+
+    /**
+     * @brief Code generator of a function.
+     */
+    class function_generator
+    {
+    private:
+        const function_t& function;
+        const std::unordered_set<std::string>& defined_functions;
+        std::unordered_set<std::string> locals;
+        std::string ret;
+
+    public:
+        function_generator(const function_t& function,
+                           const std::unordered_set<std::string>&
+                               defined_functions)
+            : function(function), defined_functions(defined_functions)
+        {
+        }
+
+    public:
+        std::string generate()
+        {
+            auto signature = parse_signature(function.header);
+            if (signature.name == "main")
+                ret += "int main(void)\n{\n";
+            else
+            {
+                std::string parameters;
+                for (size_t i = 0; i < function.parameters.size(); i++)
+                {
+                    locals.insert(function.parameters[i]);
+                    parameters += fmt::format(
+                        "{}{} {}", i ? ", " : "",
+                        signature.parameter_types[i],
+                        name_of(function.parameters[i]));
+                }
+                ret += fmt::format("static {} f_{}({})\n{{\n",
+                                   signature.returns_value ? "int" : "void",
+                                   signature.name,
+                                   parameters.empty() ? "void" : parameters);
+            }
+
+            // 变量都在开头声明，使 goto 不会跳过声明。
+            for (const auto& block : function.blocks)
+            {
+                for (const auto& instruction : block.instructions)
+                {
+                    if (instruction.result.empty())
+                        continue;
+                    locals.insert(instruction.result);
+                    ret += fmt::format("    int {};\n",
+                                       name_of(instruction.result));
+                }
+            }
+
+            // 只输出被跳转到的标号，避免未使用标号的警告。
+            std::unordered_set<std::string> targets;
+            for (const auto& block : function.blocks)
+                for (auto instruction : block.instructions)
+                    for (auto label : instruction.label_operands())
+                        targets.insert(*label);
+            for (const auto& block : function.blocks)
+            {
+                if (targets.count(block.label))
+                    ret += fmt::format("{}:;\n", label_of(block.label));
+                check_job_budget();
+                for (const auto& instruction : block.instructions)
+                    visit(instruction);
+            }
+            ret += "}\n\n";
+            return std::move(ret);
+        }
+
+    private:
+        std::string name_of(const std::string& value) const
+        {
+            if (value.starts_with('%'))
+                return fmt::format("t_{}", value.substr(1));
+            if (locals.count(value))
+                return fmt::format("v_{}", value.substr(1));
+            return fmt::format("g_{}", value.substr(1));
+        }
+        std::string label_of(const std::string& label) const
+        {
+            return fmt::format("L_{}", label.substr(1));
+        }
+        std::string operand(const std::string& value) const
+        {
+            if (auto literal = literal_of(value))
+                return c_literal(*literal);
+            return name_of(value);
+        }
+
+        void visit(const instruction_t& instruction)
+        {
+            const auto& op = instruction.op;
+            const auto& operands = instruction.operands;
+            if (op == "alloc")
+                return;
+            if (op == "load")
+                ret += fmt::format("    {} = {};\n",
+                                   name_of(instruction.result),
+                                   name_of(operands[0]));
+            else if (op == "store")
+                ret += fmt::format("    {} = {};\n", name_of(operands[1]),
+                                   operand(operands[0]));
+            else if (instruction.is_binary())
+                ret += fmt::format("    {} = {};\n",
+                                   name_of(instruction.result),
+                                   binary_expression(instruction));
+            else if (op == "br")
+                ret += fmt::format("    if ({})\n        goto {};\n"
+                                   "    goto {};\n",
+                                   operand(operands[0]), label_of(operands[1]),
+                                   label_of(operands[2]));
+            else if (op == "jump")
+                ret += fmt::format("    goto {};\n", label_of(operands[0]));
+            else if (op == "ret")
+            {
+                if (operands.empty())
+                    ret += "    return;\n";
+                else
+                    ret += fmt::format("    return {};\n",
+                                       operand(operands[0]));
+            }
+            else if (op == "call")
+            {
+                auto callee = operands[0].substr(1);
+                if (defined_functions.count(operands[0]) && callee != "main")
+                    callee = "f_" + callee;
+                std::string arguments;
+                for (size_t i = 1; i < operands.size(); i++)
+                    arguments +=
+                        fmt::format("{}{}", i > 1 ? ", " : "",
+                                    operand(operands[i]));
+                ret += "    ";
+                if (!instruction.result.empty())
+                    ret += fmt::format("{} = ", name_of(instruction.result));
+                ret += fmt::format("{}({});\n", callee, arguments);
+            }
+            else
+                throw std::runtime_error(fmt::format(
+                    "[Error] Unsupported Koopa IR instruction: {}.", op));
+        }
+        std::string binary_expression(const instruction_t& instruction) const
+        {
+            const auto& op = instruction.op;
+            auto lhs = operand(instruction.operands[0]);
+            auto rhs = operand(instruction.operands[1]);
+
+            // 有符号溢出在 C 中是未定义行为，用无符号数实现回绕。
+            static const std::unordered_map<std::string_view, std::string_view>
+                wrapping{{"add", "+"}, {"sub", "-"}, {"mul", "*"}};
+            static const std::unordered_map<std::string_view, std::string_view>
+                plain{{"and", "&"}, {"or", "|"}, {"xor", "^"}, {"eq", "=="},
+                      {"ne", "!="}, {"lt", "<"}, {"gt", ">"},   {"le", "<="},
+                      {"ge", ">="}};
+            if (auto it = wrapping.find(op); it != wrapping.end())
+                return fmt::format("(int)((unsigned){} {} (unsigned){})", lhs,
+                                   it->second, rhs);
+            // 除数为 0 和 INT_MIN / -1 在 C 中是未定义行为，由辅助函数按
+            // RISC-V 的结果处理。
+            if (op == "div" || op == "mod")
+                return fmt::format("koopa_{}({}, {})", op, lhs, rhs);
+            if (auto it = plain.find(op); it != plain.end())
+                return fmt::format("{} {} {}", lhs, it->second, rhs);
+            // 移位量与 RISC-V 一样只取低 5 位。
+            if (op == "shl")
+                return fmt::format("(int)((unsigned){} << ({} & 31))", lhs,
+                                   rhs);
+            if (op == "shr")
+                return fmt::format("(int)((unsigned){} >> ({} & 31))", lhs,
+                                   rhs);
+            return fmt::format("{} >> ({} & 31)", lhs, rhs);
+        }
+    };
+
+    /**
+     * @brief Generate a global variable, e.g. "global @x = alloc i32, 1".
+     */
+    std::string generate_global(std::string_view line)
+    {
+        auto name_begin = line.find('@');
+        auto name_end = line.find(' ', name_begin);
+        auto name = line.substr(name_begin + 1, name_end - name_begin - 1);
+        auto init = line.substr(line.rfind(',') + 1);
+        while (init.starts_with(' '))
+            init.remove_prefix(1);
+        if (init == "zeroinit")
+            return fmt::format("static int g_{};\n", name);
+        return fmt::format("static int g_{} = {};\n", name,
+                           c_literal(*literal_of(std::string(init))));
+    }
+
+    /**
+     * @brief Generate the extern declaration of a library function.
+     */
+    std::string generate_declaration(std::string_view line)
+    {
+        auto signature = parse_signature(line);
+        return fmt::format("extern {} {}({});\n",
+                           signature.returns_value ? "int" : "void",
+                           signature.name, parameter_list(signature));
+    }
+} // namespace
+
+std::string koopa_to_c::compile(const std::string& koopa_ir_str)
+{
+    auto program = program_t::parse(koopa_ir_str);
+
+    std::string ret = "/* Generated from Koopa IR. */\n\n";
+    // 与 RISC-V 相同：除以 0 得 -1，对 0 取模得被除数，INT_MIN / -1 得
+    // INT_MIN，INT_MIN % -1 得 0。
+    ret += "static inline int koopa_div(int lhs, int rhs)\n"
+           "{\n"
+           "    return rhs == 0    ? -1\n"
+           "           : rhs == -1 ? (int)(0u - (unsigned)lhs)\n"
+           "                       : lhs / rhs;\n"
+           "}\n"
+           "static inline int koopa_mod(int lhs, int rhs)\n"
+           "{\n"
+           "    return rhs == 0 ? lhs : rhs == -1 ? 0 : lhs % rhs;\n"
+           "}\n\n";
+    std::unordered_set<std::string> defined_functions;
+    std::string prototypes;
+    for (const auto& item : program.items)
+    {
+        if (auto line = std::get_if<std::string>(&item))
+        {
+            if (line->starts_with("decl "))
+                ret += generate_declaration(*line);
+            else if (line->starts_with("global "))
+                ret += generate_global(*line);
+            continue;
+        }
+        const auto& function = std::get<function_t>(item);
+        auto signature = parse_signature(function.header);
+        defined_functions.insert("@" + signature.name);
+        if (signature.name == "main")
+            continue;
+        // 函数可能在定义之前被调用。
+        prototypes += fmt::format("static {} f_{}({});\n",
+                                  signature.returns_value ? "int" : "void",
+                                  signature.name, parameter_list(signature));
+    }
+    ret += '\n';
+    if (!prototypes.empty())
+        ret += prototypes + '\n';
+
+    for (const auto& item : program.items)
+        if (auto function = std::get_if<function_t>(&item))
+            ret += function_generator(*function, defined_functions).generate();
+    return ret;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file koopa_to_c.h
+ * @author UnnamedOrange
+ * @brief Compile Koopa IR to C.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace compiler
+{
+    /**
+     * @brief Compile Koopa IR to portable C.
+     * Basic blocks become labels and gotos, values become locals, and
+     * library functions become extern declarations. The output can be
+     * compiled by the host C compiler together with runtime/sysy_host.c.
+     */
+    class koopa_to_c
+    {
+    public:
+        /**
+         * @brief Compile Koopa IR to C.
+         * If the IR cannot be parsed, throw an std::runtime_error.
+         *
+         * @param koopa_ir_str Koopa IR in string.
+         * @return std::string C source in string.
+         */
+        std::string compile(const std::string& koopa_ir_str);
+    };
+} // namespace compiler
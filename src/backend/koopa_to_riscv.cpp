@@ -9,31 +9,225 @@
 
 #include "koopa_to_riscv.h"
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cctype>
 #include <cstdint>
 #include <iostream>
 #include <map>
+#include <optional>
+#include <set>
 #include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <fmt/core.h>
 
+using namespace compiler;
+
+riscv_target_t riscv_target_t::parse(const std::string& march)
+{
+    riscv_target_t ret;
+    auto error = [&](const std::string& reason) {
+        return std::invalid_argument(
+            fmt::format("[Error] Unsupported -march {}: {}.", march, reason));
+    };
+
+    std::string isa;
+    for (auto c : march)
+        isa += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    if (!isa.starts_with("rv32i"))
+        throw error("only rv32i based targets are supported");
+
+    // 单字母扩展。
+    size_t pos = 5;
+    bool has_m = false;
+    for (; pos < isa.size() && isa[pos] != '_'; pos++)
+    {
+        if (isa[pos] == 'm')
+            has_m = true;
+        else if (std::string_view("afdc").find(isa[pos]) ==
+                 std::string_view::npos)
+            throw error(fmt::format("unknown extension {}", isa[pos]));
+    }
+    if (!has_m)
+        throw error("the M extension is required");
+
+    // 以下划线分隔的多字母扩展。
+    while (pos < isa.size())
+    {
+        size_t next = isa.find('_', pos + 1);
+        auto extension = isa.substr(pos + 1, next - pos - 1);
+        if (extension == "zba")
+            ret.zba = true;
+        else if (extension == "zbb")
+            ret.zbb = true;
+        else if (extension.empty() || extension[0] != 'z')
+            throw error(fmt::format("unknown extension {}", extension));
+        // 其他 Z 扩展不影响代码生成，忽略。
+        pos = next;
+    }
+    return ret;
+}
+koopa_to_riscv::koopa_to_riscv(const riscv_target_t& target) : target(target)
+{
+}
+
 #if defined(COMPILER_LINK_KOOPA)
 
 #include <koopa.h>
 
 #include "global_variable_manager.h"
+#include "instruction_patterns.h"
+#include "profiler_runtime.h"
 #include "register_manager.h"
+#include "runtime_shim.h"
 #include "stack_frame_manager.h"
+#include <ir/koopa_program.h>
+#include <job_budget.hpp>
 
-using namespace compiler;
-
+riscv_target_t current_target;
 register_manager rm;
 stack_frame_manager sfm;
 global_variable_manager gvm;
 
 koopa_raw_function_t current_function;
+// 每条指令所在的基本块。
+std::unordered_map<koopa_raw_value_t, koopa_raw_basic_block_t> block_of;
+// 在定义所在的基本块之外被使用的值。这些值需要在基本块的边界写回栈帧。
+std::unordered_set<koopa_raw_value_t> escaping_values;
+// 当前基本块中各个值剩余的使用次数。
+std::unordered_map<koopa_raw_value_t, size_t> remaining_uses;
+// 当前函数是否为叶函数。叶函数不调用其他函数，因此不保存返回地址。
+bool current_function_is_leaf;
+// 已生成的函数实际写入的寄存器（包括其调用的函数写入的寄存器）。
+std::unordered_map<koopa_raw_function_t, std::set<std::string>> clobbers_of;
+/**
+ * @brief Generated code of a function that can be reused by later
+ * compilations in the same process.
+ */
+struct function_code_t
+{
+    std::string code;
+    std::set<std::string> clobbers;
+};
+// 以函数的 Koopa IR 及其生成环境为键的已生成代码，只保留最近一次编译用到的。
+std::unordered_map<std::string, function_code_t> function_codes;
+// 最近一次编译中复用和重新生成的函数个数。
+size_t reused_function_count;
+size_t generated_function_count;
+// 当前程序中每个函数的 Koopa IR 文本。
+std::unordered_map<std::string, std::string> koopa_function_texts;
+// 当前程序中函数以外的 Koopa IR 文本，即全局变量和函数声明。
+std::string koopa_global_text;
+// 当前基本块中每条调用指令的位置和它可能写入的寄存器。
+std::vector<std::pair<size_t, std::set<std::string>>> block_calls;
+// 当前基本块中各个值最后一次被使用的位置。
+std::unordered_map<koopa_raw_value_t, size_t> last_use_index;
+// 当前指令在基本块中的位置。
+size_t current_index;
+// 当前基本块中与紧随其后的条件跳转合并的比较指令。
+std::unordered_set<koopa_raw_value_t> fused_compares;
+// 插入剖析钩子时各个函数的编号。
+std::unordered_map<koopa_raw_function_t, size_t> profile_index_of;
+// 行号标记给出的源文件。为空时不生成行号信息。
+std::string debug_source_file;
+// 当前函数中按顺序每条指令对应的源码行号，0 表示未知。
+std::vector<int> current_instruction_lines;
+// 当前指令在函数中的序号。
+size_t current_instruction_ordinal;
+// 最近一条 .loc 指示的行号。
+int current_source_line;
+
+/**
+ * @brief Check whether a function uses the internal calling convention.
+ * Only main is called from outside, so other defined functions are local
+ * symbols and need not follow the standard calling convention.
+ */
+bool is_internal(const koopa_raw_function_t& func)
+{
+    return func->bbs.len && std::string_view(func->name + 1) != "main";
+}
+/**
+ * @brief Get the argument registers of a function.
+ */
+std::vector<std::string> argument_regs(const koopa_raw_function_t& func)
+{
+    if (is_internal(func))
+        return {rm.internal_arg_reg_names.begin(),
+                rm.internal_arg_reg_names.end()};
+    return {rm.arg_reg_names.begin(), rm.arg_reg_names.end()};
+}
+/**
+ * @brief Check whether a call is replaced by the inlined fast path of the
+ * buffered putch.
+ */
+bool is_inline_putch(const koopa_raw_call_t& call_inst)
+{
+    return current_target.runtime_shim && !call_inst.callee->bbs.len &&
+           std::string_view(call_inst.callee->name + 1) == "putch";
+}
+/**
+ * @brief Get the registers that may be written by a call following the
+ * standard calling convention.
+ */
+std::set<std::string> all_clobbered_regs()
+{
+    std::set<std::string> ret(rm.reg_names.begin(), rm.reg_names.end());
+    ret.emplace(rm.reg_ret);
+    return ret;
+}
+/**
+ * @brief Get the registers that may be written by a call to a function.
+ */
+std::set<std::string> clobbered_regs(const koopa_raw_function_t& func)
+{
+    if (auto it = clobbers_of.find(func); it != clobbers_of.end())
+        return it->second;
+    // 尚未生成的函数和库函数可能写入所有调用者保存的寄存器。
+    return all_clobbered_regs();
+}
+/**
+ * @brief Get the registers that may be written by a call instruction,
+ * including the argument registers and the return value register.
+ */
+std::set<std::string> clobbered_regs(const koopa_raw_call_t& call_inst)
+{
+    // 内联的 putch 只使用临时寄存器，刷新缓冲区的函数不破坏寄存器。
+    if (is_inline_putch(call_inst))
+        return {};
+    auto ret = clobbered_regs(call_inst.callee);
+    auto regs = argument_regs(call_inst.callee);
+    size_t count = std::min<size_t>(regs.size(), call_inst.args.len);
+    ret.insert(regs.begin(), regs.begin() + count);
+    ret.emplace(rm.reg_ret);
+    return ret;
+}
+/**
+ * @brief Get the registers clobbered by calls in the current basic block
+ * before the last use of a value.
+ */
+std::set<std::string> clobbered_during(const koopa_raw_value_t& value,
+                                       bool is_defining)
+{
+    std::set<std::string> ret;
+    auto it = last_use_index.find(value);
+    if (it == last_use_index.end())
+        return ret;
+    for (const auto& [index, regs] : block_calls)
+    {
+        // 调用指令的结果在调用之后才被写入。
+        bool is_after = is_defining ? current_index < index
+                                    : current_index <= index;
+        if (is_after && index < it->second)
+            ret.insert(regs.begin(), regs.end());
+    }
+    return ret;
+}
 
 /**
  * @brief Generate codes that load a value in stack to a register.
@@ -61,7 +255,10 @@ std::string generate_load(const std::string& target_reg,
                           const koopa_raw_value_t& value)
 {
     std::string ret;
-    if (gvm.count(value))
+    if (gvm.count_small(value))
+        ret += fmt::format("    lw {}, {}(gp)\n", target_reg,
+                           gvm.gp_offset(value));
+    else if (gvm.count(value))
     {
         ret += fmt::format("    la {}, {}\n", target_reg, gvm.at(value));
         ret += fmt::format("    lw {}, 0({})\n", target_reg, target_reg);
@@ -99,7 +296,10 @@ std::string generate_store(const std::string& target_reg,
                            const koopa_raw_value_t& value)
 {
     std::string ret;
-    if (gvm.count(value))
+    if (gvm.count_small(value))
+        ret += fmt::format("    sw {}, {}(gp)\n", target_reg,
+                           gvm.gp_offset(value));
+    else if (gvm.count(value))
     {
         ret += fmt::format("    la {}, {}\n", temp_reg, gvm.at(value));
         ret += fmt::format("    sw {}, 0({})\n", target_reg, temp_reg);
@@ -112,6 +312,321 @@ std::string generate_store(const std::string& target_reg,
     return ret;
 }
 
+/**
+ * @brief Check whether a value is the result of an instruction that can be
+ * cached in a register.
+ */
+bool is_register_value(const koopa_raw_value_t& value)
+{
+    switch (value->kind.tag)
+    {
+    case KOOPA_RVT_BINARY:
+    case KOOPA_RVT_LOAD:
+    case KOOPA_RVT_CALL:
+        return value->ty->tag != KOOPA_RTT_UNIT;
+    default:
+        return false;
+    }
+}
+/**
+ * @brief Get the operands of an instruction that can be cached in registers.
+ * An operand used twice appears twice.
+ */
+std::vector<koopa_raw_value_t> register_operands(
+    const koopa_raw_value_t& instruction)
+{
+    std::vector<koopa_raw_value_t> ret;
+    const auto& kind = instruction->kind;
+    switch (kind.tag)
+    {
+    case KOOPA_RVT_BINARY:
+        ret.push_back(kind.data.binary.lhs);
+        ret.push_back(kind.data.binary.rhs);
+        break;
+    case KOOPA_RVT_STORE:
+        ret.push_back(kind.data.store.value);
+        break;
+    case KOOPA_RVT_BRANCH:
+        ret.push_back(kind.data.branch.cond);
+        break;
+    case KOOPA_RVT_CALL:
+        for (uint32_t i = 0; i < kind.data.call.args.len; i++)
+            ret.push_back(reinterpret_cast<koopa_raw_value_t>(
+                kind.data.call.args.buffer[i]));
+        break;
+    case KOOPA_RVT_RETURN:
+        if (kind.data.ret.value)
+            ret.push_back(kind.data.ret.value);
+        break;
+    default:
+        break;
+    }
+    std::erase_if(ret, [](const auto& value) {
+        return !is_register_value(value);
+    });
+    return ret;
+}
+/**
+ * @brief Generate codes that write a cached value back to its stack slot if
+ * needed, and free its register.
+ */
+std::string generate_spill(const koopa_raw_value_t& value,
+                           const std::string& temp_reg)
+{
+    std::string ret;
+    if (rm.is_dirty(value))
+        ret += generate_store(rm[value], temp_reg, value);
+    rm.unbind(value);
+    return ret;
+}
+/**
+ * @brief Generate codes that allocate a register for a value.
+ * If no register is vacant, another value is evicted.
+ * `rm.reg_x` is used as the temporary register for the eviction.
+ *
+ * @param reg Set to the allocated register.
+ * @param pinned Registers that must not be evicted.
+ */
+std::string generate_allocate(std::string& reg, const koopa_raw_value_t& value,
+                              const std::vector<std::string>& pinned,
+                              bool dirty)
+{
+    std::string ret;
+    // 尽量选择之后的调用不会写入的寄存器，使值在调用之后仍然有效。
+    if (auto vacant = rm.vacant_reg(clobbered_during(value, dirty)))
+        reg = *vacant;
+    else
+    {
+        auto victim = rm.victim(pinned);
+        reg = rm[victim];
+        ret += generate_spill(victim, rm.reg_x);
+    }
+    rm.bind(value, reg, dirty);
+    return ret;
+}
+/**
+ * @brief Generate codes that make an operand available in a register.
+ * A value that will be used again in the current basic block is cached.
+ *
+ * @param reg Set to the register holding the operand.
+ * @param target_reg The register to use if the operand is not cached.
+ * @param pinned Registers that must not be evicted.
+ */
+std::string generate_use(std::string& reg, const std::string& target_reg,
+                         const std::string& temp_reg,
+                         const koopa_raw_value_t& value,
+                         const std::vector<std::string>& pinned = {})
+{
+    std::string ret;
+    reg = target_reg;
+    if (value->kind.tag == KOOPA_RVT_INTEGER)
+    {
+        // 将字面量存入寄存器。
+        ret += fmt::format("    li {}, {}\n", reg,
+                           value->kind.data.integer.value);
+    }
+    else if (rm.count(value))
+    {
+        // 直接使用缓存的寄存器。
+        reg = rm[value];
+        rm.touch(value);
+    }
+    else
+    {
+        // 之后还会用到，重新加载到一个缓存寄存器中。
+        if (is_register_value(value) && remaining_uses[value] > 1)
+            ret += generate_allocate(reg, value, pinned, false);
+        ret += generate_load(reg, temp_reg, value);
+    }
+    return ret;
+}
+/**
+ * @brief Get the value of a literal operand.
+ */
+std::optional<int32_t> literal_of(const koopa_raw_value_t& value)
+{
+    if (value->kind.tag != KOOPA_RVT_INTEGER)
+        return std::nullopt;
+    return value->kind.data.integer.value;
+}
+/**
+ * @brief Generate codes that make an operand of an arithmetic instruction
+ * available in a register. The literal 0 is read from the zero register.
+ */
+std::string generate_operand(std::string& reg, const std::string& target_reg,
+                             const koopa_raw_value_t& value,
+                             const std::vector<std::string>& pinned = {})
+{
+    if (literal_of(value) == 0)
+    {
+        reg = "zero";
+        return "";
+    }
+    return generate_use(reg, target_reg, rm.reg_x, value, pinned);
+}
+/**
+ * @brief Generate codes after an operand is used.
+ * When the operand is no longer used in the current basic block, its
+ * register is freed. If it is used in other basic blocks, it is written back
+ * here, at the end of its live range in the current basic block.
+ * `rm.reg_x` is used as the temporary register.
+ */
+std::string generate_release(const koopa_raw_value_t& value)
+{
+    std::string ret;
+    if (!is_register_value(value))
+        return ret;
+    auto& uses = remaining_uses[value];
+    if (uses)
+        uses--;
+    if (!uses && rm.count(value))
+    {
+        if (!escaping_values.count(value))
+            rm.set_clean(value); // 之后不再使用，无需写回。
+        ret += generate_spill(value, rm.reg_x);
+    }
+    return ret;
+}
+/**
+ * @brief Generate codes that allocate the register for the result of an
+ * instruction.
+ *
+ * @param reg Set to the register for the result. If the result is not used
+ * in the current basic block, it is set to `fallback_reg`.
+ * @param pinned Registers that must not be evicted.
+ */
+std::string generate_define(std::string& reg, const koopa_raw_value_t& value,
+                            const std::string& fallback_reg,
+                            const std::vector<std::string>& pinned = {})
+{
+    reg = fallback_reg;
+    if (!remaining_uses[value])
+        return "";
+    return generate_allocate(reg, value, pinned, true);
+}
+/**
+ * @brief Generate codes after the result of an instruction is computed.
+ * A result not cached but used in other basic blocks is written back at once.
+ */
+std::string generate_defined(const std::string& reg,
+                             const std::string& temp_reg,
+                             const koopa_raw_value_t& value)
+{
+    if (rm.count(value) || !escaping_values.count(value))
+        return "";
+    return generate_store(reg, temp_reg, value);
+}
+/**
+ * @brief Check whether the result of an instruction is used anywhere.
+ */
+bool is_used(const koopa_raw_value_t& value)
+{
+    return remaining_uses[value] || escaping_values.count(value);
+}
+/**
+ * @brief Generate codes that write back all cached values used in other
+ * basic blocks. Call this before the terminator of a basic block.
+ */
+std::string generate_flush()
+{
+    std::string ret;
+    for (auto value : rm.variables())
+    {
+        if (escaping_values.count(value) && rm.is_dirty(value))
+        {
+            ret += generate_store(rm[value], rm.reg_x, value);
+            rm.set_clean(value);
+        }
+    }
+    return ret;
+}
+/**
+ * @brief Get the defined functions called by a function.
+ */
+std::vector<koopa_raw_function_t> callees_of(const koopa_raw_function_t& func)
+{
+    std::vector<koopa_raw_function_t> ret;
+    for (uint32_t i = 0; i < func->bbs.len; i++)
+    {
+        auto bb =
+            reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        for (uint32_t j = 0; j < bb->insts.len; j++)
+        {
+            auto instruction =
+                reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            if (instruction->kind.tag != KOOPA_RVT_CALL)
+                continue;
+            auto callee = instruction->kind.data.call.callee;
+            if (callee->bbs.len &&
+                std::find(ret.begin(), ret.end(), callee) == ret.end())
+                ret.push_back(callee);
+        }
+    }
+    return ret;
+}
+/**
+ * @brief Split the call graph into strongly connected components.
+ * Components are returned in bottom-up order: callees before callers.
+ */
+std::vector<std::vector<koopa_raw_function_t>> call_graph_sccs(
+    const koopa_raw_slice_t& funcs)
+{
+    // Tarjan 算法。分量按照逆拓扑序产生，恰好是自底向上的顺序。
+    std::vector<std::vector<koopa_raw_function_t>> ret;
+    std::unordered_map<koopa_raw_function_t, size_t> index_of;
+    std::unordered_map<koopa_raw_function_t, size_t> low_link_of;
+    std::unordered_set<koopa_raw_function_t> on_stack;
+    std::vector<koopa_raw_function_t> stack;
+    auto connect = [&](auto&& self, const koopa_raw_function_t& func) -> void {
+        size_t index = index_of.size();
+        index_of[func] = low_link_of[func] = index;
+        stack.push_back(func);
+        on_stack.insert(func);
+        for (const auto& callee : callees_of(func))
+        {
+            if (!index_of.count(callee))
+            {
+                self(self, callee);
+                low_link_of[func] =
+                    std::min(low_link_of[func], low_link_of[callee]);
+            }
+            else if (on_stack.count(callee))
+                low_link_of[func] =
+                    std::min(low_link_of[func], index_of[callee]);
+        }
+        if (low_link_of[func] != index)
+            return;
+        auto& scc = ret.emplace_back();
+        koopa_raw_function_t member;
+        do
+        {
+            member = stack.back();
+            stack.pop_back();
+            on_stack.erase(member);
+            scc.push_back(member);
+        } while (member != func);
+    };
+    for (uint32_t i = 0; i < funcs.len; i++)
+    {
+        auto func = reinterpret_cast<koopa_raw_function_t>(funcs.buffer[i]);
+        if (func->bbs.len && !index_of.count(func))
+            connect(connect, func);
+    }
+    return ret;
+}
+/**
+ * @brief Check whether the functions in a strongly connected component call
+ * each other.
+ */
+bool is_recursive(const std::vector<koopa_raw_function_t>& scc)
+{
+    if (scc.size() > 1)
+        return true;
+    auto callees = callees_of(scc.front());
+    return std::find(callees.begin(), callees.end(), scc.front()) !=
+           callees.end();
+}
+
 std::string to_riscv(const std::string&);
 std::string visit(const koopa_raw_program_t&);
 std::string visit(const koopa_raw_slice_t&);
@@ -127,25 +642,229 @@ std::string visit(const koopa_raw_branch_t&);
 std::string visit(const koopa_raw_call_t&, const koopa_raw_value_t&);
 std::string visit(const koopa_raw_global_alloc_t&, const koopa_raw_value_t&);
 
+/**
+ * @brief Split Koopa IR text into functions and the other part.
+ */
+void split_koopa_text(const std::string& koopa)
+{
+    koopa_function_texts.clear();
+    koopa_global_text.clear();
+    std::string* function_text = nullptr;
+    size_t begin = 0;
+    while (begin < koopa.size())
+    {
+        size_t end = koopa.find('\n', begin);
+        end = end == std::string::npos ? koopa.size() : end + 1;
+        std::string_view line(koopa.data() + begin, end - begin);
+        if (!function_text && line.starts_with("fun @"))
+        {
+            auto name = line.substr(5, line.find('(') - 5);
+            function_text = &koopa_function_texts[std::string(name)];
+        }
+        (function_text ? *function_text : koopa_global_text) += line;
+        if (function_text && line.starts_with("}"))
+            function_text = nullptr;
+        begin = end;
+    }
+}
+/**
+ * @brief Get the key identifying the generated code of a function.
+ * Besides the function itself, the code depends on the target, the global
+ * variables and the registers clobbered by callees.
+ */
+std::string function_code_key(const koopa_raw_function_t& func)
+{
+    std::string ret = fmt::format(
+        "zba={} zbb={} small-data-limit={} runtime-shim={} "
+        "instrument-functions={} profile-index={}\n{}\n{}",
+        current_target.zba, current_target.zbb, current_target.small_data_limit,
+        current_target.runtime_shim, current_target.instrument_functions,
+        profile_index_of[func], koopa_global_text,
+        koopa_function_texts[func->name + 1]);
+    for (const auto& callee : callees_of(func))
+    {
+        ret += fmt::format("\n{}:", callee->name + 1);
+        for (const auto& reg : clobbered_regs(callee))
+            ret += fmt::format(" {}", reg);
+    }
+    return ret;
+}
+
+/**
+ * @brief Get the source line of each instruction in a function from the
+ * "//@line N" markers of its Koopa IR text.
+ */
+std::vector<int> instruction_lines(std::string_view function_text)
+{
+    std::vector<int> ret;
+    int line = 0;
+    while (!function_text.empty())
+    {
+        auto end = function_text.find('\n');
+        auto text = function_text.substr(0, end);
+        function_text = end == std::string_view::npos
+                            ? std::string_view()
+                            : function_text.substr(end + 1);
+        while (!text.empty() && std::isspace(static_cast<unsigned char>(
+                                    text.front())))
+            text.remove_prefix(1);
+        while (!text.empty() &&
+               std::isspace(static_cast<unsigned char>(text.back())))
+            text.remove_suffix(1);
+        if (text.starts_with(ir::line_marker_prefix))
+            line = std::stoi(
+                std::string(text.substr(ir::line_marker_prefix.size())));
+        else if (!text.empty() && !text.starts_with("//") &&
+                 !text.starts_with("fun ") && !text.starts_with("}") &&
+                 !text.ends_with(':'))
+            ret.push_back(line);
+    }
+    return ret;
+}
+/**
+ * @brief Generate a .loc directive if the source line changes.
+ */
+std::string generate_loc(int line)
+{
+    if (debug_source_file.empty() || !line || line == current_source_line)
+        return "";
+    current_source_line = line;
+    return fmt::format("    .loc 1 {} 0\n", line);
+}
+/**
+ * @brief Remove comments, including line markers, from Koopa IR text.
+ */
+std::string strip_comments(const std::string& koopa)
+{
+    std::string ret;
+    size_t begin = 0;
+    while (begin < koopa.size())
+    {
+        size_t end = koopa.find('\n', begin);
+        end = end == std::string::npos ? koopa.size() : end + 1;
+        std::string_view line(koopa.data() + begin, end - begin);
+        auto first = line.find_first_not_of(" \t");
+        if (first == std::string_view::npos ||
+            !line.substr(first).starts_with("//"))
+            ret += line;
+        begin = end;
+    }
+    return ret;
+}
+
 std::string to_riscv(const std::string& koopa)
 {
+    // 行号标记在 Koopa IR 的注释中，只在划分出的文本中使用。
     koopa_program_t program;
-    koopa_error_code_t ret = koopa_parse_from_string(koopa.c_str(), &program);
+    koopa_error_code_t ret =
+        koopa_parse_from_string(strip_comments(koopa).c_str(), &program);
     assert(ret == KOOPA_EC_SUCCESS);
     koopa_raw_program_builder_t builder = koopa_new_raw_program_builder();
     koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
     koopa_delete_program(program);
-    auto ret_riscv = visit(raw);
+    gvm.clear();
+    clobbers_of.clear();
+    split_koopa_text(koopa);
+    debug_source_file.clear();
+    if (auto pos = koopa_global_text.find(ir::file_marker_prefix);
+        pos != std::string::npos)
+    {
+        pos += ir::file_marker_prefix.size();
+        debug_source_file = koopa_global_text.substr(
+            pos, koopa_global_text.find('\n', pos) - pos);
+    }
+    // 超出预算时生成过程抛出异常，此时也要释放原始程序。
+    std::string ret_riscv;
+    try
+    {
+        ret_riscv = visit(raw);
+    }
+    catch (...)
+    {
+        koopa_delete_raw_program_builder(builder);
+        throw;
+    }
     koopa_delete_raw_program_builder(builder);
     return ret_riscv;
 }
 std::string visit(const koopa_raw_program_t& program)
 {
     std::string ret;
+    // 行号信息中的 1 号文件即源文件。
+    if (!debug_source_file.empty())
+    {
+        std::string escaped;
+        for (auto c : debug_source_file)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        ret += fmt::format("    .file 1 \"{}\"\n", escaped);
+    }
     // 访问所有全局变量。
     ret += visit(program.values);
-    // 访问所有函数。
-    ret += visit(program.funcs);
+    // 按函数在程序中的顺序编号，剖析结果中的名称与之对应。
+    std::vector<std::string> profile_names;
+    profile_index_of.clear();
+    reused_function_count = 0;
+    generated_function_count = 0;
+    for (uint32_t i = 0; i < program.funcs.len; i++)
+    {
+        auto func =
+            reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+        if (!func->bbs.len)
+            continue;
+        profile_index_of[func] = profile_names.size();
+        profile_names.emplace_back(func->name + 1);
+    }
+    // 按调用图自底向上的顺序生成函数，使调用者能够使用被调用者写入的寄存器。
+    // 输出时仍保持函数在程序中的顺序。
+    {
+        std::unordered_map<koopa_raw_function_t, std::string> code_of;
+        std::unordered_map<std::string, function_code_t> next_function_codes;
+        for (const auto& scc : call_graph_sccs(program.funcs))
+        {
+            // 递归的函数之间按照标准调用约定假设所有寄存器都会被写入。
+            if (is_recursive(scc))
+            {
+                generated_function_count += scc.size();
+                for (const auto& func : scc)
+                    code_of[func] = visit(func);
+                for (const auto& func : scc)
+                    clobbers_of[func] = all_clobbered_regs();
+                continue;
+            }
+            // 之前的编译中生成过相同的函数时直接复用。
+            const auto& func = scc.front();
+            auto key = function_code_key(func);
+            auto it = function_codes.find(key);
+            // 函数声明没有代码，不计入统计。
+            bool has_body = func->bbs.len;
+            if (it == function_codes.end())
+            {
+                generated_function_count += has_body;
+                code_of[func] = visit(func);
+                it = function_codes
+                         .emplace(key, function_code_t{code_of[func],
+                                                       clobbers_of[func]})
+                         .first;
+            }
+            else
+                reused_function_count += has_body;
+            code_of[func] = it->second.code;
+            clobbers_of[func] = it->second.clobbers;
+            next_function_codes.emplace(std::move(key), it->second);
+        }
+        function_codes = std::move(next_function_codes);
+        for (uint32_t i = 0; i < program.funcs.len; i++)
+            ret += code_of[reinterpret_cast<koopa_raw_function_t>(
+                program.funcs.buffer[i])];
+    }
+    if (current_target.runtime_shim)
+        ret += runtime_shim_riscv();
+    if (current_target.instrument_functions)
+        ret += profiler_runtime_riscv(profile_names);
     return ret;
 }
 std::string visit(const koopa_raw_slice_t& slice)
@@ -187,16 +906,37 @@ std::string visit(const koopa_raw_function_t& func)
     std::string ret;
 
     ret += "    .text\n";
-    ret += fmt::format("    .globl {}\n", func->name + 1);
+    // 内部函数不会被外部调用，不导出符号。
+    if (!is_internal(func))
+        ret += fmt::format("    .globl {}\n", func->name + 1);
     ret += fmt::format("{}:\n", func->name + 1);
 
+    // 导言属于函数定义所在的行。
+    current_instruction_lines =
+        instruction_lines(koopa_function_texts[func->name + 1]);
+    current_instruction_ordinal = 0;
+    current_source_line = 0;
+    if (!current_instruction_lines.empty())
+        ret += generate_loc(current_instruction_lines.front());
+
+    // 在入口处设置 gp，之后小数据段中的变量都通过 gp 访问。
+    if (std::string_view(func->name + 1) == "main" && gvm.small_size())
+    {
+        // 禁止链接器松弛，否则 la 可能被改写为相对 gp 的寻址。
+        ret += "    .option push\n";
+        ret += "    .option norelax\n";
+        ret += "    la gp, __global_pointer$\n";
+        ret += "    .option pop\n";
+    }
+
     // 重置栈帧。
     sfm.clear();
+    rm.clear_written();
+    current_function_is_leaf = true;
     // 扫描函数中的所有指令, 算出需要分配的栈空间总量。
     {
-        sfm.alloc_upper(4); // 为了方便，总是保存返回地址。
-
-        uint32_t max_parameter_count = 0;
+        // 需要通过栈传递的参数个数的最大值。
+        uint32_t max_stack_argument_count = 0;
 
         auto basic_blocks = func->bbs;
         for (uint32_t i = 0; i < basic_blocks.len; i++)
@@ -212,9 +952,14 @@ std::string visit(const koopa_raw_function_t& func)
                 {
                     if (instruction->kind.tag == KOOPA_RVT_CALL)
                     {
-                        max_parameter_count =
-                            std::max(max_parameter_count,
-                                     instruction->kind.data.call.args.len);
+                        const auto& call = instruction->kind.data.call;
+                        uint32_t reg_count = static_cast<uint32_t>(
+                            argument_regs(call.callee).size());
+                        if (call.args.len > reg_count)
+                            max_stack_argument_count =
+                                std::max(max_stack_argument_count,
+                                         call.args.len - reg_count);
+                        current_function_is_leaf = false;
                     }
 
                     if (instruction->ty->tag != KOOPA_RTT_UNIT)
@@ -226,13 +971,64 @@ std::string visit(const koopa_raw_function_t& func)
                 }
             }
         }
-        if (max_parameter_count > 8)
-            sfm.alloc_lower((max_parameter_count - 8) * 4);
+        sfm.alloc_lower(max_stack_argument_count * 4);
+        // 使用缓冲输出时，main 在返回前需要调用函数刷新缓冲区。
+        if (current_target.runtime_shim &&
+            std::string_view(func->name + 1) == "main")
+            current_function_is_leaf = false;
+        // 调用剖析钩子的函数都不是叶函数。
+        if (current_target.instrument_functions)
+            current_function_is_leaf = false;
+        // 非叶函数需要保存返回地址。
+        if (!current_function_is_leaf)
+            sfm.alloc_upper(4);
+        // 内部叶函数的栈帧不会被其他函数看到，不需要按 16 字节对齐。
+        if (is_internal(func) && current_function_is_leaf)
+            sfm.set_alignment(4);
+    }
+    // 找出所有需要跨基本块存活的值。
+    {
+        block_of.clear();
+        escaping_values.clear();
+        auto basic_blocks = func->bbs;
+        for (uint32_t i = 0; i < basic_blocks.len; i++)
+        {
+            auto basic_block_ptr = reinterpret_cast<koopa_raw_basic_block_t>(
+                basic_blocks.buffer[i]);
+            auto basic_block = basic_block_ptr->insts;
+            for (uint32_t j = 0; j < basic_block.len; j++)
+                block_of[reinterpret_cast<koopa_raw_value_t>(
+                    basic_block.buffer[j])] = basic_block_ptr;
+        }
+        for (uint32_t i = 0; i < basic_blocks.len; i++)
+        {
+            auto basic_block_ptr = reinterpret_cast<koopa_raw_basic_block_t>(
+                basic_blocks.buffer[i]);
+            auto basic_block = basic_block_ptr->insts;
+            for (uint32_t j = 0; j < basic_block.len; j++)
+            {
+                auto instruction =
+                    reinterpret_cast<koopa_raw_value_t>(basic_block.buffer[j]);
+                for (const auto& operand : register_operands(instruction))
+                    if (block_of.at(operand) != basic_block_ptr)
+                        escaping_values.insert(operand);
+            }
+        }
+    }
+    // 参数寄存器在读取参数之前不能被分配。
+    rm.clear_reserved();
+    {
+        auto regs = argument_regs(func);
+        size_t count = std::min<size_t>(regs.size(), func->params.len);
+        for (size_t i = 0; i < count; i++)
+            rm.reserve(regs[i]);
     }
     // 计算实际的栈帧大小，并生成导言。
     {
         size_t stack_frame_size = sfm.rounded_size();
-        if (stack_frame_size <= 2048) // [-2048, 2047]
+        if (!stack_frame_size) // 栈帧为空时不需要调整 sp。
+            ;
+        else if (stack_frame_size <= 2048) // [-2048, 2047]
             ret += fmt::format("    addi sp, sp, -{}\n", stack_frame_size);
         else // 太大，使用 li 指令代替立即数。
         {
@@ -242,12 +1038,23 @@ std::string visit(const koopa_raw_function_t& func)
     }
 
     // 保存 ra 寄存器的值。
-    ret += generate_store(rm.reg_ra, rm.reg_x, sfm.offset_upper());
+    if (!current_function_is_leaf)
+        ret += generate_store(rm.reg_ra, rm.reg_x, sfm.offset_upper());
+    // 钩子通过 reg_x 接收函数的编号，且不破坏其他寄存器。
+    if (current_target.instrument_functions)
+    {
+        ret += fmt::format("    li {}, {}\n", rm.reg_x,
+                           profile_index_of.at(func));
+        ret += fmt::format("    call {}\n", profiler_enter);
+    }
 
     // 访问所有基本块。
     ret += visit(func->bbs);
     // 后记在 return 指令处生成。
 
+    // 记录函数写入的寄存器，之后生成的调用者据此只写回受影响的值。
+    clobbers_of[func] = rm.written();
+
     ret += "\n";
 
     return ret;
@@ -258,8 +1065,52 @@ std::string visit(const koopa_raw_basic_block_t& bb)
 
     // 为基本块增加标签。
     ret += fmt::format("{}:\n", bb->name + 1);
+
+    // 统计基本块中各个值的使用次数。寄存器中的值不跨越基本块。
+    rm.clear();
+    remaining_uses.clear();
+    block_calls.clear();
+    last_use_index.clear();
+    for (uint32_t i = 0; i < bb->insts.len; i++)
+    {
+        auto instruction =
+            reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+        for (const auto& operand : register_operands(instruction))
+        {
+            remaining_uses[operand]++;
+            last_use_index[operand] = i;
+        }
+        if (instruction->kind.tag == KOOPA_RVT_CALL)
+            block_calls.emplace_back(
+                i, clobbered_regs(instruction->kind.data.call));
+    }
+    // 只被紧随其后的条件跳转使用的比较，直接生成比较并跳转的指令。
+    fused_compares.clear();
+    for (uint32_t i = 0; i + 1 < bb->insts.len; i++)
+    {
+        auto instruction =
+            reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+        auto next =
+            reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i + 1]);
+        if (instruction->kind.tag == KOOPA_RVT_BINARY &&
+            compare_branch_of(instruction->kind.data.binary.op) &&
+            next->kind.tag == KOOPA_RVT_BRANCH &&
+            next->kind.data.branch.cond == instruction &&
+            remaining_uses[instruction] == 1 &&
+            !escaping_values.count(instruction))
+            fused_compares.insert(instruction);
+    }
     // 访问所有指令。
-    ret += visit(bb->insts);
+    for (uint32_t i = 0; i < bb->insts.len; i++)
+    {
+        check_job_budget();
+        current_index = i;
+        // 指令在原文本中的顺序与在程序中的顺序相同。
+        if (current_instruction_ordinal < current_instruction_lines.size())
+            ret += generate_loc(
+                current_instruction_lines[current_instruction_ordinal++]);
+        ret += visit(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]));
+    }
 
     return ret;
 }
@@ -320,21 +1171,37 @@ std::string visit(const koopa_raw_return_t& return_inst)
     if (return_inst.value)
     {
         // 生成保存返回值的指令。
-        if (return_inst.value->kind.tag == KOOPA_RVT_INTEGER)
-            ret += fmt::format("    li {}, {}\n", reg_ret,
-                               return_inst.value->kind.data.integer.value);
-        else // 将变量加载到寄存器。
-            ret += generate_load(reg_ret, rm.reg_x, return_inst.value);
+        std::string reg;
+        ret += generate_use(reg, reg_ret, rm.reg_x, return_inst.value);
+        if (reg != reg_ret)
+            ret += fmt::format("    mv {}, {}\n", reg_ret, reg);
+        rm.mark_written(reg_ret);
     }
     // 否则直接生成后记。
 
+    // 剖析钩子在返回值写入之后调用，不破坏寄存器。
+    if (current_target.instrument_functions)
+    {
+        ret += fmt::format("    call {}\n", profiler_exit);
+        if (std::string_view(current_function->name + 1) == "main")
+            ret += fmt::format("    call {}\n", profiler_write);
+    }
+
+    // 程序退出前写出缓冲区中的输出。刷新缓冲区的函数不破坏寄存器。
+    if (current_target.runtime_shim &&
+        std::string_view(current_function->name + 1) == "main")
+        ret += fmt::format("    call {}\n", runtime_shim_flush);
+
     // 恢复返回地址。
-    ret += generate_load(rm.reg_ra, rm.reg_x, sfm.offset_upper());
+    if (!current_function_is_leaf)
+        ret += generate_load(rm.reg_ra, rm.reg_x, sfm.offset_upper());
 
     // 计算实际的栈帧大小。
     {
         size_t stack_frame_size = sfm.rounded_size();
-        if (stack_frame_size < 2048) // [-2048, 2047]
+        if (!stack_frame_size) // 栈帧为空时不需要调整 sp。
+            ;
+        else if (stack_frame_size < 2048) // [-2048, 2047]
             ret += fmt::format("    addi sp, sp, {}\n", stack_frame_size);
         else // 太大，使用 li 指令代替立即数。
         {
@@ -352,111 +1219,41 @@ std::string visit(const koopa_raw_binary_t& binary_inst,
                   const koopa_raw_value_t& parent_value)
 {
     std::string ret;
-    std::string reg_x = rm.reg_x;
-    std::string reg_y = rm.reg_y;
-    std::string reg_z = rm.reg_z;
 
-    if (binary_inst.lhs->kind.tag == KOOPA_RVT_INTEGER)
-    {
-        // 将字面量存入寄存器。
-        int value = binary_inst.lhs->kind.data.integer.value;
-        ret += fmt::format("    li {}, {}\n", reg_y, value);
-    }
-    else // 将变量加载到寄存器。
-        ret += generate_load(reg_y, reg_x, binary_inst.lhs);
+    // 与之后的条件跳转合并，在跳转处生成。
+    if (fused_compares.count(parent_value))
+        return ret;
 
-    if (binary_inst.rhs->kind.tag == KOOPA_RVT_INTEGER)
-    {
-        // 将字面量存入寄存器。
-        int value = binary_inst.rhs->kind.data.integer.value;
-        ret += fmt::format("    li {}, {}\n", reg_z, value);
-    }
-    else // 将变量加载到寄存器。
-        ret += generate_load(reg_z, reg_x, binary_inst.rhs);
+    // 在模式表中选择代价最小的模式覆盖该指令。
+    auto tiling =
+        select_binary_pattern(current_target, binary_inst.op,
+                              literal_of(binary_inst.lhs),
+                              literal_of(binary_inst.rhs));
+    const auto& lhs = tiling.is_swapped ? binary_inst.rhs : binary_inst.lhs;
+    const auto& rhs = tiling.is_swapped ? binary_inst.lhs : binary_inst.rhs;
 
-    switch (binary_inst.op)
-    {
-    case KOOPA_RBO_ADD:
-    {
-        ret += fmt::format("    add {}, {}, {}\n", reg_x, reg_y, reg_z);
-        break;
-    }
-    case KOOPA_RBO_SUB:
-    {
-        ret += fmt::format("    sub {}, {}, {}\n", reg_x, reg_y, reg_z);
-        break;
-    }
-    case KOOPA_RBO_MUL:
-    {
-        ret += fmt::format("    mul {}, {}, {}\n", reg_x, reg_y, reg_z);
-        break;
-    }
-    case KOOPA_RBO_DIV:
-    {
-        ret += fmt::format("    div {}, {}, {}\n", reg_x, reg_y, reg_z);
-        break;
-    }
-    case KOOPA_RBO_MOD:
-    {
-        ret += fmt::format("    rem {}, {}, {}\n", reg_x, reg_y, reg_z);
-        break;
-    }
-    case KOOPA_RBO_LT:
-    {
-        ret += fmt::format("    slt {}, {}, {}\n", reg_x, reg_y, reg_z);
-        break;
-    }
-    case KOOPA_RBO_GT:
-    {
-        ret += fmt::format("    sgt {}, {}, {}\n", reg_x, reg_y, reg_z);
-        break;
-    }
-    case KOOPA_RBO_LE:
-    {
-        ret += fmt::format("    sgt {}, {}, {}\n", reg_x, reg_y, reg_z);
-        ret += fmt::format("    seqz {}, {}\n", reg_x, reg_x);
-        break;
-    }
-    case KOOPA_RBO_GE:
-    {
-        ret += fmt::format("    slt {}, {}, {}\n", reg_x, reg_y, reg_z);
-        ret += fmt::format("    seqz {}, {}\n", reg_x, reg_x);
-        break;
-    }
-    case KOOPA_RBO_EQ:
-    {
-        ret += fmt::format("    xor {}, {}, {}\n", reg_x, reg_y, reg_z);
-        ret += fmt::format("    seqz {}, {}\n", reg_x, reg_x);
-        break;
-    }
-    case KOOPA_RBO_NOT_EQ:
-    {
-        ret += fmt::format("    xor {}, {}, {}\n", reg_x, reg_y, reg_z);
-        ret += fmt::format("    snez {}, {}\n", reg_x, reg_x);
-        break;
-    }
-    case KOOPA_RBO_AND:
-    {
-        ret += fmt::format("    and {}, {}, {}\n", reg_x, reg_y, reg_z);
-        break;
-    }
-    case KOOPA_RBO_OR:
-    {
-        ret += fmt::format("    or {}, {}, {}\n", reg_x, reg_y, reg_z);
-        break;
-    }
-    case KOOPA_RBO_XOR:
-    {
-        ret += fmt::format("    xor {}, {}, {}\n", reg_x, reg_y, reg_z);
-        break;
-    }
-    default:
-        // 其他类型暂时遇不到。
-        assert(false);
-    }
+    std::string reg_x; // 保存结果的寄存器。
+    std::string reg_y; // 保存左操作数的寄存器。
+    std::string reg_z; // 保存右操作数的寄存器。
+
+    // 将操作数加载到寄存器。立即数直接编码在指令中。
+    ret += generate_operand(reg_y, rm.reg_y, lhs);
+    if (!tiling.pattern->has_immediate)
+        ret += generate_operand(reg_z, rm.reg_z, rhs, {reg_y});
+    // 操作数使用完毕，结果可以复用操作数的寄存器。
+    ret += generate_release(binary_inst.lhs);
+    ret += generate_release(binary_inst.rhs);
+
+    // 结果没有被使用，无需计算。
+    if (!is_used(parent_value))
+        return ret;
+    ret += generate_define(reg_x, parent_value, rm.reg_x, {reg_y, reg_z});
+
+    ret += emit_binary_pattern(*tiling.pattern, reg_x, reg_y, reg_z,
+                               literal_of(rhs).value_or(0));
 
     // 将结果保存至内存。
-    ret += generate_store(reg_x, reg_y, parent_value);
+    ret += generate_defined(reg_x, rm.reg_y, parent_value);
 
     return ret;
 }
@@ -464,14 +1261,19 @@ std::string visit(const koopa_raw_load_t& load_inst,
                   const koopa_raw_value_t& parent_value)
 {
     std::string ret;
-    std::string reg_x = rm.reg_x; // 保存值的寄存器。
+    std::string reg_x;            // 保存值的寄存器。
     std::string reg_y = rm.reg_y; // 保存偏移量的寄存器。
 
+    // 结果没有被使用，无需加载。
+    if (!is_used(parent_value))
+        return ret;
+    ret += generate_define(reg_x, parent_value, rm.reg_x);
+
     // 将变量加载到寄存器。
     ret += generate_load(reg_x, reg_y, load_inst.src);
 
     // 将结果保存至内存。
-    ret += generate_store(reg_x, reg_y, parent_value);
+    ret += generate_defined(reg_x, reg_y, parent_value);
 
     return ret;
 }
@@ -483,57 +1285,75 @@ std::string visit(const koopa_raw_store_t& store_inst)
 
     // 将值加载到寄存器。
     {
-        // 如果是常量，将整数写入寄存器。
-        if (store_inst.value->kind.tag == KOOPA_RVT_INTEGER)
-            ret += fmt::format("    li {}, {}\n", reg_x,
-                               store_inst.value->kind.data.integer.value);
-        else // 将变量加载到寄存器。
+        if (store_inst.value->kind.tag == KOOPA_RVT_FUNC_ARG_REF)
         {
-            int offset;
-            std::string argument_register;
-            if (!sfm.count(store_inst.value))
+            // 第一次读取参数。计算出参数的偏移量。
+            uint32_t argument_index{};
+            for (; argument_index < current_function->params.len;
+                 argument_index++)
             {
-                // 如果栈帧中没有这个变量，说明是第一次读取参数。计算出参数的偏移量。
-                uint32_t argument_index{};
-                for (; argument_index < current_function->params.len;
-                     argument_index++)
-                {
-                    if (store_inst.value ==
-                        current_function->params.buffer[argument_index])
-                        break;
-                }
-                assert(argument_index != current_function->params.len);
-
-                // 根据参数的序号计算出寄存器或偏移量。
-                if (argument_index < 8)
-                    argument_register = fmt::format("a{}", argument_index);
-                else
-                    offset = sfm.rounded_size() + 4 * (argument_index - 8);
+                if (store_inst.value ==
+                    current_function->params.buffer[argument_index])
+                    break;
             }
-            else // 否则照常从栈帧中直接找到变量。
-                offset = sfm.offset(store_inst.value);
+            assert(argument_index != current_function->params.len);
 
-            if (argument_register.empty()) // 不对应寄存器，从内存中加载参数。
+            // 根据参数的序号计算出寄存器或偏移量。
+            auto regs = argument_regs(current_function);
+            if (argument_index < regs.size())
+            {
+                // 直接将参数从寄存器保存到内存中。
+                reg_x = regs[argument_index];
+                rm.unreserve(reg_x);
+            }
+            else // 不对应寄存器，从内存中加载参数。
+            {
+                int offset = sfm.rounded_size() +
+                             4 * (argument_index - regs.size());
                 ret += generate_load(reg_x, reg_y, offset);
-            else // 将参数从寄存器保存到内存中。
-                ret += fmt::format("    mv {}, {}\n", reg_x, argument_register);
+            }
         }
+        else // 常量或变量。
+            ret += generate_use(reg_x, rm.reg_x, reg_y, store_inst.value);
     }
 
     // 将结果保存至内存。
     ret += generate_store(reg_x, reg_y, store_inst.dest);
+    ret += generate_release(store_inst.value);
 
     return ret;
 }
 std::string visit(const koopa_raw_jump_t& jump_inst)
 {
-    return fmt::format("    j {}\n", jump_inst.target->name + 1);
+    std::string ret;
+    // 在离开基本块之前写回跨基本块存活的值。
+    ret += generate_flush();
+    ret += fmt::format("    j {}\n", jump_inst.target->name + 1);
+    return ret;
 }
 std::string visit(const koopa_raw_branch_t& branch_inst)
 {
     std::string ret;
 
-    if (branch_inst.cond->kind.tag == KOOPA_RVT_INTEGER)
+    // 在离开基本块之前写回跨基本块存活的值。
+    ret += generate_flush();
+
+    if (fused_compares.count(branch_inst.cond))
+    {
+        // 比较与跳转合并为一条指令。
+        const auto& compare = branch_inst.cond->kind.data.binary;
+        std::string reg_y; // 保存左操作数的寄存器。
+        std::string reg_z; // 保存右操作数的寄存器。
+        ret += generate_operand(reg_y, rm.reg_y, compare.lhs);
+        ret += generate_operand(reg_z, rm.reg_z, compare.rhs, {reg_y});
+        ret += generate_release(compare.lhs);
+        ret += generate_release(compare.rhs);
+        ret += fmt::format("    {} {}, {}, {}\n",
+                           *compare_branch_of(compare.op), reg_y, reg_z,
+                           branch_inst.true_bb->name + 1);
+        ret += fmt::format("    j {}\n", branch_inst.false_bb->name + 1);
+    }
+    else if (branch_inst.cond->kind.tag == KOOPA_RVT_INTEGER)
     {
         // 直接无条件跳转。
         int value = branch_inst.cond->kind.data.integer.value;
@@ -545,9 +1365,9 @@ std::string visit(const koopa_raw_branch_t& branch_inst)
     else
     {
         // 将变量加载到寄存器。
-        std::string reg_x = rm.reg_x; // 保存值的寄存器。
+        std::string reg_x;            // 保存值的寄存器。
         std::string reg_y = rm.reg_y; // 保存偏移量的寄存器。
-        ret += generate_load(reg_x, reg_y, branch_inst.cond);
+        ret += generate_use(reg_x, rm.reg_x, reg_y, branch_inst.cond);
         ret += fmt::format("    bnez {}, {}\n", reg_x,
                            branch_inst.true_bb->name + 1);
         ret += fmt::format("    j {}\n", branch_inst.false_bb->name + 1);
@@ -560,54 +1380,157 @@ std::string visit(const koopa_raw_call_t& call_inst,
 {
     std::string ret;
 
-    // 将序号小于等于 8 的参数放入寄存器中。
-    for (uint32_t i = 0; i < std::min(8u, call_inst.args.len); i++)
+    std::vector<koopa_raw_value_t> arguments;
+    for (uint32_t i = 0; i < call_inst.args.len; i++)
+        arguments.push_back(
+            reinterpret_cast<koopa_raw_value_t>(call_inst.args.buffer[i]));
+
+    // 内联缓冲输出的 putch：写入缓冲区，满时才调用函数写出。
+    if (is_inline_putch(call_inst))
     {
-        auto argument =
-            reinterpret_cast<koopa_raw_value_t>(call_inst.args.buffer[i]);
+        std::string reg;
+        ret += generate_use(reg, rm.reg_z, rm.reg_x, arguments[0]);
+        ret += generate_release(arguments[0]);
+        ret += fmt::format("    la {}, {}\n", rm.reg_x, runtime_shim_output);
+        ret += fmt::format("    lw {}, 0({})\n", rm.reg_y, rm.reg_x);
+        ret += fmt::format("    add {}, {}, {}\n", rm.reg_y, rm.reg_x,
+                           rm.reg_y);
+        ret += fmt::format("    sb {}, 4({})\n", reg, rm.reg_y);
+        ret += fmt::format("    sub {}, {}, {}\n", rm.reg_y, rm.reg_y,
+                           rm.reg_x);
+        ret += fmt::format("    addi {}, {}, 1\n", rm.reg_y, rm.reg_y);
+        ret += fmt::format("    sw {}, 0({})\n", rm.reg_y, rm.reg_x);
+        ret += fmt::format("    li {}, {}\n", rm.reg_x,
+                           runtime_shim_buffer_size);
+        ret += fmt::format("    bne {}, {}, 1f\n", rm.reg_y, rm.reg_x);
+        ret += fmt::format("    call {}\n", runtime_shim_flush);
+        ret += "1:\n";
+        return ret;
+    }
 
-        std::string reg_x = fmt::format("a{}", i); // 保存值的寄存器。
-        std::string reg_y = rm.reg_y; // 保存偏移量的寄存器。
+    // 被调用的函数使用的参数寄存器和调用可能写入的寄存器。
+    auto regs = argument_regs(call_inst.callee);
+    size_t reg_argument_count = std::min(regs.size(), arguments.size());
+    auto clobbered = clobbered_regs(call_inst);
 
-        // 将参数写入寄存器。
-        if (argument->kind.tag == KOOPA_RVT_INTEGER)
+    // 写回调用之后仍会使用、且所在寄存器会被破坏的值。
+    // 其他寄存器中的值在调用之后仍然有效。
+    {
+        std::unordered_map<koopa_raw_value_t, size_t> call_uses;
+        for (const auto& argument : arguments)
+            call_uses[argument]++;
+        for (auto value : rm.variables())
         {
-            // 将立即数写入寄存器。
-            ret += fmt::format("    li {}, {}\n", reg_x,
-                               argument->kind.data.integer.value);
+            if (!clobbered.count(rm[value]))
+                continue;
+            bool is_live = escaping_values.count(value) ||
+                           remaining_uses[value] > call_uses[value];
+            if (is_live && rm.is_dirty(value))
+            {
+                ret += generate_store(rm[value], rm.reg_x, value);
+                rm.set_clean(value);
+            }
         }
-        else // 将变量加载到寄存器。
-            ret += generate_load(reg_x, reg_y, argument);
     }
 
-    // 将序号大于 8 的参数存入栈中。
-    for (uint32_t i = 8; i < call_inst.args.len; i++)
-    {
-        auto argument =
-            reinterpret_cast<koopa_raw_value_t>(call_inst.args.buffer[i]);
-
-        std::string reg_x = rm.reg_x; // 保存值的寄存器。
-        std::string reg_y = rm.reg_y; // 保存偏移量的寄存器。
-        // 将参数写入寄存器。
-        if (argument->kind.tag == KOOPA_RVT_INTEGER)
+    // 获取参数所在的寄存器。参数寄存器会被破坏，因此不再缓存参数。
+    auto generate_argument = [](std::string& reg,
+                                const std::string& target_reg,
+                                const koopa_raw_value_t& argument) {
+        if (rm.count(argument))
         {
-            // 将立即数写入寄存器。
-            ret += fmt::format("    li {}, {}\n", reg_x,
-                               argument->kind.data.integer.value);
+            reg = rm[argument];
+            return std::string();
         }
-        else // 将变量加载到寄存器。
-            ret += generate_load(reg_x, reg_y, argument);
+        reg = target_reg;
+        if (argument->kind.tag == KOOPA_RVT_INTEGER)
+            return fmt::format("    li {}, {}\n", reg,
+                               argument->kind.data.integer.value);
+        return generate_load(reg, rm.reg_y, argument);
+    };
+
+    // 将没有对应寄存器的参数存入栈中。
+    for (size_t i = reg_argument_count; i < arguments.size(); i++)
+    {
+        std::string reg_x; // 保存值的寄存器。
+        std::string reg_y = rm.reg_y; // 保存偏移量的寄存器。
+        ret += generate_argument(reg_x, rm.reg_x, arguments[i]);
 
         // 将寄存器中的参数写入栈。
-        ret += generate_store(reg_x, reg_y, sfm.offset_lower() + (i - 8) * 4);
+        ret += generate_store(reg_x, reg_y,
+                              sfm.offset_lower() +
+                                  (i - reg_argument_count) * 4);
+    }
+
+    // 将其他参数放入寄存器中。
+    {
+        // 源寄存器可能是其他参数的目标寄存器，先处理寄存器之间的移动。
+        std::vector<std::pair<std::string, std::string>> moves;
+        std::vector<uint32_t> others;
+        for (uint32_t i = 0; i < reg_argument_count; i++)
+        {
+            const auto& target_reg = regs[i];
+            if (!rm.count(arguments[i]))
+                others.push_back(i);
+            else if (rm[arguments[i]] != target_reg)
+                moves.emplace_back(target_reg, rm[arguments[i]]);
+        }
+        while (!moves.empty())
+        {
+            // 找到一个目标寄存器不再被读取的移动。
+            auto it = std::find_if(
+                moves.begin(), moves.end(), [&](const auto& move) {
+                    return std::none_of(
+                        moves.begin(), moves.end(), [&](const auto& other) {
+                            return other.second == move.first;
+                        });
+                });
+            if (it == moves.end())
+            {
+                // 移动形成了环，借助 reg_x 打破。
+                ret += fmt::format("    mv {}, {}\n", rm.reg_x,
+                                   moves.front().second);
+                moves.front().second = rm.reg_x;
+                continue;
+            }
+            ret += fmt::format("    mv {}, {}\n", it->first, it->second);
+            moves.erase(it);
+        }
+        // 再将立即数和内存中的参数写入寄存器。
+        for (auto i : others)
+        {
+            std::string reg_x;
+            ret += generate_argument(reg_x, regs[i], arguments[i]);
+        }
     }
 
+    for (const auto& argument : arguments)
+        ret += generate_release(argument);
+    rm.clear(clobbered);
+    // 被调用的函数写入的寄存器也算作当前函数写入的寄存器。
+    for (const auto& reg : clobbered)
+        rm.mark_written(reg);
+
     // 生成 call 指令。
-    ret += fmt::format("    call {}\n", call_inst.callee->name + 1);
+    std::string callee_name = call_inst.callee->name + 1;
+    if (current_target.runtime_shim && !call_inst.callee->bbs.len)
+    {
+        if (is_runtime_shim_function(callee_name))
+            callee_name = fmt::format("{}{}", runtime_shim_prefix, callee_name);
+        else // 其他库函数可能产生输出，先写出缓冲区以保持输出的顺序。
+            ret += fmt::format("    call {}\n", runtime_shim_flush);
+    }
+    ret += fmt::format("    call {}\n", callee_name);
 
     // 如果函数有返回值，将返回值保存。
-    if (parent_value->ty->tag != KOOPA_RTT_UNIT)
-        ret += generate_store(rm.reg_ret, rm.reg_x, parent_value);
+    if (parent_value->ty->tag != KOOPA_RTT_UNIT && is_used(parent_value))
+    {
+        std::string reg_x;
+        ret += generate_define(reg_x, parent_value, rm.reg_ret);
+        if (reg_x != rm.reg_ret)
+            ret += fmt::format("    mv {}, {}\n", reg_x, rm.reg_ret);
+        ret += generate_defined(reg_x, rm.reg_x, parent_value);
+    }
 
     return ret;
 }
@@ -616,14 +1539,39 @@ std::string visit(const koopa_raw_global_alloc_t& global_alloc_inst,
 {
     std::string ret;
 
-    gvm.alloc(parent_value, parent_value->name + 1);
+    // 暂时认为都是 int32_t。
+    constexpr size_t size = 4;
+    std::string name = parent_value->name + 1;
+    std::optional<int> gp_offset;
+    if (size <= current_target.small_data_limit)
+    {
+        bool is_first = !gvm.small_size();
+        gp_offset = gvm.alloc_small(parent_value, name, size);
+        if (gp_offset && is_first)
+        {
+            // 小数据段的起始位置，gp 指向其后 gp_bias 字节处。
+            // 由于变量按顺序连续排列，相对 gp 的偏移量在编译时即可确定。
+            ret += "    .section .sdata, \"aw\"\n";
+            ret += "    .p2align 2\n";
+            ret += ".L__sdata_base:\n";
+            ret += "    .globl __global_pointer$\n";
+            ret += fmt::format(
+                "    .set __global_pointer$, .L__sdata_base + {}\n",
+                gvm.gp_bias);
+        }
+    }
+    else
+        gvm.alloc(parent_value, name);
 
-    ret += "    .data\n";
-    ret += fmt::format("    .globl {}\n", parent_value->name + 1);
-    ret += fmt::format("{}:\n", parent_value->name + 1);
+    if (gp_offset)
+        ret += "    .section .sdata, \"aw\"\n";
+    else
+        ret += "    .data\n";
+    ret += fmt::format("    .globl {}\n", name);
+    ret += fmt::format("{}:\n", name);
 
     if (global_alloc_inst.init->kind.tag == KOOPA_RVT_ZERO_INIT)
-        ret += fmt::format("    .zero {}\n", 4);
+        ret += fmt::format("    .zero {}\n", size);
     else if (global_alloc_inst.init->kind.tag == KOOPA_RVT_INTEGER)
         ret += fmt::format("    .word {}\n",
                            global_alloc_inst.init->kind.data.integer.value);
@@ -635,7 +1583,11 @@ std::string visit(const koopa_raw_global_alloc_t& global_alloc_inst,
 
 std::string koopa_to_riscv::compile(const std::string& koopa_ir_str)
 {
-    return to_riscv(koopa_ir_str);
+    current_target = target;
+    auto ret = to_riscv(koopa_ir_str);
+    reused_function_count = ::reused_function_count;
+    generated_function_count = ::generated_function_count;
+    return ret;
 }
 
 #else
@@ -9,15 +9,62 @@
 
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 namespace compiler
 {
+    /**
+     * @brief RISC-V target features.
+     */
+    struct riscv_target_t
+    {
+        /**
+         * @brief Zba extension (address generation).
+         */
+        bool zba{};
+        /**
+         * @brief Zbb extension (basic bit-manipulation).
+         */
+        bool zbb{};
+        /**
+         * @brief Global variables not larger than this size in bytes are
+         * placed in the small data section and accessed relative to gp.
+         * 0 disables the small data section.
+         */
+        size_t small_data_limit = 8;
+        /**
+         * @brief Emit a buffered I/O runtime and call it instead of the I/O
+         * functions of libsysy.
+         */
+        bool runtime_shim{};
+        /**
+         * @brief Call profiling hooks on entry to and exit from every
+         * function, and write the profile when main returns.
+         */
+        bool instrument_functions{};
+
+        /**
+         * @brief Parse an ISA string such as "rv32im_zba_zbb".
+         * If the string is not supported, throw an std::invalid_argument.
+         */
+        static riscv_target_t parse(const std::string& march);
+    };
+
     /**
      * @brief Compile Koopa IR to RISC-V.
      */
     class koopa_to_riscv
     {
+    private:
+        riscv_target_t target;
+        size_t reused_function_count{};
+        size_t generated_function_count{};
+
+    public:
+        koopa_to_riscv() = default;
+        explicit koopa_to_riscv(const riscv_target_t& target);
+
     public:
         /**
          * @brief Compile Koopa IR to RISC-V.
@@ -26,5 +73,14 @@ namespace compiler
          * @return std::string RISC-V in string.
          */
         std::string compile(const std::string& koopa_ir_str);
+        /**
+         * @brief Number of functions whose code was reused from the previous
+         * compilation in the last compilation.
+         */
+        size_t functions_reused() const { return reused_function_count; }
+        /**
+         * @brief Number of functions generated in the last compilation.
+         */
+        size_t functions_generated() const { return generated_function_count; }
     };
 } // namespace compiler
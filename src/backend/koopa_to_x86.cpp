@@ -0,0 +1,337 @@
+/**
+ * @file koopa_to_x86.cpp
+ * @author UnnamedOrange
+ * @brief Compile Koopa IR to x86-64.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "koopa_to_x86.h"
+
+#include <array>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+
+#include <fmt/core.h>
+
+#include <ir/koopa_program.h>
+#include <job_budget.hpp>
+
+using namespace compiler;
+using namespace compiler::ir;
+
+namespace
+{
+    // System V 调用约定中传递前 6 个整数参数的寄存器。
+    constexpr std::array arg_reg_names{"%edi", "%esi", "%edx",
+                                       "%ecx", "%r8d", "%r9d"};
+
+    /**
+     * @brief Get the assembly symbol of a Koopa name, e.g. "@f" to "f".
+     */
+    std::string symbol_of(const std::string& name) { return name.substr(1); }
+
+    /**
+     * @brief Code generator of a function. Every value and local variable
+     * lives in a 4-byte slot below %rbp; %eax, %ecx and %edx are scratch
+     * registers.
+     */
+    class function_generator
+    {
+    private:
+        const function_t& function;
+        const std::unordered_set<std::string>& defined_functions;
+        std::string name;
+        // 各个值和局部变量相对于 %rbp 的偏移量。
+        std::unordered_map<std::string, int> offsets;
+        int frame_size{};
+        std::string ret;
+
+    public:
+        function_generator(const function_t& function,
+                           const std::unordered_set<std::string>&
+                               defined_functions)
+            : function(function), defined_functions(defined_functions)
+        {
+            auto header = std::string_view(function.header);
+            auto begin = header.find('@');
+            name = header.substr(begin + 1, header.find('(') - begin - 1);
+        }
+
+    public:
+        std::string generate()
+        {
+            // 为参数、指令的结果和局部变量分配栈上的位置。
+            for (const auto& parameter : function.parameters)
+                allocate(parameter);
+            for (const auto& block : function.blocks)
+                for (const auto& instruction : block.instructions)
+                    if (!instruction.result.empty())
+                        allocate(instruction.result);
+            frame_size = (frame_size + 15) / 16 * 16;
+
+            ret += "    .text\n";
+            if (name == "main")
+                ret += "    .globl main\n";
+            ret += fmt::format("    .type {}, @function\n", name);
+            ret += fmt::format("{}:\n", name);
+            ret += "    pushq %rbp\n";
+            ret += "    movq %rsp, %rbp\n";
+            if (frame_size)
+                ret += fmt::format("    subq ${}, %rsp\n", frame_size);
+
+            // 保存参数。第 7 个及之后的参数在调用者的栈帧中。
+            for (size_t i = 0; i < function.parameters.size(); i++)
+            {
+                if (i < arg_reg_names.size())
+                    ret += fmt::format("    movl {}, {}\n", arg_reg_names[i],
+                                       slot(function.parameters[i]));
+                else
+                {
+                    ret += fmt::format("    movl {}(%rbp), %eax\n",
+                                       16 + 8 * (i - arg_reg_names.size()));
+                    ret += fmt::format("    movl %eax, {}\n",
+                                       slot(function.parameters[i]));
+                }
+            }
+
+            for (const auto& block : function.blocks)
+            {
+                ret += fmt::format("{}:\n", label_of(block.label));
+                check_job_budget();
+                for (const auto& instruction : block.instructions)
+                    visit(instruction);
+            }
+            ret += fmt::format("    .size {}, .-{}\n\n", name, name);
+            return std::move(ret);
+        }
+
+    private:
+        void allocate(const std::string& value)
+        {
+            if (offsets.count(value))
+                return;
+            frame_size += 4;
+            offsets[value] = -frame_size;
+        }
+        std::string slot(const std::string& value) const
+        {
+            return fmt::format("{}(%rbp)", offsets.at(value));
+        }
+        /**
+         * @brief Get the memory operand of a variable.
+         */
+        std::string address_of(const std::string& pointer) const
+        {
+            if (offsets.count(pointer))
+                return slot(pointer);
+            return fmt::format("{}(%rip)", symbol_of(pointer));
+        }
+        std::string label_of(const std::string& label) const
+        {
+            // 基本块的名称只在函数内唯一。
+            return fmt::format(".L{}.{}", name, label.substr(1));
+        }
+        void load(const std::string& reg, const std::string& value)
+        {
+            if (auto literal = literal_of(value))
+                ret += fmt::format("    movl ${}, {}\n", *literal, reg);
+            else
+                ret += fmt::format("    movl {}, {}\n", slot(value), reg);
+        }
+
+        void visit(const instruction_t& instruction)
+        {
+            const auto& op = instruction.op;
+            const auto& operands = instruction.operands;
+            if (op == "alloc")
+                return;
+            if (op == "load")
+            {
+                ret += fmt::format("    movl {}, %eax\n",
+                                   address_of(operands[0]));
+                ret += fmt::format("    movl %eax, {}\n",
+                                   slot(instruction.result));
+            }
+            else if (op == "store")
+            {
+                load("%eax", operands[0]);
+                ret += fmt::format("    movl %eax, {}\n",
+                                   address_of(operands[1]));
+            }
+            else if (instruction.is_binary())
+                visit_binary(instruction);
+            else if (op == "br")
+            {
+                load("%eax", operands[0]);
+                ret += "    testl %eax, %eax\n";
+                ret += fmt::format("    jne {}\n", label_of(operands[1]));
+                ret += fmt::format("    jmp {}\n", label_of(operands[2]));
+            }
+            else if (op == "jump")
+                ret += fmt::format("    jmp {}\n", label_of(operands[0]));
+            else if (op == "ret")
+            {
+                if (!operands.empty())
+                    load("%eax", operands[0]);
+                ret += "    leave\n";
+                ret += "    ret\n";
+            }
+            else if (op == "call")
+                visit_call(instruction);
+            else
+                throw std::runtime_error(fmt::format(
+                    "[Error] Unsupported Koopa IR instruction: {}.", op));
+        }
+        void visit_binary(const instruction_t& instruction)
+        {
+            const auto& op = instruction.op;
+            load("%eax", instruction.operands[0]);
+            load("%ecx", instruction.operands[1]);
+
+            static const std::unordered_map<std::string_view, std::string_view>
+                arithmetic{{"add", "addl"}, {"sub", "subl"}, {"mul", "imull"},
+                           {"and", "andl"}, {"or", "orl"},   {"xor", "xorl"}};
+            static const std::unordered_map<std::string_view, std::string_view>
+                comparisons{{"eq", "sete"}, {"ne", "setne"}, {"lt", "setl"},
+                            {"gt", "setg"}, {"le", "setle"}, {"ge", "setge"}};
+            static const std::unordered_map<std::string_view, std::string_view>
+                shifts{{"shl", "shll"}, {"shr", "shrl"}, {"sar", "sarl"}};
+            if (auto it = arithmetic.find(op); it != arithmetic.end())
+                ret += fmt::format("    {} %ecx, %eax\n", it->second);
+            else if (auto it = comparisons.find(op); it != comparisons.end())
+            {
+                ret += "    cmpl %ecx, %eax\n";
+                ret += fmt::format("    {} %al\n", it->second);
+                ret += "    movzbl %al, %eax\n";
+            }
+            else if (auto it = shifts.find(op); it != shifts.end())
+                ret += fmt::format("    {} %cl, %eax\n", it->second);
+            else // div 或 mod。
+            {
+                // idivl 在除数为 0 和 INT_MIN / -1 时产生异常，这两种情况按
+                // RISC-V 的结果处理：除以 0 得 -1，对 0 取模得被除数；除以 -1
+                // 得相反数（INT_MIN 回绕为自身），对 -1 取模得 0。
+                bool is_div = op == "div";
+                ret += "    testl %ecx, %ecx\n";
+                ret += "    je 1f\n";
+                ret += "    cmpl $-1, %ecx\n";
+                ret += "    je 2f\n";
+                ret += "    cltd\n";
+                ret += "    idivl %ecx\n";
+                if (!is_div)
+                    ret += "    movl %edx, %eax\n";
+                ret += "    jmp 3f\n";
+                ret += "1:\n";
+                if (is_div)
+                    ret += "    movl $-1, %eax\n";
+                ret += "    jmp 3f\n";
+                ret += "2:\n";
+                ret += is_div ? "    negl %eax\n" : "    xorl %eax, %eax\n";
+                ret += "3:\n";
+            }
+            ret += fmt::format("    movl %eax, {}\n", slot(instruction.result));
+        }
+        void visit_call(const instruction_t& instruction)
+        {
+            const auto& operands = instruction.operands;
+            size_t argument_count = operands.size() - 1;
+            size_t stack_argument_count =
+                argument_count > arg_reg_names.size()
+                    ? argument_count - arg_reg_names.size()
+                    : 0;
+            // 调用时 %rsp 须按 16 字节对齐。
+            size_t stack_size = (stack_argument_count + 1) / 2 * 16;
+            if (stack_size)
+                ret += fmt::format("    subq ${}, %rsp\n", stack_size);
+            for (size_t i = arg_reg_names.size(); i < argument_count; i++)
+            {
+                load("%eax", operands[i + 1]);
+                ret += fmt::format("    movl %eax, {}(%rsp)\n",
+                                   8 * (i - arg_reg_names.size()));
+            }
+            for (size_t i = 0; i < argument_count && i < arg_reg_names.size();
+                 i++)
+                load(arg_reg_names[i], operands[i + 1]);
+
+            // 库函数在另一个目标文件中。
+            auto callee = symbol_of(operands[0]);
+            if (defined_functions.count(operands[0]))
+                ret += fmt::format("    call {}\n", callee);
+            else
+                ret += fmt::format("    call {}@PLT\n", callee);
+            if (stack_size)
+                ret += fmt::format("    addq ${}, %rsp\n", stack_size);
+            if (!instruction.result.empty())
+                ret += fmt::format("    movl %eax, {}\n",
+                                   slot(instruction.result));
+        }
+    };
+
+    /**
+     * @brief Generate a global variable, e.g. "global @x = alloc i32, 1".
+     */
+    std::string generate_global(std::string_view line)
+    {
+        auto name_begin = line.find('@');
+        auto name_end = line.find(' ', name_begin);
+        auto name = std::string(line.substr(name_begin + 1,
+                                            name_end - name_begin - 1));
+        auto init = line.substr(line.rfind(',') + 1);
+        while (init.starts_with(' '))
+            init.remove_prefix(1);
+
+        std::string ret;
+        if (init == "zeroinit")
+        {
+            ret += "    .bss\n";
+            ret += "    .p2align 2\n";
+            ret += fmt::format("{}:\n", name);
+            ret += "    .zero 4\n\n";
+        }
+        else
+        {
+            ret += "    .data\n";
+            ret += "    .p2align 2\n";
+            ret += fmt::format("{}:\n", name);
+            ret += fmt::format("    .long {}\n\n", init);
+        }
+        return ret;
+    }
+} // namespace
+
+std::string koopa_to_x86::compile(const std::string& koopa_ir_str)
+{
+    auto program = program_t::parse(koopa_ir_str);
+
+    std::unordered_set<std::string> defined_functions;
+    for (const auto& item : program.items)
+    {
+        if (auto function = std::get_if<function_t>(&item))
+        {
+            auto header = std::string_view(function->header);
+            auto begin = header.find('@');
+            defined_functions.emplace(
+                header.substr(begin, header.find('(') - begin));
+        }
+    }
+
+    std::string ret;
+    for (const auto& item : program.items)
+    {
+        if (auto line = std::get_if<std::string>(&item))
+        {
+            if (line->starts_with("global "))
+                ret += generate_global(*line);
+            continue;
+        }
+        ret += function_generator(std::get<function_t>(item), defined_functions)
+                   .generate();
+    }
+    ret += "    .section .note.GNU-stack,\"\",@progbits\n";
+    return ret;
+}
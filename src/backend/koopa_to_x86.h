@@ -0,0 +1,34 @@
+/**
+ * @file koopa_to_x86.h
+ * @author UnnamedOrange
+ * @brief Compile Koopa IR to x86-64.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace compiler
+{
+    /**
+     * @brief Compile Koopa IR to x86-64 GNU assembly for the System V ABI.
+     * The output links with a host build of libsysy, e.g.
+     * runtime/sysy_host.c, so that programs run natively. It is meant for
+     * checking program semantics quickly, not for performance.
+     */
+    class koopa_to_x86
+    {
+    public:
+        /**
+         * @brief Compile Koopa IR to x86-64.
+         * If the IR cannot be parsed, throw an std::runtime_error.
+         *
+         * @param koopa_ir_str Koopa IR in string.
+         * @return std::string x86-64 assembly in string.
+         */
+        std::string compile(const std::string& koopa_ir_str);
+    };
+} // namespace compiler
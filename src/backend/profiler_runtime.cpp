@@ -0,0 +1,263 @@
+/**
+ * @file profiler_runtime.cpp
+ * @author UnnamedOrange
+ * @brief Function profiling runtime emitted together with the RISC-V output.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "profiler_runtime.h"
+
+#include <fmt/core.h>
+
+using namespace compiler;
+
+std::string compiler::profiler_runtime_riscv(
+    const std::vector<std::string>& names)
+{
+    std::string name_directives;
+    for (const auto& name : names)
+        name_directives += fmt::format("    .asciz \"{}\"\n", name);
+
+    // 影子栈的每一项占 32 字节：函数的编号、进入时的周期数（8 字节）、
+    // 被调用者花费的周期数（8 字节）。
+    // 只有函数最外层的调用结束时才累加包含被调用者的时间，使递归不重复计算。
+    // 周期数按照 rdcycleh、rdcycle、rdcycleh 的顺序读取，以处理低位的进位。
+    // 系统调用号：openat 为 56，close 为 57，write 为 64。
+    // 打开文件的标志为 O_WRONLY | O_CREAT | O_TRUNC，即 577，权限为 0644。
+    return fmt::format(R"(    .data
+    .p2align 3
+__sysy_prof_data:
+    .ascii "{magic}"
+    .word {version}
+    .word {n}
+    .word .L__sysy_prof_names_end - .L__sysy_prof_names
+.L__sysy_prof_names:
+{names}.L__sysy_prof_names_end:
+    .p2align 3
+__sysy_prof_inclusive:
+    .zero {n8}
+__sysy_prof_exclusive:
+    .zero {n8}
+__sysy_prof_calls:
+    .zero {n4}
+__sysy_prof_edges:
+    .zero {edges_size}
+__sysy_prof_data_end:
+
+    .section .rodata
+__sysy_prof_path:
+    .asciz "{path}"
+
+    .bss
+    .p2align 3
+__sysy_prof_depth:
+    .zero 8
+__sysy_prof_active:
+    .zero {n4}
+    .p2align 3
+__sysy_prof_stack:
+    .zero {stack_size}
+
+    .text
+__sysy_prof_enter:
+    addi sp, sp, -32
+    sw t0, 0(sp)
+    sw t2, 4(sp)
+    sw t3, 8(sp)
+    sw t4, 12(sp)
+    sw t5, 16(sp)
+    la t0, __sysy_prof_depth
+    lw t2, 0(t0)
+    addi t3, t2, 1
+    sw t3, 0(t0)
+    la t0, __sysy_prof_calls
+    slli t3, t1, 2
+    add t0, t0, t3
+    lw t3, 0(t0)
+    addi t3, t3, 1
+    sw t3, 0(t0)
+    li t3, {max_depth}
+    bgeu t2, t3, 3f
+    la t0, __sysy_prof_stack
+    slli t3, t2, 5
+    add t0, t0, t3
+    li t3, {n}
+    beqz t2, 1f
+    lw t3, -32(t0)
+1:
+    li t4, {n}
+    mul t3, t3, t4
+    add t3, t3, t1
+    slli t3, t3, 2
+    la t4, __sysy_prof_edges
+    add t4, t4, t3
+    lw t3, 0(t4)
+    addi t3, t3, 1
+    sw t3, 0(t4)
+    la t4, __sysy_prof_active
+    slli t3, t1, 2
+    add t4, t4, t3
+    lw t3, 0(t4)
+    addi t3, t3, 1
+    sw t3, 0(t4)
+    sw t1, 0(t0)
+    sw zero, 16(t0)
+    sw zero, 20(t0)
+2:
+    rdcycleh t4
+    rdcycle t3
+    rdcycleh t5
+    bne t4, t5, 2b
+    sw t3, 8(t0)
+    sw t4, 12(t0)
+3:
+    lw t0, 0(sp)
+    lw t2, 4(sp)
+    lw t3, 8(sp)
+    lw t4, 12(sp)
+    lw t5, 16(sp)
+    addi sp, sp, 32
+    ret
+
+__sysy_prof_exit:
+    addi sp, sp, -32
+    sw t0, 0(sp)
+    sw t2, 4(sp)
+    sw t3, 8(sp)
+    sw t4, 12(sp)
+    sw t5, 16(sp)
+    sw t6, 20(sp)
+    sw a0, 24(sp)
+1:
+    rdcycleh t4
+    rdcycle t3
+    rdcycleh t5
+    bne t4, t5, 1b
+    la t0, __sysy_prof_depth
+    lw t2, 0(t0)
+    addi t2, t2, -1
+    sw t2, 0(t0)
+    li t5, {max_depth}
+    bgeu t2, t5, 4f
+    la t0, __sysy_prof_stack
+    slli t5, t2, 5
+    add t0, t0, t5
+    lw t5, 8(t0)
+    sltu t6, t3, t5
+    sub t3, t3, t5
+    sub t4, t4, t6
+    lw t5, 12(t0)
+    sub t4, t4, t5
+    beqz t2, 2f
+    lw t5, -16(t0)
+    add t5, t5, t3
+    sltu t6, t5, t3
+    sw t5, -16(t0)
+    lw t5, -12(t0)
+    add t5, t5, t4
+    add t5, t5, t6
+    sw t5, -12(t0)
+2:
+    lw t2, 0(t0)
+    la t5, __sysy_prof_active
+    slli t6, t2, 2
+    add t5, t5, t6
+    lw t6, 0(t5)
+    addi t6, t6, -1
+    sw t6, 0(t5)
+    bnez t6, 3f
+    la t5, __sysy_prof_inclusive
+    slli t6, t2, 3
+    add t5, t5, t6
+    lw t6, 0(t5)
+    add t6, t6, t3
+    sw t6, 0(t5)
+    sltu t6, t6, t3
+    lw a0, 4(t5)
+    add a0, a0, t4
+    add a0, a0, t6
+    sw a0, 4(t5)
+3:
+    lw t5, 16(t0)
+    sltu t6, t3, t5
+    sub t3, t3, t5
+    sub t4, t4, t6
+    lw t5, 20(t0)
+    sub t4, t4, t5
+    la t5, __sysy_prof_exclusive
+    slli t6, t2, 3
+    add t5, t5, t6
+    lw t6, 0(t5)
+    add t6, t6, t3
+    sw t6, 0(t5)
+    sltu t6, t6, t3
+    lw a0, 4(t5)
+    add a0, a0, t4
+    add a0, a0, t6
+    sw a0, 4(t5)
+4:
+    lw t0, 0(sp)
+    lw t2, 4(sp)
+    lw t3, 8(sp)
+    lw t4, 12(sp)
+    lw t5, 16(sp)
+    lw t6, 20(sp)
+    lw a0, 24(sp)
+    addi sp, sp, 32
+    ret
+
+__sysy_prof_write:
+    addi sp, sp, -32
+    sw a0, 0(sp)
+    sw a1, 4(sp)
+    sw a2, 8(sp)
+    sw a3, 12(sp)
+    sw a7, 16(sp)
+    li a0, -100
+    la a1, __sysy_prof_path
+    li a2, 577
+    li a3, 420
+    li a7, 56
+    ecall
+    bltz a0, 3f
+    mv a3, a0
+    la a1, __sysy_prof_data
+    la a2, __sysy_prof_data_end
+    sub a2, a2, a1
+1:
+    blez a2, 2f
+    mv a0, a3
+    li a7, 64
+    ecall
+    blez a0, 2f
+    add a1, a1, a0
+    sub a2, a2, a0
+    j 1b
+2:
+    mv a0, a3
+    li a7, 57
+    ecall
+3:
+    lw a0, 0(sp)
+    lw a1, 4(sp)
+    lw a2, 8(sp)
+    lw a3, 12(sp)
+    lw a7, 16(sp)
+    addi sp, sp, 32
+    ret
+
+)",
+                       fmt::arg("magic", profile_magic),
+                       fmt::arg("version", profile_version),
+                       fmt::arg("n", names.size()),
+                       fmt::arg("names", name_directives),
+                       fmt::arg("n4", names.size() * 4),
+                       fmt::arg("n8", names.size() * 8),
+                       fmt::arg("edges_size",
+                                (names.size() + 1) * names.size() * 4),
+                       fmt::arg("path", profile_file_name),
+                       fmt::arg("max_depth", profiler_max_depth),
+                       fmt::arg("stack_size", profiler_max_depth * 32));
+}
@@ -0,0 +1,72 @@
+/**
+ * @file profiler_runtime.h
+ * @author UnnamedOrange
+ * @brief Function profiling runtime emitted together with the RISC-V output.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace compiler
+{
+    /**
+     * @brief Symbol of the hook called after the prologue of a function.
+     * The index of the function is passed in t1. It preserves all registers
+     * except ra.
+     */
+    inline constexpr std::string_view profiler_enter = "__sysy_prof_enter";
+    /**
+     * @brief Symbol of the hook called before the epilogue of a function.
+     * It preserves all registers except ra.
+     */
+    inline constexpr std::string_view profiler_exit = "__sysy_prof_exit";
+    /**
+     * @brief Symbol of the function writing the profile when main returns.
+     * It preserves all registers except ra.
+     */
+    inline constexpr std::string_view profiler_write = "__sysy_prof_write";
+    /**
+     * @brief File the profile is written to, relative to the working
+     * directory of the program.
+     */
+    inline constexpr std::string_view profile_file_name = "sysy.prof";
+    /**
+     * @brief First 4 bytes of a profile.
+     */
+    inline constexpr std::string_view profile_magic = "SYPF";
+    /**
+     * @brief Version of the profile format.
+     */
+    inline constexpr size_t profile_version = 1;
+    /**
+     * @brief Maximum depth of calls whose time is recorded. Deeper calls
+     * are only counted, and their time belongs to their callers.
+     */
+    inline constexpr size_t profiler_max_depth = 4096;
+
+    /**
+     * @brief Get RISC-V assembly of the profiling runtime.
+     *
+     * The profile written at exit is laid out as follows, all integers
+     * being little-endian:
+     * - the magic, the version, the number of functions N and the size of
+     *   the names in bytes, 4 bytes each;
+     * - the null-terminated names, padded to 8 bytes;
+     * - inclusive cycles and exclusive cycles, N 8-byte integers each;
+     * - call counts, N 4-byte integers;
+     * - call counts of edges, (N + 1) * N 4-byte integers, where the edge
+     *   from caller i to callee j is at i * N + j and the caller N stands
+     *   for calls from outside.
+     *
+     * @param names Names of the instrumented functions, indexed by the
+     * values passed to the enter hook.
+     */
+    std::string profiler_runtime_riscv(const std::vector<std::string>& names);
+} // namespace compiler
@@ -11,8 +11,12 @@
 
 #include <array>
 #include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #if defined(COMPILER_LINK_KOOPA)
@@ -23,6 +27,10 @@ namespace compiler
 {
     /**
      * @brief Register manager for backend.
+     * Caches values of the current basic block in registers.
+     * Live ranges are split at basic block boundaries: a value lives in a
+     * register inside the block where it is used, and in its stack slot
+     * across blocks (including loops).
      */
     class register_manager
     {
@@ -54,33 +62,221 @@ namespace compiler
             "a6",
             "a7",
         };
-        std::array<std::vector<variable_t>, reg_names.size()> var_by_reg;
+        /**
+         * @brief Argument registers of the standard calling convention.
+         */
+        inline static constexpr std::array arg_reg_names = {
+            "a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7"};
+        /**
+         * @brief Argument registers of the internal calling convention.
+         * Temporaries not used as scratch registers carry extra arguments.
+         */
+        inline static constexpr std::array internal_arg_reg_names = {
+            "a0", "a1", "a2", "a3", "a4", "a5",
+            "a6", "a7", "t0", "t4", "t5", "t6"};
+
+    private:
+        // 每个寄存器中保存的变量。空指针表示寄存器空闲。
+        std::array<variable_t, reg_names.size()> var_by_reg{};
+        // 寄存器中的值是否尚未写回栈帧。
+        std::array<bool, reg_names.size()> dirty_by_reg{};
+        // 被保留的寄存器（例如尚未读取的函数参数）不参与分配。
+        std::array<bool, reg_names.size()> reserved_by_reg{};
+        // 寄存器最近一次被使用的时刻，用于选择换出的寄存器。
+        std::array<size_t, reg_names.size()> last_use_by_reg{};
         std::map<variable_t, size_t> reg_by_var;
+        size_t current_time{};
+        // 当前函数中被写入过的寄存器，用于生成函数的破坏寄存器摘要。
+        std::set<std::string> written_regs;
 
     private:
-        size_t random_vacant_reg() const
+        static std::optional<size_t> index_of(std::string_view reg)
         {
             for (size_t i = 0; i < reg_names.size(); i++)
-                if (var_by_reg[i].empty())
+                if (reg_names[i] == reg)
                     return i;
-            throw std::runtime_error("[Error] No vacant register.");
+            return std::nullopt;
+        }
+
+    public:
+        /**
+         * @brief Drop all cached variables.
+         * Call this when starting to handle a basic block.
+         */
+        void clear()
+        {
+            var_by_reg.fill(nullptr);
+            dirty_by_reg.fill(false);
+            reg_by_var.clear();
+        }
+        /**
+         * @brief Drop cached variables held in the given registers.
+         * Call this after a call clobbering these registers.
+         */
+        void clear(const std::set<std::string>& regs)
+        {
+            for (const auto& reg : regs)
+                if (auto i = index_of(reg); i && var_by_reg[*i])
+                {
+                    reg_by_var.erase(var_by_reg[*i]);
+                    var_by_reg[*i] = nullptr;
+                    dirty_by_reg[*i] = false;
+                }
+        }
+        /**
+         * @brief Release all reserved registers.
+         * Call this when starting to handle a function.
+         */
+        void clear_reserved() { reserved_by_reg.fill(false); }
+        /**
+         * @brief Exclude a register from allocation.
+         * Registers not managed by the manager are ignored.
+         */
+        void reserve(std::string_view reg)
+        {
+            if (auto i = index_of(reg))
+                reserved_by_reg[*i] = true;
+        }
+        /**
+         * @brief Make a reserved register available for allocation again.
+         */
+        void unreserve(std::string_view reg)
+        {
+            if (auto i = index_of(reg))
+                reserved_by_reg[*i] = false;
+        }
+
+    public:
+        /**
+         * @brief Forget the registers written so far.
+         * Call this when starting to handle a function.
+         */
+        void clear_written() { written_regs.clear(); }
+        /**
+         * @brief Record that a register is written by the current function.
+         */
+        void mark_written(std::string_view reg) { written_regs.emplace(reg); }
+        /**
+         * @brief Get the registers written by the current function.
+         */
+        const std::set<std::string>& written() const { return written_regs; }
+
+    public:
+        /**
+         * @brief Check whether a variable is cached in a register.
+         */
+        size_t count(variable_t x1) const { return reg_by_var.count(x1); }
+        /**
+         * @brief Get the register holding a cached variable.
+         */
+        std::string operator[](variable_t x1) const
+        {
+            return reg_names[reg_by_var.at(x1)];
+        }
+        /**
+         * @brief Check whether a cached variable has not been written back.
+         */
+        bool is_dirty(variable_t x1) const
+        {
+            return dirty_by_reg[reg_by_var.at(x1)];
+        }
+        /**
+         * @brief Mark a cached variable as written back.
+         */
+        void set_clean(variable_t x1)
+        {
+            dirty_by_reg[reg_by_var.at(x1)] = false;
+        }
+        /**
+         * @brief Record a use of a cached variable.
+         */
+        void touch(variable_t x1)
+        {
+            last_use_by_reg[reg_by_var.at(x1)] = ++current_time;
+        }
+        /**
+         * @brief Get all cached variables in the order of registers.
+         */
+        std::vector<variable_t> variables() const
+        {
+            std::vector<variable_t> ret;
+            for (const auto& var : var_by_reg)
+                if (var)
+                    ret.push_back(var);
+            return ret;
         }
 
     public:
-        std::string get_reg(variable_t x1)
+        /**
+         * @brief Find a register holding no variable.
+         *
+         * @param avoided Registers used only if no other register is vacant.
+         */
+        std::optional<std::string> vacant_reg(
+            const std::set<std::string>& avoided = {}) const
         {
-            // 暂时直接分配寄存器，不考虑寄存器不够的情况。
-            if (!reg_by_var.count(x1))
+            std::optional<std::string> ret;
+            for (size_t i = 0; i < reg_names.size(); i++)
+            {
+                if (var_by_reg[i] || reserved_by_reg[i])
+                    continue;
+                if (!avoided.count(reg_names[i]))
+                    return reg_names[i];
+                if (!ret)
+                    ret = reg_names[i];
+            }
+            return ret;
+        }
+        /**
+         * @brief Choose a cached variable to evict.
+         * Clean variables are preferred because they need no write back.
+         * Among them the least recently used one is chosen.
+         *
+         * @param pinned Registers that must not be evicted.
+         */
+        variable_t victim(const std::vector<std::string>& pinned) const
+        {
+            std::optional<size_t> ret;
+            for (size_t i = 0; i < reg_names.size(); i++)
             {
-                int reg = random_vacant_reg();
-                var_by_reg[reg].push_back(x1);
-                reg_by_var[x1] = reg;
+                if (!var_by_reg[i] || reserved_by_reg[i])
+                    continue;
+                bool is_pinned = false;
+                for (const auto& reg : pinned)
+                    is_pinned |= reg == reg_names[i];
+                if (is_pinned)
+                    continue;
+                if (!ret ||
+                    std::make_pair(dirty_by_reg[i], last_use_by_reg[i]) <
+                        std::make_pair(dirty_by_reg[*ret],
+                                       last_use_by_reg[*ret]))
+                    ret = i;
             }
-            return operator[](x1);
+            if (!ret)
+                throw std::runtime_error("[Error] No register to evict.");
+            return var_by_reg[*ret];
+        }
+        /**
+         * @brief Cache a variable in a vacant register.
+         */
+        void bind(variable_t x1, std::string_view reg, bool dirty)
+        {
+            size_t i = index_of(reg).value();
+            var_by_reg[i] = x1;
+            dirty_by_reg[i] = dirty;
+            last_use_by_reg[i] = ++current_time;
+            reg_by_var[x1] = i;
+            written_regs.emplace(reg);
         }
-        std::string operator[](variable_t var_name) const
+        /**
+         * @brief Remove a variable from its register.
+         */
+        void unbind(variable_t x1)
         {
-            return reg_names[reg_by_var.at(var_name)];
+            size_t i = reg_by_var.at(x1);
+            var_by_reg[i] = nullptr;
+            dirty_by_reg[i] = false;
+            reg_by_var.erase(x1);
         }
     };
 } // namespace compiler
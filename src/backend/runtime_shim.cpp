@@ -0,0 +1,272 @@
+/**
+ * @file runtime_shim.cpp
+ * @author UnnamedOrange
+ * @brief Buffered I/O runtime emitted together with the RISC-V output.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "runtime_shim.h"
+
+#include <array>
+
+#include <fmt/core.h>
+
+using namespace compiler;
+
+bool compiler::is_runtime_shim_function(std::string_view name)
+{
+    // starttime 和 stoptime 仍然调用 libsysy。
+    constexpr std::array names = {
+        "getint", "getch", "getarray", "putint", "putch", "putarray",
+    };
+    for (const auto& function_name : names)
+        if (name == function_name)
+            return true;
+    return false;
+}
+
+std::string compiler::runtime_shim_riscv()
+{
+    // 输出缓冲区的第一个字为待输出的字节数，之后为数据。
+    // 每次输出之后待输出的字节数都小于缓冲区大小，满时立即写出。
+    // 输入缓冲区的前两个字分别为读取位置和有效字节数，之后为数据。
+    // 系统调用号：read 为 63，write 为 64。
+    return fmt::format(R"(    .bss
+    .p2align 2
+__sysy_shim_out:
+    .zero {out_size}
+__sysy_shim_in:
+    .zero {in_size}
+
+    .text
+__sysy_shim_flush:
+    addi sp, sp, -16
+    sw a0, 0(sp)
+    sw a1, 4(sp)
+    sw a2, 8(sp)
+    sw a7, 12(sp)
+    la a1, __sysy_shim_out
+    lw a2, 0(a1)
+    sw zero, 0(a1)
+    addi a1, a1, 4
+1:
+    blez a2, 2f
+    li a0, 1
+    li a7, 64
+    ecall
+    blez a0, 2f
+    add a1, a1, a0
+    sub a2, a2, a0
+    j 1b
+2:
+    lw a0, 0(sp)
+    lw a1, 4(sp)
+    lw a2, 8(sp)
+    lw a7, 12(sp)
+    addi sp, sp, 16
+    ret
+
+__sysy_shim_putch:
+    la t1, __sysy_shim_out
+    lw t2, 0(t1)
+    add t3, t1, t2
+    sb a0, 4(t3)
+    addi t2, t2, 1
+    sw t2, 0(t1)
+    li t3, {size}
+    bne t2, t3, 1f
+    tail __sysy_shim_flush
+1:
+    ret
+
+__sysy_shim_putint:
+    la t1, __sysy_shim_out
+    lw t2, 0(t1)
+    li t3, {putint_limit}
+    ble t2, t3, 1f
+    mv t0, ra
+    call __sysy_shim_flush
+    mv ra, t0
+    li t2, 0
+1:
+    add t3, t1, t2
+    addi t3, t3, 4
+    bgez a0, 2f
+    li t4, 45
+    sb t4, 0(t3)
+    addi t3, t3, 1
+    neg a0, a0
+2:
+    mv t4, t3
+    li t5, 10
+3:
+    remu t6, a0, t5
+    divu a0, a0, t5
+    addi t6, t6, 48
+    sb t6, 0(t3)
+    addi t3, t3, 1
+    bnez a0, 3b
+    addi t5, t3, -1
+4:
+    bgeu t4, t5, 5f
+    lbu t6, 0(t4)
+    lbu a1, 0(t5)
+    sb a1, 0(t4)
+    sb t6, 0(t5)
+    addi t4, t4, 1
+    addi t5, t5, -1
+    j 4b
+5:
+    addi t3, t3, -4
+    sub t2, t3, t1
+    sw t2, 0(t1)
+    ret
+
+__sysy_shim_putarray:
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    sw a1, 8(sp)
+    sw a0, 4(sp)
+    sw zero, 0(sp)
+    call __sysy_shim_putint
+    li a0, 58
+    call __sysy_shim_putch
+1:
+    lw t0, 0(sp)
+    lw t1, 4(sp)
+    bge t0, t1, 2f
+    li a0, 32
+    call __sysy_shim_putch
+    lw t0, 0(sp)
+    lw t1, 8(sp)
+    slli t2, t0, 2
+    add t1, t1, t2
+    lw a0, 0(t1)
+    addi t0, t0, 1
+    sw t0, 0(sp)
+    call __sysy_shim_putint
+    j 1b
+2:
+    li a0, 10
+    call __sysy_shim_putch
+    lw ra, 12(sp)
+    addi sp, sp, 16
+    ret
+
+__sysy_shim_peek:
+    la t1, __sysy_shim_in
+    lw t2, 0(t1)
+    lw a0, 4(t1)
+    blt t2, a0, 2f
+    li a0, 0
+    addi a1, t1, 8
+    li a2, {size}
+    li a7, 63
+    ecall
+    sw zero, 0(t1)
+    bgtz a0, 1f
+    sw zero, 4(t1)
+    li a0, -1
+    ret
+1:
+    sw a0, 4(t1)
+    li t2, 0
+2:
+    add t2, t1, t2
+    lbu a0, 8(t2)
+    ret
+
+__sysy_shim_getch:
+    mv t0, ra
+    call __sysy_shim_peek
+    mv ra, t0
+    bltz a0, 1f
+    lw t2, 0(t1)
+    addi t2, t2, 1
+    sw t2, 0(t1)
+1:
+    ret
+
+__sysy_shim_getint:
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    sw zero, 8(sp)
+    sw zero, 4(sp)
+1:
+    call __sysy_shim_peek
+    li t2, 32
+    beq a0, t2, 2f
+    addi t2, a0, -9
+    li t3, 5
+    bgeu t2, t3, 3f
+2:
+    lw t2, 0(t1)
+    addi t2, t2, 1
+    sw t2, 0(t1)
+    j 1b
+3:
+    li t2, 45
+    bne a0, t2, 4f
+    li t2, 1
+    sw t2, 8(sp)
+    lw t2, 0(t1)
+    addi t2, t2, 1
+    sw t2, 0(t1)
+4:
+    call __sysy_shim_peek
+    addi a0, a0, -48
+    li t2, 10
+    bgeu a0, t2, 5f
+    lw t3, 4(sp)
+    mul t3, t3, t2
+    add t3, t3, a0
+    sw t3, 4(sp)
+    lw t2, 0(t1)
+    addi t2, t2, 1
+    sw t2, 0(t1)
+    j 4b
+5:
+    lw a0, 4(sp)
+    lw t2, 8(sp)
+    beqz t2, 6f
+    neg a0, a0
+6:
+    lw ra, 12(sp)
+    addi sp, sp, 16
+    ret
+
+__sysy_shim_getarray:
+    addi sp, sp, -16
+    sw ra, 12(sp)
+    sw a0, 8(sp)
+    call __sysy_shim_getint
+    sw a0, 4(sp)
+    sw zero, 0(sp)
+1:
+    lw t0, 0(sp)
+    lw t1, 4(sp)
+    bge t0, t1, 2f
+    call __sysy_shim_getint
+    lw t0, 0(sp)
+    lw t1, 8(sp)
+    slli t2, t0, 2
+    add t1, t1, t2
+    sw a0, 0(t1)
+    addi t0, t0, 1
+    sw t0, 0(sp)
+    j 1b
+2:
+    lw a0, 4(sp)
+    lw ra, 12(sp)
+    addi sp, sp, 16
+    ret
+
+)",
+                       fmt::arg("size", runtime_shim_buffer_size),
+                       fmt::arg("out_size", runtime_shim_buffer_size + 4),
+                       fmt::arg("in_size", runtime_shim_buffer_size + 8),
+                       // 保证写入最长的整数 "-2147483648" 之后缓冲区仍未满。
+                       fmt::arg("putint_limit", runtime_shim_buffer_size - 12));
+}
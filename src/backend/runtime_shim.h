@@ -0,0 +1,46 @@
+/**
+ * @file runtime_shim.h
+ * @author UnnamedOrange
+ * @brief Buffered I/O runtime emitted together with the RISC-V output.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace compiler
+{
+    /**
+     * @brief Prefix of the symbols defined by the runtime shim.
+     * Function "putint" of libsysy is replaced by "__sysy_shim_putint".
+     */
+    inline constexpr std::string_view runtime_shim_prefix = "__sysy_shim_";
+    /**
+     * @brief Symbol of the output buffer.
+     * The first word is the number of pending bytes, followed by the bytes.
+     */
+    inline constexpr std::string_view runtime_shim_output = "__sysy_shim_out";
+    /**
+     * @brief Symbol of the function writing out the output buffer.
+     * It preserves all registers except ra.
+     */
+    inline constexpr std::string_view runtime_shim_flush = "__sysy_shim_flush";
+    /**
+     * @brief Size of the output buffer and the input buffer in bytes.
+     */
+    inline constexpr size_t runtime_shim_buffer_size = 4096;
+
+    /**
+     * @brief Check whether a libsysy function is replaced by the shim.
+     */
+    bool is_runtime_shim_function(std::string_view name);
+    /**
+     * @brief Get RISC-V assembly of the shim.
+     */
+    std::string runtime_shim_riscv();
+} // namespace compiler
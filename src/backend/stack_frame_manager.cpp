@@ -20,6 +20,7 @@ void stack_frame_manager::clear()
     offsets.push_back(0);
     additional_lower = 0;
     additional_upper = 0;
+    alignment = 16;
 }
 void stack_frame_manager::alloc(variable_t variable_id, size_t size)
 {
@@ -30,6 +31,7 @@ void stack_frame_manager::alloc(variable_t variable_id, size_t size)
 }
 void stack_frame_manager::alloc_lower(size_t size) { additional_lower = size; }
 void stack_frame_manager::alloc_upper(size_t size) { additional_upper = size; }
+void stack_frame_manager::set_alignment(size_t size) { alignment = size; }
 size_t stack_frame_manager::count(variable_t variable_id) const
 {
     return variable_to_index.count(variable_id);
@@ -50,6 +52,5 @@ size_t stack_frame_manager::size() const
 }
 size_t stack_frame_manager::rounded_size() const
 {
-    constexpr size_t rounded_to = 16;
-    return (size() + rounded_to - 1) / rounded_to * rounded_to;
+    return (size() + alignment - 1) / alignment * alignment;
 }
@@ -36,6 +36,8 @@ namespace compiler
         size_t additional_lower;
         // 高地址额外的空间。用于保存返回地址。
         size_t additional_upper;
+        // 栈帧大小对齐到的字节数。
+        size_t alignment;
         // 保存的偏移量。
         std::vector<size_t> offsets;
         // 变量名到偏移量下标的映射。
@@ -65,6 +67,11 @@ namespace compiler
          * Call this for return address.
          */
         void alloc_upper(size_t size);
+        /**
+         * @brief Set the alignment of the stack frame size.
+         * Defaults to 16 as required by the standard calling convention.
+         */
+        void set_alignment(size_t size);
         /**
          * @brief Check whether a variable ID exists in the manager.
          */
@@ -88,7 +95,7 @@ namespace compiler
         size_t size() const;
         /**
          * @brief Get size of the current stack frame (rounded to multiples of
-         * 16).
+         * the alignment).
          */
         size_t rounded_size() const;
     };
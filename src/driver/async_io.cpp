@@ -0,0 +1,356 @@
+/**
+ * @file async_io.cpp
+ * @author UnnamedOrange
+ * @brief Asynchronous whole-file reads and writes.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "async_io.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+using namespace compiler;
+
+/**
+ * @brief Minimal io_uring wrapper using raw system calls.
+ */
+struct async_file_io::ring_t
+{
+    int fd = -1;
+    unsigned entries{};
+    void* sq_ptr = MAP_FAILED;
+    size_t sq_size{};
+    void* cq_ptr = MAP_FAILED;
+    size_t cq_size{};
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_size{};
+
+    unsigned* sq_head{};
+    unsigned* sq_tail{};
+    unsigned* sq_mask{};
+    unsigned* sq_array{};
+    unsigned* cq_head{};
+    unsigned* cq_tail{};
+    unsigned* cq_mask{};
+    io_uring_cqe* cqes{};
+
+    // 已放入提交队列但尚未通知内核的请求数。
+    unsigned to_submit{};
+
+    /**
+     * @brief Set up a ring. Returns nullptr if io_uring is not available.
+     */
+    static ring_t* create(unsigned entries)
+    {
+        auto ret = new ring_t;
+        io_uring_params params{};
+        ret->fd = static_cast<int>(
+            ::syscall(__NR_io_uring_setup, entries, &params));
+        if (ret->fd < 0)
+        {
+            delete ret;
+            return nullptr;
+        }
+        ret->entries = params.sq_entries;
+
+        ret->sq_size =
+            params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ret->cq_size =
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool is_single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (is_single_mmap)
+            ret->sq_size = ret->cq_size = std::max(ret->sq_size, ret->cq_size);
+        ret->sq_ptr = ::mmap(nullptr, ret->sq_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ret->fd,
+                             IORING_OFF_SQ_RING);
+        if (ret->sq_ptr == MAP_FAILED)
+        {
+            delete ret;
+            return nullptr;
+        }
+        ret->cq_ptr = is_single_mmap
+                          ? ret->sq_ptr
+                          : ::mmap(nullptr, ret->cq_size,
+                                   PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, ret->fd,
+                                   IORING_OFF_CQ_RING);
+        ret->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        ret->sqes = static_cast<io_uring_sqe*>(
+            ::mmap(nullptr, ret->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ret->fd, IORING_OFF_SQES));
+        if (ret->cq_ptr == MAP_FAILED || ret->sqes == MAP_FAILED)
+        {
+            delete ret;
+            return nullptr;
+        }
+
+        auto sq = static_cast<char*>(ret->sq_ptr);
+        ret->sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        ret->sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        ret->sq_mask =
+            reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        ret->sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        auto cq = static_cast<char*>(ret->cq_ptr);
+        ret->cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        ret->cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        ret->cq_mask =
+            reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        ret->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return ret;
+    }
+    ~ring_t()
+    {
+        if (sqes != MAP_FAILED)
+            ::munmap(sqes, sqes_size);
+        if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+            ::munmap(cq_ptr, cq_size);
+        if (sq_ptr != MAP_FAILED)
+            ::munmap(sq_ptr, sq_size);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    /**
+     * @brief Get a vacant submission queue entry.
+     * The caller guarantees that the queue is not full.
+     */
+    io_uring_sqe* get_sqe()
+    {
+        unsigned tail = *sq_tail;
+        unsigned index = tail & *sq_mask;
+        auto sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array[index] = index;
+        std::atomic_ref(*sq_tail).store(tail + 1, std::memory_order_release);
+        to_submit++;
+        return sqe;
+    }
+    /**
+     * @brief Notify the kernel of new entries, and optionally wait for
+     * completions.
+     */
+    void enter(unsigned min_complete)
+    {
+        unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+        while (true)
+        {
+            long ret = ::syscall(__NR_io_uring_enter, fd, to_submit,
+                                 min_complete, flags, nullptr, 0);
+            if (ret >= 0)
+            {
+                to_submit -= std::min<unsigned>(to_submit, ret);
+                return;
+            }
+            if (errno != EINTR && errno != EAGAIN)
+                throw std::runtime_error(fmt::format(
+                    "[Error] io_uring_enter: {}.", std::strerror(errno)));
+        }
+    }
+};
+
+async_file_io::async_file_io(unsigned entries)
+    : ring(ring_t::create(entries))
+{
+}
+async_file_io::~async_file_io()
+{
+    // 内核可能仍在读写缓冲区，必须等待所有请求完成。
+    try
+    {
+        while (in_flight)
+            reap(true);
+    }
+    catch (...)
+    {
+    }
+    for (auto& [ticket, request] : requests)
+        close_request(request);
+    delete ring;
+}
+
+uint64_t async_file_io::read(const std::filesystem::path& path)
+{
+    uint64_t ticket = next_ticket++;
+    auto& request = requests[ticket];
+    request.path = path;
+    request.fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (request.fd < 0 || ::fstat(request.fd, &st))
+    {
+        request.error = errno;
+        close_request(request);
+        return ticket;
+    }
+    request.buffer.resize(st.st_size);
+    if (request.buffer.empty())
+        close_request(request);
+    else if (ring)
+        submit(ticket);
+    else
+        transfer_synchronously(ticket);
+    return ticket;
+}
+std::string async_file_io::wait_read(uint64_t ticket)
+{
+    while (!requests.at(ticket).is_finished)
+        reap(true);
+    auto request = std::move(requests.at(ticket));
+    requests.erase(ticket);
+    if (request.error)
+        throw std::runtime_error(
+            fmt::format("[Error] Cannot read {}: {}.", request.path.string(),
+                        std::strerror(request.error)));
+    return std::move(request.buffer);
+}
+void async_file_io::write(const std::filesystem::path& path,
+                          std::string content)
+{
+    uint64_t ticket = next_ticket++;
+    auto& request = requests[ticket];
+    request.path = path;
+    request.is_write = true;
+    request.buffer = std::move(content);
+    request.fd =
+        ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (request.fd < 0)
+        request.error = errno;
+    if (request.fd < 0 || request.buffer.empty())
+        finish_request(ticket);
+    else if (ring)
+        submit(ticket);
+    else
+        transfer_synchronously(ticket);
+}
+void async_file_io::finish()
+{
+    while (in_flight)
+        reap(true);
+    if (!write_errors.empty())
+    {
+        auto errors = std::move(write_errors);
+        write_errors.clear();
+        throw std::runtime_error(errors);
+    }
+}
+
+void async_file_io::submit(uint64_t ticket)
+{
+    // 保证提交队列不满，同时完成队列不会溢出。
+    while (in_flight >= ring->entries)
+        reap(true);
+    auto& request = requests.at(ticket);
+    auto sqe = ring->get_sqe();
+    sqe->opcode = request.is_write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = request.fd;
+    sqe->addr =
+        reinterpret_cast<uint64_t>(request.buffer.data() + request.done);
+    sqe->len = static_cast<uint32_t>(request.buffer.size() - request.done);
+    sqe->off = request.done;
+    sqe->user_data = ticket;
+    in_flight++;
+    // 立即通知内核，使读写与调用者的计算重叠。
+    ring->enter(0);
+}
+void async_file_io::complete(uint64_t ticket, int64_t result)
+{
+    auto& request = requests.at(ticket);
+    if (result == -EINVAL || result == -EOPNOTSUPP)
+    {
+        // 内核不支持该操作，退回同步读写。
+        transfer_synchronously(ticket);
+        return;
+    }
+    if (result < 0)
+        request.error = static_cast<int>(-result);
+    else if (result == 0 && !request.is_write)
+        request.buffer.resize(request.done); // 文件变短了。
+    else
+    {
+        request.done += result;
+        if (request.done < request.buffer.size())
+        {
+            submit(ticket);
+            return;
+        }
+    }
+    finish_request(ticket);
+}
+void async_file_io::transfer_synchronously(uint64_t ticket)
+{
+    auto& request = requests.at(ticket);
+    while (request.done < request.buffer.size())
+    {
+        auto data = request.buffer.data() + request.done;
+        auto size = request.buffer.size() - request.done;
+        ssize_t result = request.is_write
+                             ? ::pwrite(request.fd, data, size, request.done)
+                             : ::pread(request.fd, data, size, request.done);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result < 0)
+            request.error = errno;
+        else if (result == 0 && !request.is_write)
+            request.buffer.resize(request.done); // 文件变短了。
+        if (result <= 0)
+            break;
+        request.done += result;
+    }
+    finish_request(ticket);
+}
+void async_file_io::finish_request(uint64_t ticket)
+{
+    auto& request = requests.at(ticket);
+    close_request(request);
+    if (request.is_write)
+    {
+        // 写入没有等待者，完成后即可丢弃。
+        if (request.error)
+            write_errors += fmt::format("[Error] Cannot write {}: {}.\n",
+                                        request.path.string(),
+                                        std::strerror(request.error));
+        requests.erase(ticket);
+    }
+}
+void async_file_io::reap(bool wait)
+{
+    if (!ring)
+        return;
+    unsigned head = *ring->cq_head;
+    if (wait && head == std::atomic_ref(*ring->cq_tail).load(
+                            std::memory_order_acquire))
+        ring->enter(1);
+    while (true)
+    {
+        head = *ring->cq_head;
+        if (head ==
+            std::atomic_ref(*ring->cq_tail).load(std::memory_order_acquire))
+            break;
+        auto cqe = ring->cqes[head & *ring->cq_mask];
+        std::atomic_ref(*ring->cq_head)
+            .store(head + 1, std::memory_order_release);
+        in_flight--;
+        complete(cqe.user_data, cqe.res);
+    }
+}
+void async_file_io::close_request(request_t& request)
+{
+    if (request.fd >= 0)
+        ::close(request.fd);
+    request.fd = -1;
+    request.is_finished = true;
+}
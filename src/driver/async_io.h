@@ -0,0 +1,97 @@
+/**
+ * @file async_io.h
+ * @author UnnamedOrange
+ * @brief Asynchronous whole-file reads and writes.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+namespace compiler
+{
+    /**
+     * @brief Asynchronous whole-file reads and writes.
+     * Data transfers are queued to io_uring and proceed while the caller
+     * computes. If io_uring is not available, pread and pwrite are used
+     * synchronously instead.
+     * Not thread-safe: use one instance per thread.
+     */
+    class async_file_io
+    {
+    private:
+        struct request_t
+        {
+            std::filesystem::path path;
+            int fd = -1;
+            bool is_write{};
+            bool is_finished{};
+            // 失败时的 errno。
+            int error{};
+            std::string buffer;
+            size_t done{};
+        };
+        struct ring_t;
+
+    private:
+        ring_t* ring = nullptr;
+        uint64_t next_ticket{};
+        std::unordered_map<uint64_t, request_t> requests;
+        // 已提交但尚未完成的请求数。
+        size_t in_flight{};
+        // 已完成但失败的写入。
+        std::string write_errors;
+
+    public:
+        /**
+         * @brief Create the I/O layer.
+         *
+         * @param entries Maximum number of requests in flight.
+         */
+        explicit async_file_io(unsigned entries = 64);
+        ~async_file_io();
+        async_file_io(const async_file_io&) = delete;
+        async_file_io& operator=(const async_file_io&) = delete;
+
+    public:
+        /**
+         * @brief Check whether io_uring is used.
+         */
+        bool uses_io_uring() const { return ring; }
+        /**
+         * @brief Start reading a whole file.
+         *
+         * @return uint64_t Ticket passed to wait_read.
+         */
+        uint64_t read(const std::filesystem::path& path);
+        /**
+         * @brief Wait for a read to finish and get the content.
+         * If the read failed, throw an std::runtime_error.
+         */
+        std::string wait_read(uint64_t ticket);
+        /**
+         * @brief Start writing a whole file, replacing its content.
+         */
+        void write(const std::filesystem::path& path, std::string content);
+        /**
+         * @brief Wait for all requests to finish.
+         * If any write failed, throw an std::runtime_error.
+         */
+        void finish();
+
+    private:
+        void submit(uint64_t ticket);
+        void complete(uint64_t ticket, int64_t result);
+        void transfer_synchronously(uint64_t ticket);
+        void finish_request(uint64_t ticket);
+        void reap(bool wait);
+        void close_request(request_t& request);
+    };
+} // namespace compiler
@@ -0,0 +1,115 @@
+/**
+ * @file batch.cpp
+ * @author UnnamedOrange
+ * @brief Compile many files in one process.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "batch.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "async_io.h"
+#include "metrics.h"
+
+using namespace compiler;
+
+size_t compiler::run_batch(
+    const std::filesystem::path& manifest_path,
+    const std::function<std::string(const std::string&)>& compile,
+    metrics_registry* metrics, size_t prefetch_count)
+{
+    // 读取清单。
+    std::vector<std::pair<std::filesystem::path, std::filesystem::path>> jobs;
+    {
+        std::ifstream ifs(manifest_path);
+        if (!ifs)
+            throw std::runtime_error(fmt::format(
+                "[Error] Cannot open manifest {}.", manifest_path.string()));
+        std::string line;
+        for (size_t line_number = 1; std::getline(ifs, line); line_number++)
+        {
+            std::istringstream iss(line);
+            std::string input, output, extra;
+            if (!(iss >> input))
+                continue;
+            if (!(iss >> output) || iss >> extra)
+                throw std::runtime_error(fmt::format(
+                    "[Error] {}:{}: expected an input path and an output path.",
+                    manifest_path.string(), line_number));
+            jobs.emplace_back(input, output);
+        }
+    }
+
+    // 短作业优先：按输入大小从小到大编译，小文件不必等待大文件。
+    // 无法获得大小的输入排在最前，读取时报告错误。
+    {
+        std::vector<std::pair<uintmax_t, size_t>> order;
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            std::error_code ec;
+            auto size = std::filesystem::file_size(jobs[i].first, ec);
+            order.emplace_back(ec ? 0 : size, i);
+        }
+        std::stable_sort(order.begin(), order.end());
+        std::vector<std::pair<std::filesystem::path, std::filesystem::path>>
+            sorted_jobs;
+        for (auto [size, i] : order)
+            sorted_jobs.push_back(std::move(jobs[i]));
+        jobs = std::move(sorted_jobs);
+    }
+
+    async_file_io io;
+    std::vector<uint64_t> tickets(jobs.size());
+    size_t failure_count = 0;
+
+    // 提前读取之后的输入，编译当前文件时读取在后台进行。
+    for (size_t i = 0; i < std::min(prefetch_count, jobs.size()); i++)
+        tickets[i] = io.read(jobs[i].first);
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        if (metrics)
+            metrics->set_queue_depth(jobs.size() - i);
+        if (i + prefetch_count < jobs.size())
+            tickets[i + prefetch_count] =
+                io.read(jobs[i + prefetch_count].first);
+        try
+        {
+            auto source = io.wait_read(tickets[i]);
+            // 输出在后台写入。
+            io.write(jobs[i].second, compile(source) + "\n");
+        }
+        catch (const std::runtime_error& err)
+        {
+            std::cerr << fmt::format("{}: {}", jobs[i].first.string(),
+                                     err.what())
+                      << std::endl;
+            failure_count++;
+        }
+    }
+
+    if (metrics)
+        metrics->set_queue_depth(0);
+    try
+    {
+        io.finish();
+    }
+    catch (const std::runtime_error& err)
+    {
+        std::cerr << err.what();
+        failure_count++;
+    }
+    return failure_count;
+}
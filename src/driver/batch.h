@@ -0,0 +1,40 @@
+/**
+ * @file batch.h
+ * @author UnnamedOrange
+ * @brief Compile many files in one process.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+namespace compiler
+{
+    class metrics_registry;
+
+    /**
+     * @brief Compile the files listed in a manifest.
+     * Each non-empty line of the manifest has an input path and an output
+     * path separated by whitespace. Smaller inputs are compiled first.
+     * Upcoming inputs are prefetched and outputs are written asynchronously
+     * while compiling.
+     *
+     * @param manifest_path Path of the manifest.
+     * @param compile Compile source code to output. Throws an
+     * std::runtime_error on failure.
+     * @param metrics Where to report the number of inputs waiting, or
+     * nullptr.
+     * @param prefetch_count Number of inputs read ahead.
+     * @return size_t Number of files that failed.
+     */
+    size_t run_batch(
+        const std::filesystem::path& manifest_path,
+        const std::function<std::string(const std::string&)>& compile,
+        metrics_registry* metrics = nullptr, size_t prefetch_count = 16);
+} // namespace compiler
@@ -0,0 +1,283 @@
+/**
+ * @file compile_cache.cpp
+ * @author UnnamedOrange
+ * @brief Compile cache shared by concurrent compiler processes.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "compile_cache.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+using namespace compiler;
+
+/**
+ * @brief Header at the beginning of the cache file.
+ */
+struct compile_cache::header_t
+{
+    uint64_t magic;
+    uint64_t slot_count;
+    uint64_t arena_size;
+    /**
+     * @brief Number of bytes used in the arena. Accessed atomically.
+     */
+    uint64_t arena_top;
+};
+/**
+ * @brief Slot of the hash table.
+ * A slot is claimed by setting state from empty or abandoned to the pid of
+ * the claimer, and published by setting state to ready after the other
+ * fields are written. A published slot never changes. All fields are
+ * accessed atomically.
+ */
+struct compile_cache::slot_t
+{
+    /**
+     * @brief 0 means the slot is empty, 1 ready, 2 abandoned, and
+     * (pid << 2 | 3) claimed by the process pid.
+     */
+    uint64_t state;
+    uint64_t hash;
+    /**
+     * @brief Offset of the inputs in the arena. The output follows them.
+     */
+    uint64_t offset;
+    uint64_t inputs_size;
+    uint64_t output_size;
+};
+
+namespace
+{
+    constexpr uint64_t slot_empty = 0;
+    constexpr uint64_t slot_ready = 1;
+    constexpr uint64_t slot_abandoned = 2;
+
+    uint64_t claimed_by(pid_t pid)
+    {
+        return static_cast<uint64_t>(pid) << 2 | 3;
+    }
+    /**
+     * @brief Identify the running compiler executable by its inode, size and
+     * modification time, which change whenever it is rebuilt.
+     */
+    std::string compiler_identity()
+    {
+        struct stat st;
+        if (::stat("/proc/self/exe", &st))
+            return "unknown";
+        return fmt::format("{}:{}:{}.{}", st.st_ino, st.st_size,
+                           st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+    }
+    /**
+     * @brief Check whether a slot was claimed by a process that no longer
+     * exists.
+     */
+    bool is_orphaned(uint64_t state)
+    {
+        if ((state & 3) != 3)
+            return false;
+        return ::kill(static_cast<pid_t>(state >> 2), 0) && errno == ESRCH;
+    }
+} // namespace
+
+compile_cache::compile_cache(const std::filesystem::path& path)
+{
+    auto error = [&](const std::string& reason) {
+        return std::runtime_error(fmt::format(
+            "[Error] Cannot use cache {}: {}.", path.string(), reason));
+    };
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0)
+        throw error(std::strerror(errno));
+
+    mapped_size = sizeof(header_t) + default_slot_count * sizeof(slot_t) +
+                  default_arena_size;
+    // 只在创建文件时加锁。全零的文件即为空表，之后的读写都不需要锁。
+    {
+        ::flock(fd, LOCK_EX);
+        struct stat st;
+        bool ok = !::fstat(fd, &st);
+        if (ok && static_cast<size_t>(st.st_size) < mapped_size)
+            ok = !::ftruncate(fd, mapped_size);
+        else if (ok)
+            mapped_size = st.st_size;
+        if (ok)
+        {
+            data = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+            ok = data != MAP_FAILED;
+            if (!ok)
+                data = nullptr;
+        }
+        if (ok && header().magic != magic)
+        {
+            // 文件可能是旧格式的缓存，清空整个表。
+            std::memset(data, 0, sizeof(header_t) +
+                                     default_slot_count * sizeof(slot_t));
+            header().slot_count = default_slot_count;
+            header().arena_size = default_arena_size;
+            header().arena_top = 0;
+            std::atomic_ref(header().magic).store(magic);
+        }
+        ::flock(fd, LOCK_UN);
+        if (!ok)
+        {
+            int err = errno;
+            close();
+            throw error(std::strerror(err));
+        }
+    }
+
+    // 逐项比较以免溢出。
+    slot_count = header().slot_count;
+    arena_size = header().arena_size;
+    uint64_t table_size = mapped_size - sizeof(header_t);
+    if (!slot_count || slot_count > table_size / sizeof(slot_t) ||
+        arena_size > table_size - slot_count * sizeof(slot_t))
+    {
+        close();
+        throw error("corrupted file");
+    }
+}
+compile_cache::~compile_cache() { close(); }
+void compile_cache::close()
+{
+    if (data)
+        ::munmap(data, mapped_size);
+    if (fd >= 0)
+        ::close(fd);
+    data = nullptr;
+    fd = -1;
+}
+
+compile_cache::key_t compile_cache::make_key(std::string_view config,
+                                             std::string_view source)
+{
+    // 编译器、配置和源代码之间插入 '\0' 以免拼接产生歧义。
+    static const std::string compiler = compiler_identity();
+    key_t key;
+    key.inputs.reserve(compiler.size() + 1 + config.size() + 1 +
+                       source.size());
+    key.inputs.append(compiler).push_back('\0');
+    key.inputs.append(config).push_back('\0');
+    key.inputs.append(source);
+    // FNV-1a。
+    key.hash = 0xcbf29ce484222325;
+    for (unsigned char c : key.inputs)
+    {
+        key.hash ^= c;
+        key.hash *= 0x100000001b3;
+    }
+    return key;
+}
+std::optional<std::string> compile_cache::find(const key_t& key) const
+{
+    for (uint64_t i = 0; i < slot_count; i++)
+    {
+        auto& current = slot((key.hash + i) % slot_count);
+        uint64_t state = std::atomic_ref(current.state).load();
+        if (state == slot_empty)
+            break;
+        // 未就绪、已放弃、损坏和哈希冲突的槽位都跳过，继续探查。
+        if (state != slot_ready)
+            continue;
+        if (auto output = output_of(current, key))
+            return std::string(*output);
+    }
+    return std::nullopt;
+}
+void compile_cache::insert(const key_t& key, std::string_view output)
+{
+    for (uint64_t i = 0; i < slot_count; i++)
+    {
+        auto& current = slot((key.hash + i) % slot_count);
+        uint64_t state = std::atomic_ref(current.state).load();
+        if (state == slot_ready)
+        {
+            if (output_of(current, key))
+                return; // 其他进程已经插入。
+            continue;
+        }
+        // 占据空槽位、已放弃的槽位或占据者已退出的槽位。其他进程正在插入的
+        // 槽位可能是相同的键，但在就绪前无法比较，跳过即可。
+        if (state != slot_empty && state != slot_abandoned &&
+            !is_orphaned(state))
+            continue;
+        if (!std::atomic_ref(current.state)
+                 .compare_exchange_strong(state, claimed_by(::getpid())))
+            continue;
+
+        // 在数据区中分配空间。空间不足时放弃槽位，不影响之后的查找，较小的
+        // 输出仍可插入。
+        uint64_t size = key.inputs.size() + output.size();
+        std::atomic_ref arena_top(header().arena_top);
+        uint64_t offset = arena_top.load();
+        do
+        {
+            if (offset > arena_size || size > arena_size - offset)
+            {
+                std::atomic_ref(current.state).store(slot_abandoned);
+                return;
+            }
+        } while (!arena_top.compare_exchange_weak(offset, offset + size));
+        std::memcpy(arena() + offset, key.inputs.data(), key.inputs.size());
+        std::memcpy(arena() + offset + key.inputs.size(), output.data(),
+                    output.size());
+        std::atomic_ref(current.hash).store(key.hash);
+        std::atomic_ref(current.offset).store(offset);
+        std::atomic_ref(current.inputs_size).store(key.inputs.size());
+        std::atomic_ref(current.output_size).store(output.size());
+        std::atomic_ref(current.state).store(slot_ready);
+        return;
+    }
+}
+std::optional<std::string_view> compile_cache::output_of(
+    slot_t& current, const key_t& key) const
+{
+    if (std::atomic_ref(current.state).load() != slot_ready ||
+        std::atomic_ref(current.hash).load() != key.hash)
+        return std::nullopt;
+    // 各字段只读取一次，检查范围后再使用。
+    uint64_t offset = std::atomic_ref(current.offset).load();
+    uint64_t inputs_size = std::atomic_ref(current.inputs_size).load();
+    uint64_t output_size = std::atomic_ref(current.output_size).load();
+    if (inputs_size != key.inputs.size() || offset > arena_size ||
+        inputs_size > arena_size - offset ||
+        output_size > arena_size - offset - inputs_size)
+        return std::nullopt;
+    if (std::memcmp(arena() + offset, key.inputs.data(), inputs_size))
+        return std::nullopt;
+    return std::string_view(arena() + offset + inputs_size, output_size);
+}
+
+compile_cache::header_t& compile_cache::header() const
+{
+    return *static_cast<header_t*>(data);
+}
+compile_cache::slot_t& compile_cache::slot(uint64_t index) const
+{
+    auto slots = reinterpret_cast<slot_t*>(static_cast<char*>(data) +
+                                           sizeof(header_t));
+    return slots[index];
+}
+char* compile_cache::arena() const
+{
+    return static_cast<char*>(data) + sizeof(header_t) +
+           slot_count * sizeof(slot_t);
+}
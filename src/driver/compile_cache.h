@@ -0,0 +1,103 @@
+/**
+ * @file compile_cache.h
+ * @author UnnamedOrange
+ * @brief Compile cache shared by concurrent compiler processes.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace compiler
+{
+    /**
+     * @brief Compile cache shared by concurrent compiler processes.
+     * Outputs are kept in a memory-mapped file holding a lock-free
+     * open-addressing hash table and an append-only arena. A result
+     * inserted by one process is visible to the others at once.
+     * The inputs of each compilation are stored next to its output and
+     * compared on lookup, so a hash collision is never a hit. The inputs
+     * include the identity of the compiler executable, so a rebuilt
+     * compiler does not use outputs of an older one.
+     */
+    class compile_cache
+    {
+    public:
+        /**
+         * @brief Key of a compilation: its inputs and their hash.
+         */
+        struct key_t
+        {
+            uint64_t hash;
+            std::string inputs;
+        };
+
+    private:
+        struct header_t;
+        struct slot_t;
+
+        inline static constexpr uint64_t magic = 0x32656863'61437953;
+        inline static constexpr uint64_t default_slot_count = 1 << 14;
+        inline static constexpr uint64_t default_arena_size = 64 << 20;
+
+    private:
+        int fd = -1;
+        void* data = nullptr;
+        size_t mapped_size{};
+        // 文件可被其他进程改写，只使用构造时检查过的大小。
+        uint64_t slot_count{};
+        uint64_t arena_size{};
+
+    public:
+        /**
+         * @brief Open or create the cache file.
+         * If the file cannot be used, throw an std::runtime_error.
+         */
+        explicit compile_cache(const std::filesystem::path& path);
+        ~compile_cache();
+        compile_cache(const compile_cache&) = delete;
+        compile_cache& operator=(const compile_cache&) = delete;
+
+    public:
+        /**
+         * @brief Make the key of a compilation.
+         *
+         * @param config Everything affecting the output other than the
+         * source, e.g. the mode and the target.
+         * @param source SysY source code.
+         */
+        static key_t make_key(std::string_view config, std::string_view source);
+        /**
+         * @brief Look up the output of a compilation.
+         * Results still being inserted by other processes are not found.
+         */
+        std::optional<std::string> find(const key_t& key) const;
+        /**
+         * @brief Insert the output of a compilation.
+         * Nothing happens if the key exists or the cache is full.
+         * Slots claimed by processes that died before publishing them are
+         * reused.
+         */
+        void insert(const key_t& key, std::string_view output);
+
+    private:
+        void close();
+        header_t& header() const;
+        slot_t& slot(uint64_t index) const;
+        char* arena() const;
+        /**
+         * @brief Get the output in a slot if it is ready, within the arena
+         * and of the key.
+         */
+        std::optional<std::string_view> output_of(slot_t& current,
+                                                  const key_t& key) const;
+    };
+} // namespace compiler
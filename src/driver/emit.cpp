@@ -0,0 +1,141 @@
+/**
+ * @file emit.cpp
+ * @author UnnamedOrange
+ * @brief Write several outputs of one compilation.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "emit.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+using namespace compiler;
+
+emit_request_t emit_request_t::parse(const std::string& str)
+{
+    auto pos = str.find('=');
+    if (pos == std::string::npos || pos + 1 == str.size())
+        throw std::invalid_argument(fmt::format(
+            "[Error] Invalid -emit {}: expected KIND=PATH.", str));
+    auto kind = str.substr(0, pos);
+    emit_request_t ret{};
+    if (kind == "koopa")
+        ret.kind = emit_kind_t::koopa;
+    else if (kind == "riscv")
+        ret.kind = emit_kind_t::riscv;
+    else if (kind == "c")
+        ret.kind = emit_kind_t::c;
+    else if (kind == "obj")
+        ret.kind = emit_kind_t::obj;
+    else
+        throw std::invalid_argument(fmt::format(
+            "[Error] Invalid -emit {}: unknown kind {}.", str, kind));
+    ret.path = str.substr(pos + 1);
+    return ret;
+}
+
+output_writer::~output_writer()
+{
+    for (auto& thread : threads)
+        if (thread.joinable())
+            thread.join();
+}
+
+void output_writer::write(const std::filesystem::path& path,
+                          std::string content)
+{
+    threads.emplace_back([this, path, content = std::move(content)]() {
+        std::ofstream ofs(path);
+        ofs << content << std::endl;
+        if (!ofs)
+            report(fmt::format("[Error] Cannot write {}.", path.string()));
+    });
+}
+void output_writer::assemble(const std::filesystem::path& path,
+                             std::string riscv, std::string march)
+{
+    threads.emplace_back([this, path, riscv = std::move(riscv),
+                          march = std::move(march)]() {
+        // 与 compiler.sh 相同，使用 clang 汇编。
+        auto asm_path = path;
+        asm_path += fmt::format(".{}.S", ::getpid());
+        {
+            std::ofstream ofs(asm_path);
+            ofs << riscv << std::endl;
+            if (!ofs)
+            {
+                report(fmt::format("[Error] Cannot write {}.",
+                                   asm_path.string()));
+                return;
+            }
+        }
+        // 不经过 shell 直接运行 clang，路径和 -march 中的字符不会被解释。
+        std::vector<std::string> arguments{"clang",
+                                           asm_path.string(),
+                                           "-c",
+                                           "-o",
+                                           path.string(),
+                                           "-target",
+                                           "riscv32-unknown-linux-elf",
+                                           "-march=" + march,
+                                           "-mabi=ilp32"};
+        std::vector<char*> argv;
+        for (auto& argument : arguments)
+            argv.push_back(argument.data());
+        argv.push_back(nullptr);
+        pid_t pid;
+        int status = 0;
+        int err = ::posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(),
+                                 environ);
+        if (!err)
+            while (::waitpid(pid, &status, 0) < 0)
+                if (errno != EINTR)
+                {
+                    err = errno;
+                    break;
+                }
+        std::error_code ec;
+        std::filesystem::remove(asm_path, ec);
+        if (err)
+            report(fmt::format("[Error] Cannot assemble {}: cannot run clang: "
+                               "{}.",
+                               path.string(), std::strerror(err)));
+        else if (!WIFEXITED(status) || WEXITSTATUS(status))
+            report(fmt::format("[Error] Cannot assemble {}: clang {}.",
+                               path.string(),
+                               WIFEXITED(status)
+                                   ? fmt::format("exited with {}",
+                                                 WEXITSTATUS(status))
+                                   : fmt::format("was killed by signal {}",
+                                                 WTERMSIG(status))));
+    });
+}
+void output_writer::join()
+{
+    for (auto& thread : threads)
+        thread.join();
+    threads.clear();
+    std::lock_guard lock(errors_mutex);
+    if (!errors.empty())
+        throw std::runtime_error(std::exchange(errors, std::string()));
+}
+void output_writer::report(const std::string& error)
+{
+    std::lock_guard lock(errors_mutex);
+    if (!errors.empty())
+        errors += "\n";
+    errors += error;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file emit.h
+ * @author UnnamedOrange
+ * @brief Write several outputs of one compilation.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace compiler
+{
+    /**
+     * @brief Kind of an output.
+     */
+    enum class emit_kind_t
+    {
+        /**
+         * @brief Koopa IR text.
+         */
+        koopa,
+        /**
+         * @brief RISC-V assembly.
+         */
+        riscv,
+        /**
+         * @brief C source, compiled by the host C compiler with
+         * runtime/sysy_host.c.
+         */
+        c,
+        /**
+         * @brief RISC-V object file, assembled by clang.
+         */
+        obj,
+    };
+
+    /**
+     * @brief An output requested by "-emit KIND=PATH".
+     */
+    struct emit_request_t
+    {
+        emit_kind_t kind;
+        std::filesystem::path path;
+
+        /**
+         * @brief Parse "KIND=PATH".
+         * If the string is invalid, throw an std::invalid_argument.
+         */
+        static emit_request_t parse(const std::string& str);
+    };
+
+    /**
+     * @brief Write outputs on background threads, so that writing one
+     * output overlaps with producing the next.
+     */
+    class output_writer
+    {
+    private:
+        std::vector<std::thread> threads;
+        std::mutex errors_mutex;
+        std::string errors;
+
+    public:
+        output_writer() = default;
+        ~output_writer();
+        output_writer(const output_writer&) = delete;
+        output_writer& operator=(const output_writer&) = delete;
+
+    public:
+        /**
+         * @brief Start writing a text output.
+         */
+        void write(const std::filesystem::path& path, std::string content);
+        /**
+         * @brief Start assembling RISC-V assembly into an object file.
+         *
+         * @param march ISA string passed to the assembler.
+         */
+        void assemble(const std::filesystem::path& path, std::string riscv,
+                      std::string march);
+        /**
+         * @brief Wait for all outputs.
+         * If any output failed, throw an std::runtime_error.
+         */
+        void join();
+
+    private:
+        void report(const std::string& error);
+    };
+} // namespace compiler
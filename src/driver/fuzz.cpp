@@ -0,0 +1,179 @@
+/**
+ * @file fuzz.cpp
+ * @author UnnamedOrange
+ * @brief Differential testing of the optimization levels with random
+ * programs.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "fuzz.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <ir/koopa_interpreter.h>
+
+#include "random_program.h"
+#include "watch.h"
+
+using namespace compiler;
+
+namespace
+{
+    /**
+     * @brief Observable behavior of a program at an optimization level.
+     */
+    struct behavior_t
+    {
+        bool is_valid{};
+        std::string description;
+
+        bool operator==(const behavior_t&) const = default;
+    };
+
+    std::string escape(const std::string& output)
+    {
+        std::string ret;
+        for (auto c : output)
+        {
+            if (ret.size() >= 60)
+                return ret + "...";
+            ret += c == '\n' ? std::string("\\n") : std::string(1, c);
+        }
+        return ret;
+    }
+
+    class differential_tester_t
+    {
+    private:
+        const std::function<std::string(const std::string&, int)>& compile;
+        int max_level;
+        ir::koopa_interpreter interpreter;
+
+    public:
+        differential_tester_t(
+            const std::function<std::string(const std::string&, int)>&
+                compile,
+            int max_level)
+            : compile(compile), max_level(max_level)
+        {
+        }
+
+    public:
+        behavior_t behavior_at(const std::string& source, int level) const
+        {
+            std::string koopa_ir_str;
+            try
+            {
+                koopa_ir_str = compile(source, level);
+            }
+            // 删除子树后的程序可能不再合法，前端对此抛出的不一定是
+            // std::runtime_error。
+            catch (const std::exception& err)
+            {
+                return {false, fmt::format("fails to compile: {}", err.what())};
+            }
+            try
+            {
+                auto result = interpreter.run(koopa_ir_str);
+                return {true,
+                        fmt::format("returns {} and prints \"{}\"",
+                                    result.exit_code, escape(result.output))};
+            }
+            catch (const std::runtime_error& err)
+            {
+                return {false, fmt::format("fails to run: {}", err.what())};
+            }
+        }
+        /**
+         * @brief Get the behavior of each level, or an empty vector if the
+         * program is not valid at level 0, e.g. it runs too long.
+         */
+        std::vector<behavior_t> behaviors(const std::string& source) const
+        {
+            std::vector<behavior_t> ret{behavior_at(source, 0)};
+            if (!ret[0].is_valid)
+                return {};
+            for (int level = 1; level <= max_level; level++)
+                ret.push_back(behavior_at(source, level));
+            return ret;
+        }
+        static bool differs(const std::vector<behavior_t>& results)
+        {
+            for (const auto& result : results)
+                if (result != results[0])
+                    return true;
+            return false;
+        }
+    };
+} // namespace
+
+size_t compiler::run_fuzz(
+    size_t count, uint64_t seed,
+    const std::function<std::string(const std::string&, int)>& compile,
+    const std::filesystem::path& failure_directory, int max_level)
+{
+    differential_tester_t tester(compile, max_level);
+    size_t failure_count = 0;
+    size_t invalid_count = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        auto program_seed = seed + i;
+        auto program = generate_random_program(program_seed);
+        auto results = tester.behaviors(program.to_sysy());
+        // 在 O0 运行过久等的程序不参与比较。
+        if (results.empty())
+        {
+            invalid_count++;
+            continue;
+        }
+        if (!tester.differs(results))
+            continue;
+        failure_count++;
+
+        // 不断删除子树，直到删除任何子树都不再使结果不同。
+        auto original_size = program.size();
+        for (bool is_reduced = true; is_reduced;)
+        {
+            is_reduced = false;
+            for (size_t index = 0;
+                 auto candidate = reduce_random_program(program, index);)
+            {
+                if (candidate->is_well_formed() &&
+                    tester.differs(tester.behaviors(candidate->to_sysy())))
+                {
+                    program = std::move(*candidate);
+                    is_reduced = true;
+                }
+                else
+                    index++;
+            }
+        }
+
+        auto source = program.to_sysy();
+        std::string header = fmt::format("// Seed: {}\n", program_seed);
+        results = tester.behaviors(source);
+        for (size_t level = 0; level < results.size(); level++)
+            header += fmt::format("// O{} {}\n", level,
+                                  results[level].description);
+        auto path =
+            failure_directory / fmt::format("fuzz_{}.sy", program_seed);
+        write_file_atomically(path, header + source);
+        std::cout << fmt::format("[Fuzz] Seed {} gives different results. "
+                                 "Minimized from {} to {} nodes: {}",
+                                 program_seed, original_size, program.size(),
+                                 path.string())
+                  << std::endl;
+    }
+    std::cout << fmt::format("[Fuzz] Compared {} programs, {} differ, {} "
+                             "skipped.",
+                             count - invalid_count, failure_count,
+                             invalid_count)
+              << std::endl;
+    return failure_count;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file fuzz.h
+ * @author UnnamedOrange
+ * @brief Differential testing of the optimization levels with random
+ * programs.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+namespace compiler
+{
+    /**
+     * @brief Compile random programs at every optimization level, run the
+     * Koopa IR of each level and compare the results with level 0.
+     * A program whose results differ is minimized by deleting subtrees
+     * while they still differ, and written to "fuzz_SEED.sy" in the failure
+     * directory.
+     *
+     * @param count Number of programs.
+     * @param seed Seed of the first program. Program i uses seed + i.
+     * @param compile Compile SysY source to Koopa IR at an optimization
+     * level. Throws an std::runtime_error on failure.
+     * @param failure_directory Where to write failing programs.
+     * @param max_level Highest optimization level to compare.
+     * @return size_t Number of programs whose results differ.
+     */
+    size_t run_fuzz(
+        size_t count, uint64_t seed,
+        const std::function<std::string(const std::string&, int)>& compile,
+        const std::filesystem::path& failure_directory, int max_level = 2);
+} // namespace compiler
@@ -0,0 +1,313 @@
+/**
+ * @file metrics.cpp
+ * @author UnnamedOrange
+ * @brief Metrics of a long-running compiler process in Prometheus text
+ * format.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include <frontend/string_interner.h>
+#include <job_budget.hpp>
+
+using namespace compiler;
+
+void metrics_registry::observe_compile(std::string_view mode, double seconds,
+                                       bool succeeded)
+{
+    std::lock_guard lock(mutex);
+    auto it = latencies.find(mode);
+    if (it == latencies.end())
+        it = latencies.emplace(std::string(mode), histogram_t{}).first;
+    auto& histogram = it->second;
+    for (size_t i = 0; i < latency_buckets.size(); i++)
+        if (seconds <= latency_buckets[i])
+            histogram.buckets[i]++;
+    histogram.count++;
+    histogram.sum += seconds;
+    if (!succeeded)
+    {
+        auto failure = failures.find(mode);
+        if (failure == failures.end())
+            failure = failures.emplace(std::string(mode), 0).first;
+        failure->second++;
+    }
+}
+void metrics_registry::add_phase_cpu_time(std::string_view phase,
+                                          double seconds)
+{
+    std::lock_guard lock(mutex);
+    auto it = phase_cpu_seconds.find(phase);
+    if (it == phase_cpu_seconds.end())
+        it = phase_cpu_seconds.emplace(std::string(phase), 0.0).first;
+    it->second += seconds;
+}
+void metrics_registry::add_cache_lookups(std::string_view cache,
+                                         uint64_t hits, uint64_t misses)
+{
+    std::lock_guard lock(mutex);
+    auto it = cache_lookups.find(cache);
+    if (it == cache_lookups.end())
+        it = cache_lookups
+                 .emplace(std::string(cache), std::pair<uint64_t, uint64_t>{})
+                 .first;
+    it->second.first += hits;
+    it->second.second += misses;
+}
+void metrics_registry::add_bytes(size_t in, size_t out)
+{
+    std::lock_guard lock(mutex);
+    bytes_in += in;
+    bytes_out += out;
+}
+void metrics_registry::set_queue_depth(size_t depth)
+{
+    std::lock_guard lock(mutex);
+    queue_depth = depth;
+}
+void metrics_registry::sample_heap()
+{
+    auto heap = job_budget::heap_in_use();
+    std::lock_guard lock(mutex);
+    heap_high_water = std::max(heap_high_water, heap);
+}
+
+std::string metrics_registry::render() const
+{
+    std::lock_guard lock(mutex);
+    std::string ret;
+    auto header = [&](std::string_view name, std::string_view type,
+                      std::string_view help) {
+        ret += fmt::format("# HELP {} {}\n# TYPE {} {}\n", name, help, name,
+                           type);
+    };
+
+    header("sysy_compile_duration_seconds", "histogram",
+           "Wall time of compilations.");
+    for (const auto& [mode, histogram] : latencies)
+    {
+        // Prometheus 的桶是累计的。
+        for (size_t i = 0; i < latency_buckets.size(); i++)
+            ret += fmt::format(
+                "sysy_compile_duration_seconds_bucket{{mode=\"{}\",le=\"{}\"}} "
+                "{}\n",
+                mode, latency_buckets[i], histogram.buckets[i]);
+        ret += fmt::format(
+            "sysy_compile_duration_seconds_bucket{{mode=\"{}\",le=\"+Inf\"}} "
+            "{}\n",
+            mode, histogram.count);
+        ret += fmt::format(
+            "sysy_compile_duration_seconds_sum{{mode=\"{}\"}} {}\n", mode,
+            histogram.sum);
+        ret += fmt::format(
+            "sysy_compile_duration_seconds_count{{mode=\"{}\"}} {}\n", mode,
+            histogram.count);
+    }
+    header("sysy_compile_failures_total", "counter",
+           "Compilations that failed or exceeded their budget.");
+    for (const auto& [mode, count] : failures)
+        ret += fmt::format("sysy_compile_failures_total{{mode=\"{}\"}} {}\n",
+                           mode, count);
+
+    header("sysy_phase_cpu_seconds_total", "counter",
+           "CPU time spent in each phase.");
+    for (const auto& [phase, seconds] : phase_cpu_seconds)
+        ret += fmt::format(
+            "sysy_phase_cpu_seconds_total{{phase=\"{}\"}} {}\n", phase,
+            seconds);
+
+    header("sysy_cache_lookups_total", "counter", "Lookups in caches.");
+    for (const auto& [cache, counts] : cache_lookups)
+        ret += fmt::format(
+            "sysy_cache_lookups_total{{cache=\"{}\",result=\"hit\"}} {}\n"
+            "sysy_cache_lookups_total{{cache=\"{}\",result=\"miss\"}} {}\n",
+            cache, counts.first, cache, counts.second);
+    header("sysy_cache_hit_ratio", "gauge", "Hits over lookups of caches.");
+    for (const auto& [cache, counts] : cache_lookups)
+        ret += fmt::format(
+            "sysy_cache_hit_ratio{{cache=\"{}\"}} {}\n", cache,
+            static_cast<double>(counts.first) /
+                std::max<uint64_t>(counts.first + counts.second, 1));
+
+    header("sysy_input_bytes_total", "counter", "Bytes of source read.");
+    ret += fmt::format("sysy_input_bytes_total {}\n", bytes_in);
+    header("sysy_output_bytes_total", "counter", "Bytes of output produced.");
+    ret += fmt::format("sysy_output_bytes_total {}\n", bytes_out);
+    header("sysy_queue_depth", "gauge", "Inputs waiting to be compiled.");
+    ret += fmt::format("sysy_queue_depth {}\n", queue_depth);
+    header("sysy_heap_high_water_bytes", "gauge",
+           "Largest heap in use seen after a compilation.");
+    ret += fmt::format("sysy_heap_high_water_bytes {}\n", heap_high_water);
+    // 驻留的字符串只增不减，当前大小即最高水位。
+    header("sysy_interner_arena_bytes", "gauge",
+           "Bytes of arena allocated by the string interner.");
+    ret += fmt::format("sysy_interner_arena_bytes {}\n",
+                       string_interner::global().arena_size());
+    return ret;
+}
+
+metrics_server::metrics_server(const std::string& endpoint,
+                               const metrics_registry& registry)
+    : registry(registry)
+{
+    auto fail = [&](std::string_view what) {
+        int err = errno;
+        if (listen_fd >= 0)
+            ::close(listen_fd);
+        throw std::runtime_error(
+            fmt::format("[Error] Cannot listen on {}: {}: {}.", endpoint,
+                        what, std::strerror(err)));
+    };
+
+    bool is_port = !endpoint.empty() &&
+                   std::all_of(endpoint.begin(), endpoint.end(),
+                               [](char c) { return '0' <= c && c <= '9'; });
+    if (is_port)
+    {
+        if (endpoint.size() > 5 || std::stoul(endpoint) > 65535)
+        {
+            errno = EINVAL;
+            fail("port");
+        }
+        listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0)
+            fail("socket");
+        int reuse = 1;
+        ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse,
+                     sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(std::stoul(endpoint)));
+        // 只在本机提供。
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&address),
+                   sizeof(address)) < 0)
+            fail("bind");
+    }
+    else
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (endpoint.size() >= sizeof(address.sun_path))
+        {
+            errno = ENAMETOOLONG;
+            fail("path");
+        }
+        std::memcpy(address.sun_path, endpoint.c_str(), endpoint.size() + 1);
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0)
+            fail("socket");
+        // 上次运行留下的套接字文件无法再绑定，先删除。不删除其他文件。
+        struct stat st;
+        if (::stat(endpoint.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            ::unlink(endpoint.c_str());
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&address),
+                   sizeof(address)) < 0)
+            fail("bind");
+        socket_path = endpoint;
+    }
+    if (::listen(listen_fd, 16) < 0)
+        fail("listen");
+    if (::pipe2(stop_pipe, O_CLOEXEC) < 0)
+        fail("pipe");
+    thread = std::thread([this] { serve(); });
+}
+metrics_server::~metrics_server()
+{
+    char c = 0;
+    while (::write(stop_pipe[1], &c, 1) < 0 && errno == EINTR)
+        ;
+    thread.join();
+    ::close(stop_pipe[0]);
+    ::close(stop_pipe[1]);
+    ::close(listen_fd);
+    if (!socket_path.empty())
+        ::unlink(socket_path.c_str());
+}
+
+void metrics_server::serve()
+{
+    while (true)
+    {
+        pollfd fds[2] = {{listen_fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        if (fds[1].revents)
+            return;
+        if (!(fds[0].revents & POLLIN))
+            continue;
+        int client_fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd < 0)
+            continue;
+        respond(client_fd);
+        ::close(client_fd);
+    }
+}
+void metrics_server::respond(int client_fd)
+{
+    // 读取请求头后应答。不区分路径，任何请求都得到全部指标。
+    // 客户端不发送请求时，稍等后直接应答。
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos &&
+           request.find("\n\n") == std::string::npos && request.size() < 8192)
+    {
+        pollfd fd{client_fd, POLLIN, 0};
+        if (::poll(&fd, 1, 100) <= 0)
+            break;
+        ssize_t size = ::read(client_fd, buffer, sizeof(buffer));
+        if (size <= 0)
+            break;
+        request.append(buffer, size);
+    }
+
+    auto body = registry.render();
+    auto response = fmt::format(
+        "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: {}\r\n"
+        "Connection: close\r\n"
+        "\r\n{}",
+        body.size(), body);
+    for (size_t written = 0; written < response.size();)
+    {
+        ssize_t size = ::send(client_fd, response.data() + written,
+                              response.size() - written, MSG_NOSIGNAL);
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size <= 0)
+            return;
+        written += size;
+    }
+}
+
+double compiler::thread_cpu_time()
+{
+    timespec time{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file metrics.h
+ * @author UnnamedOrange
+ * @brief Metrics of a long-running compiler process in Prometheus text
+ * format.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace compiler
+{
+    /**
+     * @brief Counters and histograms of the compilations in this process.
+     * Thread-safe.
+     */
+    class metrics_registry
+    {
+    public:
+        /**
+         * @brief Upper bounds of the latency histogram buckets in seconds.
+         */
+        static constexpr std::array<double, 10> latency_buckets = {
+            0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.5, 1, 5};
+
+    private:
+        struct histogram_t
+        {
+            std::array<uint64_t, latency_buckets.size()> buckets{};
+            uint64_t count{};
+            double sum{};
+        };
+
+    private:
+        mutable std::mutex mutex;
+        // 键为编译模式。
+        std::map<std::string, histogram_t, std::less<>> latencies;
+        std::map<std::string, uint64_t, std::less<>> failures;
+        // 键为阶段。
+        std::map<std::string, double, std::less<>> phase_cpu_seconds;
+        // 键为缓存的名字，值为命中和未命中的次数。
+        std::map<std::string, std::pair<uint64_t, uint64_t>, std::less<>>
+            cache_lookups;
+        uint64_t bytes_in{};
+        uint64_t bytes_out{};
+        size_t queue_depth{};
+        size_t heap_high_water{};
+
+    public:
+        /**
+         * @brief Record a finished compilation.
+         *
+         * @param mode Compiler mode, e.g. "riscv".
+         * @param seconds Wall time of the compilation.
+         * @param succeeded Whether it produced an output.
+         */
+        void observe_compile(std::string_view mode, double seconds,
+                             bool succeeded);
+        /**
+         * @brief Add CPU time spent in a phase, e.g. "frontend".
+         */
+        void add_phase_cpu_time(std::string_view phase, double seconds);
+        /**
+         * @brief Record lookups in a cache, e.g. "output".
+         */
+        void add_cache_lookups(std::string_view cache, uint64_t hits,
+                               uint64_t misses);
+        /**
+         * @brief Add bytes of source read and output produced.
+         */
+        void add_bytes(size_t in, size_t out);
+        /**
+         * @brief Set the number of inputs waiting to be compiled.
+         */
+        void set_queue_depth(size_t depth);
+        /**
+         * @brief Sample the heap and keep the largest size seen.
+         */
+        void sample_heap();
+        /**
+         * @brief Render all metrics in Prometheus text format.
+         */
+        std::string render() const;
+    };
+
+    /**
+     * @brief Serve metrics over HTTP on a background thread, so that a
+     * scraper or curl can read them.
+     */
+    class metrics_server
+    {
+    private:
+        const metrics_registry& registry;
+        int listen_fd = -1;
+        // 写入一端以通知后台线程退出。
+        int stop_pipe[2] = {-1, -1};
+        std::string socket_path;
+        std::thread thread;
+
+    public:
+        /**
+         * @brief Start serving.
+         * If failed, throw an std::runtime_error.
+         *
+         * @param endpoint A TCP port on 127.0.0.1 if it is a number,
+         * otherwise the path of a Unix socket.
+         * @param registry Metrics to serve. Must outlive the server.
+         */
+        metrics_server(const std::string& endpoint,
+                       const metrics_registry& registry);
+        ~metrics_server();
+        metrics_server(const metrics_server&) = delete;
+        metrics_server& operator=(const metrics_server&) = delete;
+
+    private:
+        void serve();
+        void respond(int client_fd);
+    };
+
+    /**
+     * @brief CPU time consumed by the calling thread in seconds.
+     */
+    double thread_cpu_time();
+
+    /**
+     * @brief Add the CPU time of the calling thread during the lifetime of
+     * the timer to a phase, including when the phase throws.
+     */
+    class phase_timer
+    {
+    private:
+        metrics_registry& registry;
+        std::string_view phase;
+        double start_time;
+
+    public:
+        phase_timer(metrics_registry& registry, std::string_view phase)
+            : registry(registry), phase(phase), start_time(thread_cpu_time())
+        {
+        }
+        ~phase_timer()
+        {
+            try
+            {
+                registry.add_phase_cpu_time(phase,
+                                            thread_cpu_time() - start_time);
+            }
+            catch (...)
+            {
+            }
+        }
+        phase_timer(const phase_timer&) = delete;
+        phase_timer& operator=(const phase_timer&) = delete;
+    };
+} // namespace compiler
@@ -0,0 +1,200 @@
+/**
+ * @file profile_report.cpp
+ * @author UnnamedOrange
+ * @brief Report the profile written by programs built with
+ * -instrument-functions.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "profile_report.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <backend/profiler_runtime.h>
+
+using namespace compiler;
+
+namespace
+{
+    /**
+     * @brief Profile of a program run.
+     */
+    struct profile_t
+    {
+        std::vector<std::string> names;
+        std::vector<uint64_t> inclusive;
+        std::vector<uint64_t> exclusive;
+        std::vector<uint32_t> calls;
+        // 第 i 行第 j 列为 i 调用 j 的次数，最后一行为从外部调用的次数。
+        std::vector<std::vector<uint32_t>> edges;
+    };
+
+    /**
+     * @brief Read little-endian integers from a profile.
+     */
+    class profile_reader
+    {
+    private:
+        const std::string& data;
+        size_t position{};
+
+    public:
+        explicit profile_reader(const std::string& data) : data(data) {}
+
+    public:
+        uint64_t read(size_t size)
+        {
+            if (position > data.size() || data.size() - position < size)
+                throw std::runtime_error(
+                    "[Error] Invalid profile: unexpected end of file.");
+            uint64_t ret = 0;
+            for (size_t i = 0; i < size; i++)
+                ret |= static_cast<uint64_t>(
+                           static_cast<unsigned char>(data[position + i]))
+                       << (8 * i);
+            position += size;
+            return ret;
+        }
+        std::string read_string(size_t size)
+        {
+            if (position > data.size() || data.size() - position < size)
+                throw std::runtime_error(
+                    "[Error] Invalid profile: unexpected end of file.");
+            auto ret = data.substr(position, size);
+            position += size;
+            return ret;
+        }
+        void align(size_t alignment)
+        {
+            position = (position + alignment - 1) / alignment * alignment;
+        }
+    };
+
+    profile_t parse_profile(const std::string& data)
+    {
+        profile_reader reader(data);
+        if (reader.read_string(profile_magic.size()) != profile_magic)
+            throw std::runtime_error("[Error] Invalid profile: bad magic.");
+        if (reader.read(4) != profile_version)
+            throw std::runtime_error(
+                "[Error] Invalid profile: unsupported version.");
+        size_t n = reader.read(4);
+        auto names = reader.read_string(reader.read(4));
+        reader.align(8);
+
+        profile_t ret;
+        for (size_t begin = 0; ret.names.size() < n;)
+        {
+            auto end = names.find('\0', begin);
+            if (end == std::string::npos)
+                throw std::runtime_error(
+                    "[Error] Invalid profile: bad function names.");
+            ret.names.push_back(names.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        for (size_t i = 0; i < n; i++)
+            ret.inclusive.push_back(reader.read(8));
+        for (size_t i = 0; i < n; i++)
+            ret.exclusive.push_back(reader.read(8));
+        for (size_t i = 0; i < n; i++)
+            ret.calls.push_back(static_cast<uint32_t>(reader.read(4)));
+        ret.edges.resize(n + 1);
+        for (auto& row : ret.edges)
+            for (size_t j = 0; j < n; j++)
+                row.push_back(static_cast<uint32_t>(reader.read(4)));
+        return ret;
+    }
+} // namespace
+
+std::string compiler::profile_report(const std::filesystem::path& profile_path)
+{
+    std::ifstream ifs(profile_path, std::ios::binary);
+    if (!ifs)
+        throw std::runtime_error(
+            fmt::format("[Error] Cannot read {}.", profile_path.string()));
+    std::string data((std::istreambuf_iterator<char>(ifs)),
+                     std::istreambuf_iterator<char>());
+    auto profile = parse_profile(data);
+    size_t n = profile.names.size();
+
+    std::string ret;
+    // 平面剖析：按函数自身花费的周期数排序。
+    {
+        std::vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return profile.exclusive[a] > profile.exclusive[b];
+        });
+        uint64_t total = std::accumulate(profile.exclusive.begin(),
+                                         profile.exclusive.end(), uint64_t{});
+        ret += "Flat profile:\n\n";
+        ret += fmt::format("{:>7} {:>14} {:>14} {:>10} {:>12}  {}\n", "%time",
+                           "self cycles", "total cycles", "calls",
+                           "self/call", "name");
+        for (auto i : order)
+        {
+            if (!profile.calls[i])
+                continue;
+            ret += fmt::format(
+                "{:>7.2f} {:>14} {:>14} {:>10} {:>12}  {}\n",
+                total ? 100.0 * profile.exclusive[i] / total : 0.0,
+                profile.exclusive[i], profile.inclusive[i], profile.calls[i],
+                profile.exclusive[i] / profile.calls[i], profile.names[i]);
+        }
+    }
+    // 调用图：每个函数之前为调用者，之后为被调用者。
+    {
+        std::vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return profile.inclusive[a] > profile.inclusive[b];
+        });
+        ret += "\nCall graph:\n\n";
+        ret += fmt::format("{:<7} {:>14} {:>14} {:>21}  {}\n", "index",
+                           "total cycles", "self cycles", "calls", "name");
+        for (auto i : order)
+        {
+            if (!profile.calls[i])
+                continue;
+            for (size_t caller = 0; caller <= n; caller++)
+            {
+                auto count = profile.edges[caller][i];
+                if (!count)
+                    continue;
+                ret += fmt::format(
+                    "{:<7} {:>14} {:>14} {:>21}      {}\n", "", "", "",
+                    fmt::format("{}/{}", count, profile.calls[i]),
+                    caller == n
+                        ? std::string("<spontaneous>")
+                        : fmt::format("{} [{}]", profile.names[caller],
+                                      caller));
+            }
+            ret += fmt::format("{:<7} {:>14} {:>14} {:>21}  {} [{}]\n",
+                               fmt::format("[{}]", i), profile.inclusive[i],
+                               profile.exclusive[i], profile.calls[i],
+                               profile.names[i], i);
+            for (size_t callee = 0; callee < n; callee++)
+            {
+                auto count = profile.edges[i][callee];
+                if (!count)
+                    continue;
+                ret += fmt::format(
+                    "{:<7} {:>14} {:>14} {:>21}      {} [{}]\n", "", "", "",
+                    fmt::format("{}/{}", count, profile.calls[callee]),
+                    profile.names[callee], callee);
+            }
+            ret += "\n";
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,28 @@
+/**
+ * @file profile_report.h
+ * @author UnnamedOrange
+ * @brief Report the profile written by programs built with
+ * -instrument-functions.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+namespace compiler
+{
+    /**
+     * @brief Format a profile as a flat profile followed by a call graph,
+     * similar to gprof.
+     * If the profile cannot be read or is invalid, throw an
+     * std::runtime_error.
+     *
+     * @param profile_path Path of the profile, usually "sysy.prof".
+     * @return std::string Report in string.
+     */
+    std::string profile_report(const std::filesystem::path& profile_path);
+} // namespace compiler
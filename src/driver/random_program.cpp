@@ -0,0 +1,538 @@
+/**
+ * @file random_program.cpp
+ * @author UnnamedOrange
+ * @brief Random well-defined SysY programs for differential testing.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "random_program.h"
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <string_view>
+#include <utility>
+
+#include <fmt/core.h>
+
+using namespace compiler;
+
+std::string sysy_node_t::to_sysy(int indent) const
+{
+    std::string pad(indent * 4, ' ');
+    auto join = [](const auto& items, std::string_view separator,
+                   const auto& to_string) {
+        std::string ret;
+        for (const auto& item : items)
+        {
+            if (!ret.empty())
+                ret += separator;
+            ret += to_string(item);
+        }
+        return ret;
+    };
+    auto statements = [&](const std::vector<sysy_node_t>& nodes,
+                          int indent) {
+        std::string ret;
+        for (const auto& node : nodes)
+            ret += node.to_sysy(indent);
+        return ret;
+    };
+    auto expression = [](const sysy_node_t& node) { return node.to_sysy(); };
+
+    switch (kind)
+    {
+    case sysy_node_kind_t::program:
+    {
+        std::string ret;
+        for (const auto& child : children)
+        {
+            if (child.kind == sysy_node_kind_t::function && !ret.empty())
+                ret += '\n';
+            ret += child.to_sysy();
+        }
+        return ret;
+    }
+    case sysy_node_kind_t::global_declaration:
+    case sysy_node_kind_t::declaration:
+        return fmt::format("{}int {} = {};\n", pad, text,
+                           children.at(0).to_sysy());
+    case sysy_node_kind_t::function:
+        return fmt::format("int {}({})\n{{\n{}}}\n", text,
+                           join(parameters, ", ",
+                                [](const std::string& parameter) {
+                                    return "int " + parameter;
+                                }),
+                           statements(children, 1));
+    case sysy_node_kind_t::block:
+        return fmt::format("{}{{\n{}{}}}\n", pad,
+                           statements(children, indent + 1), pad);
+    case sysy_node_kind_t::assignment:
+        return fmt::format("{}{} = {};\n", pad, text, children.at(0).to_sysy());
+    case sysy_node_kind_t::print:
+        return fmt::format("{}putint({});\n{}putch(10);\n", pad,
+                           children.at(0).to_sysy(), pad);
+    case sysy_node_kind_t::if_statement:
+    {
+        auto ret = fmt::format("{}if ({})\n{}", pad, children.at(0).to_sysy(),
+                               children.at(1).to_sysy(indent));
+        if (children.size() > 2)
+            ret += fmt::format("{}else\n{}", pad,
+                               children[2].to_sysy(indent));
+        return ret;
+    }
+    case sysy_node_kind_t::while_statement:
+    {
+        // 循环变量在循环体之前递增，continue 不会跳过它。
+        std::string inner(indent * 4 + 4, ' ');
+        std::string condition = fmt::format("{} < {}", text, bound);
+        if (children.size() > 1)
+            condition += fmt::format(" && {}", children[1].to_sysy());
+        return fmt::format("{0}{{\n"
+                           "{1}int {2} = 0;\n"
+                           "{1}while ({3})\n"
+                           "{1}{{\n"
+                           "{1}    {2} = {2} + 1;\n"
+                           "{4}"
+                           "{1}}}\n"
+                           "{0}}}\n",
+                           pad, inner, text, condition,
+                           statements(children.at(0).children, indent + 2));
+    }
+    case sysy_node_kind_t::break_statement:
+        return pad + "break;\n";
+    case sysy_node_kind_t::continue_statement:
+        return pad + "continue;\n";
+    case sysy_node_kind_t::return_statement:
+        return fmt::format("{}return {};\n", pad, children.at(0).to_sysy());
+    case sysy_node_kind_t::literal:
+        return text.starts_with('-') ? fmt::format("({})", text) : text;
+    case sysy_node_kind_t::variable:
+        return text;
+    case sysy_node_kind_t::unary:
+        return fmt::format("({}{})", text, children.at(0).to_sysy());
+    case sysy_node_kind_t::binary:
+        return fmt::format("({} {} {})", children.at(0).to_sysy(), text,
+                           children.at(1).to_sysy());
+    case sysy_node_kind_t::division:
+        return fmt::format("({} {} ({} % 16 + 17))", children.at(0).to_sysy(),
+                           text, children.at(1).to_sysy());
+    case sysy_node_kind_t::call:
+        return fmt::format("{}({})", text, join(children, ", ", expression));
+    }
+    return "";
+}
+size_t sysy_node_t::size() const
+{
+    size_t ret = 1;
+    for (const auto& child : children)
+        ret += child.size();
+    return ret;
+}
+
+namespace
+{
+    bool is_well_formed(const sysy_node_t& node,
+                        std::vector<std::string>& names, bool is_in_loop)
+    {
+        auto is_declared = [&](const std::string& name) {
+            return std::find(names.begin(), names.end(), name) != names.end();
+        };
+        auto children_are_well_formed = [&](bool is_in_loop) {
+            auto name_count = names.size();
+            for (const auto& child : node.children)
+                if (!is_well_formed(child, names, is_in_loop))
+                    return false;
+            names.resize(name_count);
+            return true;
+        };
+        switch (node.kind)
+        {
+        case sysy_node_kind_t::program:
+            for (const auto& child : node.children)
+                if (!is_well_formed(child, names, false))
+                    return false;
+            return true;
+        case sysy_node_kind_t::global_declaration:
+        case sysy_node_kind_t::declaration:
+            if (!children_are_well_formed(is_in_loop))
+                return false;
+            names.push_back(node.text);
+            return true;
+        case sysy_node_kind_t::function:
+        {
+            names.push_back(node.text);
+            auto name_count = names.size();
+            names.insert(names.end(), node.parameters.begin(),
+                         node.parameters.end());
+            bool ret = children_are_well_formed(false);
+            names.resize(name_count);
+            return ret;
+        }
+        case sysy_node_kind_t::while_statement:
+        {
+            names.push_back(node.text);
+            bool ret = children_are_well_formed(true);
+            names.pop_back();
+            return ret;
+        }
+        case sysy_node_kind_t::break_statement:
+        case sysy_node_kind_t::continue_statement:
+            return is_in_loop;
+        case sysy_node_kind_t::assignment:
+        case sysy_node_kind_t::variable:
+        case sysy_node_kind_t::call:
+            return is_declared(node.text) &&
+                   children_are_well_formed(is_in_loop);
+        default:
+            return children_are_well_formed(is_in_loop);
+        }
+    }
+
+    class generator_t
+    {
+    private:
+        struct variable_t
+        {
+            std::string name;
+            bool is_assignable{};
+        };
+        struct function_t
+        {
+            std::string name;
+            size_t parameter_count{};
+        };
+
+    private:
+        std::mt19937_64 random;
+        std::vector<variable_t> variables;
+        std::vector<function_t> functions;
+        size_t global_count{};
+        size_t local_count{};
+        size_t counter_count{};
+        int loop_depth{};
+        int statement_budget{};
+
+    public:
+        explicit generator_t(uint64_t seed) : random(seed) {}
+
+    private:
+        // 不使用标准库的分布，使同一种子在不同平台上生成同一程序。
+        size_t below(size_t n) { return random() % n; }
+        bool chance(size_t percent) { return below(100) < percent; }
+        template <typename T, size_t size>
+        const T& pick(const std::array<T, size>& items)
+        {
+            return items[below(size)];
+        }
+
+        sysy_node_t literal()
+        {
+            // 偶尔使用大数，使加减乘溢出并回绕。
+            static constexpr std::array<std::string_view, 6> large{
+                "2147483647", "1000000007", "65536",
+                "46341",      "123456789",  "1073741824"};
+            if (chance(10))
+                return {sysy_node_kind_t::literal, std::string(pick(large))};
+            return {sysy_node_kind_t::literal,
+                    std::to_string(static_cast<int>(below(141)) - 20)};
+        }
+        sysy_node_t expression(int depth)
+        {
+            if (!depth || chance(30))
+            {
+                if (!variables.empty() && chance(65))
+                    return {sysy_node_kind_t::variable,
+                            variables[below(variables.size())].name};
+                return literal();
+            }
+            static constexpr std::array<std::string_view, 16> binary_ops{
+                "+",  "-",  "*",  "+",  "-", "*",  "<",  ">",
+                "<=", ">=", "==", "!=", "&&", "||", "+", "*"};
+            static constexpr std::array<std::string_view, 3> unary_ops{
+                "-", "!", "+"};
+            static constexpr std::array<std::string_view, 2> division_ops{
+                "/", "%"};
+            auto choice = below(10);
+            sysy_node_t ret;
+            if (choice < 6)
+                ret = {sysy_node_kind_t::binary, std::string(pick(binary_ops))};
+            else if (choice < 8)
+                ret = {sysy_node_kind_t::unary, std::string(pick(unary_ops))};
+            else
+                ret = {sysy_node_kind_t::division,
+                       std::string(pick(division_ops))};
+            ret.children.push_back(expression(depth - 1));
+            if (ret.kind != sysy_node_kind_t::unary)
+                ret.children.push_back(expression(depth - 1));
+            return ret;
+        }
+        /**
+         * @brief A whole right-hand side, which may be a call.
+         */
+        sysy_node_t right_hand_side()
+        {
+            if (functions.empty() || !chance(25))
+                return expression(3);
+            const auto& function = functions[below(functions.size())];
+            sysy_node_t ret{sysy_node_kind_t::call, function.name};
+            for (size_t i = 0; i < function.parameter_count; i++)
+                ret.children.push_back(expression(2));
+            return ret;
+        }
+
+        sysy_node_t block(int depth)
+        {
+            sysy_node_t ret{sysy_node_kind_t::block};
+            auto variable_count = variables.size();
+            for (size_t i = 1 + below(4); i && statement_budget > 0; i--)
+                ret.children.push_back(statement(depth));
+            variables.resize(variable_count);
+            return ret;
+        }
+        sysy_node_t statement(int depth)
+        {
+            statement_budget--;
+            auto choice = below(100);
+            std::vector<const variable_t*> assignable;
+            for (const auto& variable : variables)
+                if (variable.is_assignable)
+                    assignable.push_back(&variable);
+
+            if (choice < 20)
+            {
+                sysy_node_t ret{sysy_node_kind_t::declaration,
+                                fmt::format("v{}", local_count++)};
+                ret.children.push_back(right_hand_side());
+                variables.push_back({ret.text, true});
+                return ret;
+            }
+            if (choice < 45 && !assignable.empty())
+            {
+                sysy_node_t ret{sysy_node_kind_t::assignment,
+                                assignable[below(assignable.size())]->name};
+                ret.children.push_back(right_hand_side());
+                return ret;
+            }
+            if (choice < 55)
+            {
+                sysy_node_t ret{sysy_node_kind_t::print};
+                ret.children.push_back(expression(3));
+                return ret;
+            }
+            if (choice < 70 && depth < 3)
+            {
+                sysy_node_t ret{sysy_node_kind_t::if_statement};
+                ret.children.push_back(expression(2));
+                ret.children.push_back(block(depth + 1));
+                if (chance(50))
+                    ret.children.push_back(block(depth + 1));
+                return ret;
+            }
+            if (choice < 82 && depth < 3 && loop_depth < 2)
+            {
+                // 循环变量只读，保证循环有界。
+                sysy_node_t ret{sysy_node_kind_t::while_statement,
+                                fmt::format("i{}", counter_count++)};
+                ret.bound = static_cast<int>(below(7));
+                variables.push_back({ret.text, false});
+                loop_depth++;
+                ret.children.push_back(block(depth + 1));
+                loop_depth--;
+                if (chance(30))
+                    ret.children.push_back(expression(2));
+                variables.pop_back();
+                return ret;
+            }
+            if (choice < 88 && loop_depth)
+                return {chance(50) ? sysy_node_kind_t::break_statement
+                                   : sysy_node_kind_t::continue_statement};
+            // 提前返回只出现在嵌套的语句中，避免函数的大部分不可达。
+            if (choice < 91 && depth)
+            {
+                sysy_node_t ret{sysy_node_kind_t::return_statement};
+                ret.children.push_back(expression(3));
+                return ret;
+            }
+            return block(depth + 1);
+        }
+        sysy_node_t function(std::string name, size_t parameter_count,
+                             const std::vector<std::string>& globals)
+        {
+            sysy_node_t ret{sysy_node_kind_t::function, std::move(name)};
+            auto variable_count = variables.size();
+            for (size_t i = 0; i < parameter_count; i++)
+            {
+                ret.parameters.push_back(fmt::format("a{}", i));
+                variables.push_back({ret.parameters.back(), true});
+            }
+            statement_budget = static_cast<int>(6 + below(15));
+            while (statement_budget > 0)
+                ret.children.push_back(statement(0));
+            // main 返回前输出所有全局变量。
+            if (ret.text == "main")
+            {
+                for (const auto& global : globals)
+                {
+                    sysy_node_t print{sysy_node_kind_t::print};
+                    print.children.push_back(
+                        {sysy_node_kind_t::variable, global});
+                    ret.children.push_back(std::move(print));
+                }
+            }
+            sysy_node_t return_statement{sysy_node_kind_t::return_statement};
+            return_statement.children.push_back(expression(3));
+            ret.children.push_back(std::move(return_statement));
+            variables.resize(variable_count);
+            return ret;
+        }
+
+    public:
+        sysy_node_t program()
+        {
+            sysy_node_t ret{sysy_node_kind_t::program};
+            std::vector<std::string> globals;
+            for (size_t i = 1 + below(4); i; i--)
+            {
+                sysy_node_t global{sysy_node_kind_t::global_declaration,
+                                   fmt::format("g{}", global_count++)};
+                global.children.push_back(literal());
+                globals.push_back(global.text);
+                variables.push_back({global.text, true});
+                ret.children.push_back(std::move(global));
+            }
+            // 函数只调用之前定义的函数，不会递归。
+            for (size_t i = below(5); i; i--)
+            {
+                auto name = fmt::format("f{}", functions.size());
+                auto parameter_count = below(4);
+                ret.children.push_back(
+                    function(name, parameter_count, globals));
+                functions.push_back({name, parameter_count});
+            }
+            ret.children.push_back(function("main", 0, globals));
+            return ret;
+        }
+    };
+
+    bool is_statement_list(sysy_node_kind_t kind)
+    {
+        return kind == sysy_node_kind_t::program ||
+               kind == sysy_node_kind_t::function ||
+               kind == sysy_node_kind_t::block;
+    }
+    /**
+     * @brief Get the children of a node that can be deleted. The return
+     * statement at the end of a function is kept, so that the function does
+     * not run off its end.
+     */
+    size_t deletable_count(const sysy_node_t& node)
+    {
+        if (!is_statement_list(node.kind))
+            return 0;
+        if (node.kind == sysy_node_kind_t::function &&
+            !node.children.empty() &&
+            node.children.back().kind == sysy_node_kind_t::return_statement)
+            return node.children.size() - 1;
+        return node.children.size();
+    }
+    /**
+     * @brief Count the reductions of a node itself.
+     */
+    size_t reduction_count(const sysy_node_t& node)
+    {
+        switch (node.kind)
+        {
+        case sysy_node_kind_t::if_statement:
+            // 删除 else，或只保留一个分支。
+            return node.children.size() > 2 ? 3 : 1;
+        case sysy_node_kind_t::while_statement:
+            // 删除额外的条件，或只保留循环体。
+            return node.children.size() > 1 ? 2 : 1;
+        case sysy_node_kind_t::unary:
+        case sysy_node_kind_t::binary:
+        case sysy_node_kind_t::division:
+        case sysy_node_kind_t::call:
+            // 用一个子表达式代替。
+            return node.children.size();
+        default:
+            return deletable_count(node);
+        }
+    }
+    void apply_reduction(sysy_node_t& node, size_t index)
+    {
+        switch (node.kind)
+        {
+        case sysy_node_kind_t::if_statement:
+        {
+            if (index == 2)
+                node.children.pop_back();
+            else
+            {
+                auto branch = std::move(node.children[index + 1]);
+                node = std::move(branch);
+            }
+            return;
+        }
+        case sysy_node_kind_t::while_statement:
+        {
+            if (index == 1)
+                node.children.pop_back();
+            else
+            {
+                auto body = std::move(node.children[0]);
+                node = std::move(body);
+            }
+            return;
+        }
+        case sysy_node_kind_t::unary:
+        case sysy_node_kind_t::binary:
+        case sysy_node_kind_t::division:
+        case sysy_node_kind_t::call:
+        {
+            auto child = std::move(node.children[index]);
+            node = std::move(child);
+            return;
+        }
+        default:
+            node.children.erase(node.children.begin() + index);
+            return;
+        }
+    }
+    bool reduce(sysy_node_t& node, size_t& index)
+    {
+        auto count = reduction_count(node);
+        if (index < count)
+        {
+            apply_reduction(node, index);
+            return true;
+        }
+        index -= count;
+        for (auto& child : node.children)
+            if (reduce(child, index))
+                return true;
+        return false;
+    }
+} // namespace
+
+bool sysy_node_t::is_well_formed() const
+{
+    std::vector<std::string> names;
+    return ::is_well_formed(*this, names, false);
+}
+
+sysy_node_t compiler::generate_random_program(uint64_t seed)
+{
+    return generator_t(seed).program();
+}
+
+std::optional<sysy_node_t> compiler::reduce_random_program(
+    const sysy_node_t& program, size_t index)
+{
+    auto ret = program;
+    if (!reduce(ret, index))
+        return std::nullopt;
+    return ret;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file random_program.h
+ * @author UnnamedOrange
+ * @brief Random well-defined SysY programs for differential testing.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace compiler
+{
+    /**
+     * @brief Kind of a node of a random SysY program.
+     */
+    enum class sysy_node_kind_t
+    {
+        // 顶层。
+        program,
+        global_declaration,
+        function,
+        // 语句。
+        block,
+        declaration,
+        assignment,
+        print,
+        if_statement,
+        while_statement,
+        break_statement,
+        continue_statement,
+        return_statement,
+        // 表达式。
+        literal,
+        variable,
+        unary,
+        binary,
+        division,
+        call,
+    };
+
+    /**
+     * @brief A node of a random SysY program.
+     *
+     * Each statement and expression is well-defined by itself, so that
+     * deleting any subtree keeps the program well-defined as long as it
+     * still compiles:
+     * - A division prints its divisor as "(d % 16 + 17)", which is never 0
+     * or -1.
+     * - A loop declares and increments its own counter, which nothing else
+     * assigns, and the increment comes before the body and any continue.
+     * - Functions only call functions defined before them, and calls are
+     * only whole right-hand sides, so the order of evaluation never
+     * matters.
+     * - Only addition, subtraction, multiplication and negation overflow,
+     * and they wrap around as the target does.
+     */
+    struct sysy_node_t
+    {
+        sysy_node_kind_t kind{};
+        /**
+         * @brief Name of the variable, the loop counter or the function, the
+         * operator, or the literal.
+         */
+        std::string text{};
+        /**
+         * @brief Parameters of a function.
+         */
+        std::vector<std::string> parameters{};
+        /**
+         * @brief Number of iterations of a loop.
+         */
+        int bound{};
+        /**
+         * @brief Children in the order of the source. The body of a loop is
+         * followed by its extra condition, if any.
+         */
+        std::vector<sysy_node_t> children{};
+
+        /**
+         * @brief Print the subtree as SysY source.
+         */
+        std::string to_sysy(int indent = 0) const;
+        /**
+         * @brief Count the nodes of the subtree.
+         */
+        size_t size() const;
+        /**
+         * @brief Check whether every name is declared before it is used and
+         * every break and continue is in a loop. A reduced program may not
+         * be, and the frontend does not diagnose all such programs.
+         */
+        bool is_well_formed() const;
+    };
+
+    /**
+     * @brief Generate a random program. The same seed gives the same
+     * program.
+     * The program reads no input. It prints values with putint and putch and
+     * prints all global variables before main returns.
+     */
+    sysy_node_t generate_random_program(uint64_t seed);
+    /**
+     * @brief Make a program smaller by deleting a subtree or replacing a node
+     * with one of its children. The result may not be well-formed.
+     *
+     * @param program The program.
+     * @param index Which of the possible reductions to make, in preorder.
+     * @return std::optional<sysy_node_t> The smaller program, or
+     * std::nullopt if there are not so many possible reductions.
+     */
+    std::optional<sysy_node_t> reduce_random_program(
+        const sysy_node_t& program, size_t index);
+} // namespace compiler
@@ -0,0 +1,101 @@
+/**
+ * @file watch.cpp
+ * @author UnnamedOrange
+ * @brief Utilities for watch mode.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "watch.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+using namespace compiler;
+
+file_watcher::file_watcher(const std::filesystem::path& path)
+    : file_name(path.filename())
+{
+    auto directory = path.parent_path();
+    if (directory.empty())
+        directory = ".";
+
+    fd = ::inotify_init1(IN_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error(fmt::format("[Error] inotify_init1: {}.",
+                                             std::strerror(errno)));
+    // 编辑器可能直接写入文件，也可能写入临时文件后重命名。
+    if (::inotify_add_watch(fd, directory.c_str(),
+                            IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+    {
+        int err = errno;
+        ::close(fd);
+        throw std::runtime_error(fmt::format(
+            "[Error] Cannot watch {}: {}.", directory.string(),
+            std::strerror(err)));
+    }
+}
+file_watcher::~file_watcher()
+{
+    if (fd >= 0)
+        ::close(fd);
+}
+
+void file_watcher::wait()
+{
+    alignas(inotify_event) char buffer[4096];
+    while (true)
+    {
+        ssize_t size = ::read(fd, buffer, sizeof(buffer));
+        if (size < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(fmt::format(
+                "[Error] Cannot read inotify events: {}.",
+                std::strerror(errno)));
+        }
+        // 一次读取可能包含多个事件，只要有一个与文件相关即返回。
+        bool is_modified = false;
+        for (ssize_t offset = 0; offset < size;)
+        {
+            auto event =
+                reinterpret_cast<const inotify_event*>(buffer + offset);
+            if (event->len && file_name == event->name)
+                is_modified = true;
+            offset += sizeof(inotify_event) + event->len;
+        }
+        if (is_modified)
+            return;
+    }
+}
+
+void compiler::write_file_atomically(const std::filesystem::path& path,
+                                     std::string_view content)
+{
+    auto temp_path = path;
+    temp_path += fmt::format(".{}.tmp", ::getpid());
+    {
+        std::ofstream ofs(temp_path, std::ios::binary);
+        ofs << content;
+        if (!ofs.flush())
+            throw std::runtime_error(fmt::format(
+                "[Error] Cannot write {}.", temp_path.string()));
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(temp_path, ec);
+        throw std::runtime_error(
+            fmt::format("[Error] Cannot write {}.", path.string()));
+    }
+}
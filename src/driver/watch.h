@@ -0,0 +1,52 @@
+/**
+ * @file watch.h
+ * @author UnnamedOrange
+ * @brief Utilities for watch mode.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+
+namespace compiler
+{
+    /**
+     * @brief Watch a file for modifications using inotify.
+     * The directory of the file is watched, so that editors replacing the
+     * file by renaming are also noticed.
+     */
+    class file_watcher
+    {
+    private:
+        int fd = -1;
+        std::filesystem::path file_name;
+
+    public:
+        /**
+         * @brief Start watching a file.
+         * If inotify is not available, throw an std::runtime_error.
+         */
+        explicit file_watcher(const std::filesystem::path& path);
+        ~file_watcher();
+        file_watcher(const file_watcher&) = delete;
+        file_watcher& operator=(const file_watcher&) = delete;
+
+    public:
+        /**
+         * @brief Block until the file is written or replaced.
+         */
+        void wait();
+    };
+
+    /**
+     * @brief Write a file by renaming a temporary file, so that readers never
+     * see a partially written file.
+     * If failed, throw an std::runtime_error.
+     */
+    void write_file_atomically(const std::filesystem::path& path,
+                               std::string_view content);
+} // namespace compiler
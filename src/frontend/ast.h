@@ -9,26 +9,34 @@
 
 #pragma once
 
+#include <array>
 #include <cassert>
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <optional>
+#include <stdexcept>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include <fmt/core.h>
 
 #include "symbol_table.h"
+#include <ir/koopa_program.h>
+#include <job_budget.hpp>
 
 namespace compiler::ast
 {
-    inline int global_result_id;
+    // 前端的状态属于线程，多个编译单元可以在不同线程中同时编译。
+    inline thread_local int global_result_id;
     inline int new_result_id() { return ++global_result_id; }
-    inline int global_sequential_id;
+    inline thread_local int global_sequential_id;
     inline std::string new_sequential_id()
     {
         return fmt::format("seq_{}", ++global_sequential_id);
     }
-    inline int global_if_id;
+    inline thread_local int global_if_id;
     inline std::string new_if_id()
     {
         return fmt::format("if_{}", ++global_if_id);
@@ -37,7 +45,7 @@ namespace compiler::ast
     {
         return fmt::format("else_{}", global_if_id);
     }
-    inline int global_land_id;
+    inline thread_local int global_land_id;
     inline std::string new_land_id()
     {
         return fmt::format("land_{}", ++global_land_id);
@@ -46,7 +54,7 @@ namespace compiler::ast
     {
         return fmt::format("land_sc_{}", global_land_id);
     }
-    inline int global_lor_id;
+    inline thread_local int global_lor_id;
     inline std::string new_lor_id()
     {
         return fmt::format("lor_{}", ++global_lor_id);
@@ -55,7 +63,7 @@ namespace compiler::ast
     {
         return fmt::format("lor_sc_{}", global_lor_id);
     }
-    inline int global_while_id;
+    inline thread_local int global_while_id;
     inline std::string new_while_id()
     {
         return fmt::format("while_{}", ++global_while_id);
@@ -64,7 +72,83 @@ namespace compiler::ast
     {
         return fmt::format("while_body_{}", global_while_id);
     }
-    inline symbol_table_t st;
+    inline thread_local symbol_table_t st;
+    /**
+     * @brief Wrap a constant around to 32 bits, as the target does when the
+     * result of an addition, a subtraction or a multiplication overflows.
+     */
+    inline int wrap_around(int64_t value)
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(value));
+    }
+    /**
+     * @brief Whether to emit "//@line N" markers before the IR of each
+     * statement, so that the backend can map instructions to source lines.
+     */
+    inline thread_local bool emits_line_markers;
+    /**
+     * @brief Get the marker of a source line, or an empty string if markers
+     * are not emitted or the line is unknown.
+     */
+    inline std::string line_marker(int line)
+    {
+        if (!emits_line_markers || !line)
+            return "";
+        return fmt::format("    {}{}\n", ir::line_marker_prefix, line);
+    }
+    /**
+     * @brief Functions already declared or defined in the IR, including the
+     * library functions.
+     */
+    inline thread_local std::unordered_set<std::string> declared_functions;
+    /**
+     * @brief Declarations of external functions by name, e.g.
+     * "decl @f(i32): i32".
+     */
+    inline thread_local std::map<std::string, std::string>
+        external_function_declarations;
+    /**
+     * @brief Get the declarations of external functions that are not defined
+     * in this program. Put them before the functions.
+     */
+    inline std::string external_declarations_to_koopa()
+    {
+        std::string ret;
+        for (const auto& [name, declaration] : external_function_declarations)
+            if (!declared_functions.count(name))
+                ret += declaration;
+        if (!ret.empty())
+            ret += "\n";
+        return ret;
+    }
+    /**
+     * @brief Restart numbering of values and labels.
+     * Names in Koopa IR functions are local, so each function restarts them
+     * and its IR does not change when other functions change.
+     */
+    inline void reset_function_ids()
+    {
+        global_result_id = 0;
+        global_sequential_id = 0;
+        global_if_id = 0;
+        global_land_id = 0;
+        global_lor_id = 0;
+        global_while_id = 0;
+    }
+    /**
+     * @brief Reset all states of the frontend.
+     * Call this before compiling another program.
+     *
+     * @param emits_line_markers See `emits_line_markers`.
+     */
+    inline void reset(bool emits_line_markers = false)
+    {
+        reset_function_ids();
+        st = symbol_table_t();
+        ast::emits_line_markers = emits_line_markers;
+        declared_functions.clear();
+        external_function_declarations.clear();
+    }
 
     class ast_base_t;
     /**
@@ -81,6 +165,11 @@ namespace compiler::ast
         mutable int result_id{};
 
     public:
+        /**
+         * @brief Source line of the node. 0 if unknown.
+         * Set for functions, block items and loops.
+         */
+        int line{};
         mutable std::string break_target;
         mutable std::string continue_target;
         void push_down(const ast_t& down) const
@@ -130,6 +219,19 @@ namespace compiler::ast
 
     public:
         std::string to_koopa() const override
+        {
+            std::string ret = library_to_koopa();
+            // 外部函数在所有条目转换后才知道是否在本程序中定义。
+            std::string items;
+            for (const auto& item : declaration_or_function_items)
+                items += item->to_koopa();
+            return ret + external_declarations_to_koopa() + items;
+        }
+        /**
+         * @brief Add library functions to the symbol table and get their
+         * declarations. Called before the items are converted.
+         */
+        static std::string library_to_koopa()
         {
             std::string ret;
 
@@ -149,6 +251,7 @@ namespace compiler::ast
                 {
                     const auto& symbol = lib_functions[i];
                     st.insert(symbol.internal_name, symbol);
+                    declared_functions.insert(symbol.internal_name);
                 }
             }
 
@@ -163,9 +266,6 @@ decl @starttime()
 decl @stoptime()
 
 )";
-
-            for (const auto& item : declaration_or_function_items)
-                ret += item->to_koopa();
             return ret;
         }
     };
@@ -204,6 +304,24 @@ decl @stoptime()
         std::string to_koopa() const override;
     };
 
+    /**
+     * @brief AST of an external declaration, whose definition is in another
+     * compilation unit.
+     * ExternDecl ::= "extern" BType IDENT ";";
+     * ExternDecl ::= "extern" FuncType IDENT "(" [FuncFParams] ")" ";";
+     */
+    class ast_external_declaration_t : public ast_base_t
+    {
+    public:
+        ast_t type;
+        std::string raw_name;
+        bool is_function{};
+        std::vector<ast_t> parameters;
+
+    public:
+        std::string to_koopa() const override;
+    };
+
     /**
      * @brief AST of a parameter list.
      * FuncFParamList ::= FuncFParam;
@@ -249,6 +367,7 @@ decl @stoptime()
             for (const auto& item : block_items)
             {
                 push_down(item);
+                ret += line_marker(item->line);
                 ret += item->to_koopa();
             }
             st.pop();
@@ -282,6 +401,8 @@ decl @stoptime()
     public:
         std::string to_koopa() const override
         {
+            // 每条语句或声明是一个取消检查点。
+            check_job_budget();
             push_down(item);
             return item->to_koopa();
         }
@@ -461,6 +582,8 @@ decl @stoptime()
             ret += fmt::format("%{}:\n", while_body_id);
             {
                 ret += while_branch->to_koopa();
+                // 回到循环开头的跳转属于 while 所在的行。
+                ret += line_marker(line);
                 ret += fmt::format("    jump %{}\n", while_id);
             }
 
@@ -631,7 +754,7 @@ decl @stoptime()
             else if (op == "+")
                 return (*rvalue);
             else if (op == "-")
-                return -(*rvalue);
+                return wrap_around(-int64_t(*rvalue));
             else if (op == "!")
                 return !(*rvalue);
 
@@ -790,7 +913,10 @@ decl @stoptime()
                 return std::nullopt;
 
             else if (op == "*")
-                return (*rvalue_1) * (*rvalue_2);
+                return wrap_around(int64_t(*rvalue_1) * (*rvalue_2));
+            // 除数为 0 或结果溢出时未定义，不在编译时计算。
+            else if (!*rvalue_2 || (*rvalue_1 == INT32_MIN && *rvalue_2 == -1))
+                return std::nullopt;
             else if (op == "/")
                 return (*rvalue_1) / (*rvalue_2);
             else if (op == "%")
@@ -887,9 +1013,9 @@ decl @stoptime()
                 return std::nullopt;
 
             else if (op == "+")
-                return (*rvalue_1) + (*rvalue_2);
+                return wrap_around(int64_t(*rvalue_1) + (*rvalue_2));
             else if (op == "-")
-                return (*rvalue_1) - (*rvalue_2);
+                return wrap_around(int64_t(*rvalue_1) - (*rvalue_2));
 
             return std::nullopt;
         }
@@ -1718,8 +1844,11 @@ decl @stoptime()
             symbol_function_t symbol;
             symbol.has_return_value = !function_type->to_koopa().empty();
             st.insert(function_name, symbol);
+            declared_functions.insert(function_name);
         }
 
+        reset_function_ids();
+        st.clear_local_names();
         st.push();
 
         std::string parameter_string;
@@ -1743,6 +1872,7 @@ decl @stoptime()
                            parameter_string, return_type_string);
 
         ret += fmt::format("%{}_entry:\n", function_name);
+        ret += line_marker(line);
         for (size_t i = 0; i < parameters.size(); i++)
         {
             auto param =
@@ -1768,6 +1898,41 @@ decl @stoptime()
         return ret;
     }
 
+    inline std::string ast_external_declaration_t::to_koopa() const
+    {
+        auto type_string = type->to_koopa();
+        if (!is_function)
+        {
+            if (type_string.empty())
+                throw std::runtime_error(fmt::format(
+                    "[Error] Variable {} cannot be void.", raw_name));
+            // 名字与定义所在的编译单元中的全局变量相同。
+            symbol_variable_t symbol;
+            symbol.is_external = true;
+            st.insert(raw_name, std::move(symbol));
+            return "";
+        }
+
+        symbol_function_t symbol;
+        symbol.has_return_value = !type_string.empty();
+        st.insert(raw_name, symbol);
+        std::string parameter_string;
+        for (const auto& parameter : parameters)
+        {
+            auto param = std::dynamic_pointer_cast<ast_parameter_t>(parameter);
+            if (!parameter_string.empty())
+                parameter_string += ", ";
+            parameter_string += param->type->to_koopa();
+        }
+        if (!type_string.empty())
+            type_string = fmt::format(": {}", type_string);
+        external_function_declarations.emplace(
+            raw_name,
+            fmt::format("decl @{}({}){}\n", raw_name, parameter_string,
+                        type_string));
+        return "";
+    }
+
     inline std::string ast_statement_2_t::to_koopa() const
     {
         std::string ret;
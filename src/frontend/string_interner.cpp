@@ -0,0 +1,184 @@
+/**
+ * @file string_interner.cpp
+ * @author UnnamedOrange
+ * @brief Process-wide concurrent string interner.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "string_interner.h"
+
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+
+using namespace compiler;
+
+string_interner::string_interner()
+    : buckets(new std::atomic<const entry_t*>[bucket_count])
+{
+    for (size_t i = 0; i < bucket_count; i++)
+        buckets[i].store(nullptr, std::memory_order_relaxed);
+}
+string_interner::~string_interner()
+{
+    for (auto list : {current_chunk.load(), large_chunks.load()})
+    {
+        while (list)
+        {
+            auto next = list->next;
+            list->~chunk_t();
+            ::operator delete(list);
+            list = next;
+        }
+    }
+    for (auto& segment : segments)
+        delete[] segment.load();
+}
+
+string_interner& string_interner::global()
+{
+    // 进程结束前一直存在，编译之间共享。
+    static string_interner instance;
+    return instance;
+}
+
+string_id_t string_interner::intern(std::string_view s)
+{
+    if (s.size() > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error("[Error] Identifier is too long.");
+    auto hash = hash_of(s);
+    auto& bucket = buckets[hash & (bucket_count - 1)];
+    auto head = bucket.load(std::memory_order_acquire);
+    if (auto found = find_in(head, nullptr, hash, s))
+        return found->id;
+
+    // 先分配 ID 并登记条目，再把条目插入桶中。
+    // 其他线程通过桶得到 ID 时，条目已经可以通过 ID 找到。
+    auto id = next_id.fetch_add(1, std::memory_order_relaxed);
+    if (id == std::numeric_limits<string_id_t>::max())
+        throw std::runtime_error("[Error] Too many interned strings.");
+    auto memory = static_cast<char*>(allocate(sizeof(entry_t) + s.size()));
+    auto entry = new (memory) entry_t{head, hash, id,
+                                      static_cast<uint32_t>(s.size())};
+    std::memcpy(memory + sizeof(entry_t), s.data(), s.size());
+    slot_of(id).store(entry, std::memory_order_release);
+
+    while (!bucket.compare_exchange_weak(entry->next, entry,
+                                         std::memory_order_release,
+                                         std::memory_order_acquire))
+    {
+        // 只需检查其他线程新插入的部分。
+        // 若相同的字符串已被插入，放弃本条目，其 ID 仍指向相同的字符串。
+        if (auto found = find_in(entry->next, head, hash, s))
+            return found->id;
+        head = entry->next;
+    }
+    return id;
+}
+std::optional<string_id_t> string_interner::find(std::string_view s) const
+{
+    auto hash = hash_of(s);
+    auto head = buckets[hash & (bucket_count - 1)].load(
+        std::memory_order_acquire);
+    if (auto found = find_in(head, nullptr, hash, s))
+        return found->id;
+    return std::nullopt;
+}
+std::string_view string_interner::str(string_id_t id) const
+{
+    size_t k = size_t(id) + first_segment_size;
+    size_t segment = std::bit_width(k) - std::bit_width(first_segment_size);
+    auto slots = segments[segment].load(std::memory_order_acquire);
+    if (!slots || id >= size())
+        throw std::runtime_error("[Error] Invalid string ID.");
+    auto entry = slots[k - (first_segment_size << segment)].load(
+        std::memory_order_acquire);
+    if (!entry)
+        throw std::runtime_error("[Error] Invalid string ID.");
+    return entry->view();
+}
+
+uint64_t string_interner::hash_of(std::string_view s)
+{
+    // FNV-1a。
+    uint64_t ret = 14695981039346656037ull;
+    for (unsigned char c : s)
+        ret = (ret ^ c) * 1099511628211ull;
+    return ret;
+}
+const string_interner::entry_t* string_interner::find_in(
+    const entry_t* head, const entry_t* stop, uint64_t hash,
+    std::string_view s)
+{
+    for (auto entry = head; entry != stop; entry = entry->next)
+        if (entry->hash == hash && entry->view() == s)
+            return entry;
+    return nullptr;
+}
+void* string_interner::allocate(size_t size)
+{
+    size = (size + alignof(entry_t) - 1) / alignof(entry_t) * alignof(entry_t);
+    auto new_chunk = [](size_t capacity, chunk_t* next) {
+        auto memory = ::operator new(sizeof(chunk_t) + capacity);
+        return new (memory) chunk_t{next, capacity, {}};
+    };
+
+    // 较大的字符串单独占用一块。
+    if (size > chunk_size / 4)
+    {
+        auto chunk = new_chunk(size, large_chunks.load());
+        while (!large_chunks.compare_exchange_weak(chunk->next, chunk))
+            ;
+        arena_bytes.fetch_add(size, std::memory_order_relaxed);
+        return chunk->data();
+    }
+
+    auto chunk = current_chunk.load(std::memory_order_acquire);
+    while (true)
+    {
+        if (chunk)
+        {
+            auto used = chunk->used.fetch_add(size, std::memory_order_relaxed);
+            if (used + size <= chunk->capacity)
+                return chunk->data() + used;
+        }
+        // 当前块已满，换上新块。其他线程先换上时使用它的块。
+        auto replacement = new_chunk(chunk_size, chunk);
+        replacement->used.store(size, std::memory_order_relaxed);
+        if (current_chunk.compare_exchange_strong(chunk, replacement,
+                                                  std::memory_order_acq_rel,
+                                                  std::memory_order_acquire))
+        {
+            arena_bytes.fetch_add(chunk_size, std::memory_order_relaxed);
+            return replacement->data();
+        }
+        replacement->~chunk_t();
+        ::operator delete(replacement);
+    }
+}
+std::atomic<const string_interner::entry_t*>& string_interner::slot_of(
+    string_id_t id)
+{
+    size_t k = size_t(id) + first_segment_size;
+    size_t segment = std::bit_width(k) - std::bit_width(first_segment_size);
+    auto slots = segments[segment].load(std::memory_order_acquire);
+    if (!slots)
+    {
+        // 多个线程同时分配同一段时，只保留最先完成的。
+        size_t count = first_segment_size << segment;
+        auto allocated = new std::atomic<const entry_t*>[count];
+        for (size_t i = 0; i < count; i++)
+            allocated[i].store(nullptr, std::memory_order_relaxed);
+        if (segments[segment].compare_exchange_strong(
+                slots, allocated, std::memory_order_acq_rel,
+                std::memory_order_acquire))
+            slots = allocated;
+        else
+            delete[] allocated;
+    }
+    return slots[k - (first_segment_size << segment)];
+}
@@ -0,0 +1,134 @@
+/**
+ * @file string_interner.h
+ * @author UnnamedOrange
+ * @brief Process-wide concurrent string interner.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+namespace compiler
+{
+    /**
+     * @brief ID of an interned string. Equal strings have equal IDs.
+     */
+    using string_id_t = uint32_t;
+
+    /**
+     * @brief Append-only string interner that can be used from many threads
+     * at the same time without locks.
+     *
+     * Strings are copied into an arena and never freed until the interner is
+     * destroyed, so views returned by `str` stay valid. Lookup and insertion
+     * only use atomic loads and compare-and-swap.
+     */
+    class string_interner
+    {
+    private:
+        struct entry_t
+        {
+            const entry_t* next;
+            uint64_t hash;
+            string_id_t id;
+            uint32_t size;
+            // 字符串紧跟在条目之后。
+            const char* data() const
+            {
+                return reinterpret_cast<const char*>(this + 1);
+            }
+            std::string_view view() const { return {data(), size}; }
+        };
+        struct chunk_t
+        {
+            chunk_t* next;
+            size_t capacity;
+            std::atomic<size_t> used;
+            // 数据紧跟在块之后。
+            char* data() { return reinterpret_cast<char*>(this + 1); }
+        };
+
+    private:
+        static constexpr size_t bucket_count = size_t(1) << 16;
+        static constexpr size_t chunk_size = size_t(1) << 16;
+        // 第 k 段有 first_segment_size << k 个 ID。
+        static constexpr size_t first_segment_size = 32;
+        static constexpr size_t segment_count = 27;
+
+        // 每个桶是一个只在头部插入的链表。
+        std::unique_ptr<std::atomic<const entry_t*>[]> buckets;
+        // 由 ID 找到条目。段按需分配，分配后不再移动。
+        std::array<std::atomic<std::atomic<const entry_t*>*>, segment_count>
+            segments{};
+        std::atomic<string_id_t> next_id{};
+        // 当前分配的块。所有块通过 next 串起来，以便析构时释放。
+        std::atomic<chunk_t*> current_chunk{};
+        std::atomic<chunk_t*> large_chunks{};
+        std::atomic<size_t> arena_bytes{};
+
+    public:
+        string_interner();
+        ~string_interner();
+        string_interner(const string_interner&) = delete;
+        string_interner& operator=(const string_interner&) = delete;
+
+    public:
+        /**
+         * @brief Get the interner shared by the whole process.
+         */
+        static string_interner& global();
+
+    public:
+        /**
+         * @brief Get the ID of a string, adding it if it is new.
+         */
+        string_id_t intern(std::string_view s);
+        /**
+         * @brief Get the ID of a string if it has been added.
+         */
+        std::optional<string_id_t> find(std::string_view s) const;
+        /**
+         * @brief Get the string of an ID returned by `intern`.
+         */
+        std::string_view str(string_id_t id) const;
+        /**
+         * @brief Number of IDs given out so far.
+         * An ID may be given out without being kept when two threads add the
+         * same string at the same time, so this can exceed the number of
+         * distinct strings.
+         */
+        size_t size() const { return next_id.load(std::memory_order_relaxed); }
+        /**
+         * @brief Bytes of arena allocated for the strings.
+         */
+        size_t arena_size() const
+        {
+            return arena_bytes.load(std::memory_order_relaxed);
+        }
+
+    private:
+        static uint64_t hash_of(std::string_view s);
+        static const entry_t* find_in(const entry_t* head,
+                                      const entry_t* stop, uint64_t hash,
+                                      std::string_view s);
+        void* allocate(size_t size);
+        std::atomic<const entry_t*>& slot_of(string_id_t id);
+    };
+
+    /**
+     * @brief Intern a string in the process-wide interner.
+     */
+    inline string_id_t intern(std::string_view s)
+    {
+        return string_interner::global().intern(s);
+    }
+} // namespace compiler
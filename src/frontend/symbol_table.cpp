@@ -20,9 +20,11 @@ symbol_table_t::symbol_table_t() : table_stack(1) {}
 
 void symbol_table_t::push() { table_stack.emplace_back(); }
 void symbol_table_t::pop() { table_stack.pop_back(); }
+void symbol_table_t::clear_local_names() { local_use_count.clear(); }
 
 void symbol_table_t::insert(const std::string& raw_name, symbol_t symbol)
 {
+    auto id = intern(raw_name);
     std::visit(
         [&](auto& symbol) {
             using T = std::decay_t<decltype(symbol)>;
@@ -32,35 +34,63 @@ void symbol_table_t::insert(const std::string& raw_name, symbol_t symbol)
             }
             else
             {
-                auto original_internal_name =
-                    fmt::format("{}_{}", raw_name, table_stack.size());
-                symbol.internal_name =
-                    fmt::format("{}_{}", original_internal_name,
-                                ++use_count[original_internal_name]);
+                bool is_external = false;
+                if constexpr (std::is_same_v<T, symbol_variable_t>)
+                    is_external = symbol.is_external;
+                // 外部变量的声明与定义使用相同的名字。
+                auto previous = find_variable(id);
+                if (previous && (previous->is_external || is_external))
+                {
+                    symbol.internal_name = previous->internal_name;
+                    return;
+                }
+                auto& count =
+                    table_stack.size() == 1 ? use_count : local_use_count;
+                auto key = uint64_t(id) << 32 | table_stack.size();
+                symbol.internal_name = fmt::format(
+                    "{}_{}_{}", raw_name, table_stack.size(), ++count[key]);
             }
         },
         symbol);
-    table_stack.back()[raw_name] = symbol;
+    table_stack.back()[id] = symbol;
+}
+const symbol_variable_t* symbol_table_t::find_variable(string_id_t id) const
+{
+    const auto& table = table_stack.back();
+    auto it = table.find(id);
+    if (it == table.end())
+        return nullptr;
+    return std::get_if<symbol_variable_t>(&it->second);
 }
 size_t symbol_table_t::count(const std::string& raw_name) const
 {
+    // 从未驻留的名字一定不在表中。
+    auto id = string_interner::global().find(raw_name);
+    if (!id)
+        return 0;
     size_t ret{};
     for (const auto& table : table_stack)
-        ret += table.count(raw_name);
+        ret += table.count(*id);
     return ret;
 }
 std::optional<symbol_t> symbol_table_t::at(const std::string& raw_name) const
 {
+    auto id = string_interner::global().find(raw_name);
+    if (!id)
+        return std::nullopt;
     for (auto it = table_stack.crbegin(); it != table_stack.crend(); it++)
-        if ((*it).count(raw_name))
-            return (*it).at(raw_name);
+        if (auto found = it->find(*id); found != it->end())
+            return found->second;
     return std::nullopt;
 }
 bool symbol_table_t::is_global(const std::string& raw_name) const
 {
+    auto id = string_interner::global().find(raw_name);
+    if (!id)
+        return false;
     for (size_t i = table_stack.size() - 1; ~i; i--)
     {
-        if (table_stack[i].count(raw_name))
+        if (table_stack[i].count(*id))
         {
             if (i)
                 return false;
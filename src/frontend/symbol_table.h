@@ -9,12 +9,15 @@
 
 #pragma once
 
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <unordered_map>
 #include <variant>
 #include <vector>
 
+#include "string_interner.h"
+
 namespace compiler
 {
     struct symbol_base_t
@@ -29,7 +32,11 @@ namespace compiler
 
     struct symbol_variable_t : public symbol_base_t
     {
-        // TODO: Design member variables.
+        /**
+         * @brief Declared with "extern" and defined in another compilation
+         * unit. A later definition in the same scope keeps the name.
+         */
+        bool is_external{};
     };
 
     struct symbol_function_t : public symbol_base_t
@@ -42,15 +49,20 @@ namespace compiler
 
     /**
      * @brief Symbol table for frontend.
+     * Raw names are interned in the process-wide interner and the tables are
+     * keyed by their IDs.
      */
     class symbol_table_t
     {
     public:
-        using table_t = std::unordered_map<std::string, symbol_t>;
+        using table_t = std::unordered_map<string_id_t, symbol_t>;
 
     private:
         std::vector<table_t> table_stack;
-        std::unordered_map<std::string, size_t> use_count;
+        // 键为原始名字的 ID 和所在的层数。
+        std::unordered_map<uint64_t, size_t> use_count;
+        // 局部符号的使用次数。局部符号的名字只需在函数内唯一。
+        std::unordered_map<uint64_t, size_t> local_use_count;
 
     public:
         symbol_table_t();
@@ -64,6 +76,12 @@ namespace compiler
          * @brief Pop a table from the table stack.
          */
         void pop();
+        /**
+         * @brief Restart numbering of local symbols.
+         * Call this when starting to handle a function, so that names in
+         * the function do not depend on other functions.
+         */
+        void clear_local_names();
 
     public:
         /**
@@ -83,5 +101,8 @@ namespace compiler
          * If the symbol does not exist, returns false.
          */
         bool is_global(const std::string& raw_name) const;
+
+    private:
+        const symbol_variable_t* find_variable(string_id_t id) const;
     };
 } // namespace compiler
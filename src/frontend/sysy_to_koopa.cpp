@@ -9,13 +9,25 @@
 
 #include "sysy_to_koopa.h"
 
-#include <cstdlib>
-#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <iterator>
 #include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
 
 #include <fmt/core.h>
 
 #include "ast.h"
+#include "top_level_scanner.h"
+#include <ir/koopa_program.h>
+#include <job_budget.hpp>
 #include <parser/yy_interface.h>
 #include <utility.hpp>
 
@@ -23,35 +35,219 @@ using namespace compiler;
 
 std::string sysy_to_koopa::compile(const std::filesystem::path& input_file_path)
 {
-    using namespace ast;
+    if (prunes_unreachable_functions || parse_jobs > 1)
+    {
+        // 需要先扫描整个源文件，才能知道哪些函数会被调用，以及如何划分。
+        std::ifstream ifs(input_file_path, std::ios::binary);
+        if (!ifs)
+            throw std::runtime_error(fmt::format("[Error] Cannot open {}.",
+                                                 input_file_path.string()));
+        return file_marker(input_file_path) +
+               compile_source(
+                   std::string((std::istreambuf_iterator<char>(ifs)),
+                               std::istreambuf_iterator<char>()));
+    }
+
     c_file input_file;
-    ast_t ast;
 
-    // Open the input file and assign it to yyin.
+    // Open the input file.
+    try
     {
-        try
-        {
-            input_file = c_file::open(input_file_path, "r");
-        }
-        catch (const std::exception& e)
+        input_file = c_file::open(input_file_path, "r");
+    }
+    catch (const std::exception& e)
+    {
+        throw std::runtime_error(fmt::format("[Error] Cannot open {}: {}",
+                                             input_file_path.string(),
+                                             e.what()));
+    }
+
+    return file_marker(input_file_path) + compile(input_file);
+}
+std::string sysy_to_koopa::compile_source(const std::string& source)
+{
+    // 不可达的函数被替换为空白，语法分析和生成 IR 时直接跳过。
+    // 流直接读取字符串的缓冲区，字符串须在编译期间保持有效。
+    std::string pruned_source;
+    if (prunes_unreachable_functions)
+        pruned_source = prune_unreachable_functions(source);
+    const auto& text = prunes_unreachable_functions ? pruned_source : source;
+
+    if (parse_jobs > 1)
+    {
+        auto ast = parse_in_parallel(text);
+        ast::reset(emits_line_markers);
+        return ast->to_koopa();
+    }
+    return compile(open_source(text));
+}
+std::string sysy_to_koopa::compile_stream(int input_fd)
+{
+    ast::reset(emits_line_markers);
+    std::string ret = file_marker("<stdin>");
+    ret += ast::ast_program_t::library_to_koopa();
+    // 外部函数的声明在最后插入到库函数的声明之后。
+    size_t declarations_end = ret.size();
+    top_level_scanner splitter;
+    // 每个条目单独分析，行号从条目开始处在整个输入中的行号开始计数。
+    size_t counted_end = 0;
+    int line = 1;
+    auto convert = [&](size_t begin, size_t end) {
+        std::string_view all = splitter.source();
+        line += static_cast<int>(std::count(
+            all.begin() + counted_end, all.begin() + begin, '\n'));
+        counted_end = begin;
+        auto program = std::dynamic_pointer_cast<ast::ast_program_t>(
+            parse(open_source(all.substr(begin, end - begin)), line));
+        for (const auto& item : program->declaration_or_function_items)
+            ret += item->to_koopa();
+    };
+
+    std::string buffer(1 << 16, '\0');
+    size_t converted_end = 0;
+    while (true)
+    {
+        ssize_t size = ::read(input_fd, buffer.data(), buffer.size());
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size < 0)
+            throw std::runtime_error(fmt::format(
+                "[Error] Cannot read input: {}.", std::strerror(errno)));
+        if (!size)
+            break;
+        splitter.feed(std::string_view(buffer.data(), size));
+
+        // 完整的条目立即分析并生成 IR，与后续输入的到达重叠。
+        // 符号按源码顺序加入符号表，与整体分析的结果相同。
+        while (auto item = splitter.next())
         {
-            std::cerr << e.what() << std::endl;
-            std::exit(1);
+            convert(item->begin, item->end);
+            converted_end = item->end;
         }
-        yyin = input_file;
     }
 
+    // 剩余部分不是完整的条目，交给语法分析报告错误。
+    if (!splitter.is_idle())
+        convert(converted_end, splitter.source().size());
+    ret.insert(declarations_end, ast::external_declarations_to_koopa());
+    return ret;
+}
+std::string sysy_to_koopa::compile(FILE* input_file)
+{
+    // 前端使用全局状态，编译前重置，以便在同一进程中多次编译。
+    ast::reset(emits_line_markers);
+    return parse(input_file)->to_koopa();
+}
+
+std::string sysy_to_koopa::file_marker(
+    const std::filesystem::path& path) const
+{
+    if (!emits_line_markers)
+        return "";
+    return fmt::format("{}{}\n", ir::file_marker_prefix, path.string());
+}
+c_file sysy_to_koopa::open_source(std::string_view source)
+{
+    try
+    {
+        return c_file::open_string(source);
+    }
+    catch (const std::exception& e)
+    {
+        throw std::runtime_error(
+            fmt::format("[Error] Cannot read source: {}", e.what()));
+    }
+}
+ast::ast_t sysy_to_koopa::parse(FILE* input_file, int first_line)
+{
+    // 每次分析使用独立的词法分析器，因此可以在多个线程中同时进行。
+    yyscan_t scanner;
+    if (yylex_init(&scanner))
+        throw std::runtime_error("[Error] Cannot create the lexer.");
+    yyset_in(input_file, scanner);
+    yyset_lineno(first_line, scanner);
+
     // Parse the input file to get AST.
+    // 超出预算时词法分析器抛出异常，此时也要释放词法分析器。
+    ast::ast_t ast;
+    int result;
+    try
     {
-        int result = yyparse(ast);
-        if (result)
+        result = yyparse(scanner, ast);
+    }
+    catch (...)
+    {
+        yylex_destroy(scanner);
+        throw;
+    }
+    yylex_destroy(scanner);
+    if (result)
+        throw std::runtime_error(
+            fmt::format("[Error] YACC failed with error code {}.", result));
+    return ast;
+}
+ast::ast_t sysy_to_koopa::parse_in_parallel(const std::string& source) const
+{
+    // 在顶层条目之间把源码划分为大小相近的若干段。
+    // 条目之间只有空白和注释，每段都是完整的程序。
+    top_level_scanner splitter;
+    splitter.feed(source);
+    std::vector<size_t> item_ends;
+    while (auto item = splitter.next())
+        item_ends.push_back(item->end);
+    size_t job_count = std::min(parse_jobs, item_ends.size());
+    if (!splitter.is_idle() || job_count < 2)
+        return parse(open_source(source));
+
+    // 每段记录其第一行在整个源码中的行号。
+    std::vector<std::pair<std::string_view, int>> chunks;
+    size_t chunk_size = source.size() / job_count;
+    size_t begin = 0;
+    int line = 1;
+    for (size_t i = 0; i < item_ends.size(); i++)
+    {
+        bool is_last = i + 1 == item_ends.size();
+        if (!is_last && item_ends[i] - begin < chunk_size)
+            continue;
+        size_t end = is_last ? source.size() : item_ends[i];
+        auto chunk = std::string_view(source).substr(begin, end - begin);
+        chunks.emplace_back(chunk, line);
+        line += static_cast<int>(std::count(chunk.begin(), chunk.end(), '\n'));
+        begin = end;
+    }
+
+    // 各段与调用者共享时间和内存预算。
+    std::vector<std::future<ast::ast_t>> futures;
+    for (auto [chunk, first_line] : chunks)
+        futures.push_back(std::async(
+            std::launch::async,
+            [chunk, first_line, budget = current_job_budget] {
+                shared_job_budget_scope scope(budget);
+                return parse(open_source(chunk), first_line);
+            }));
+
+    // 按源码顺序拼接各段的条目。全局符号在生成 IR 时按此顺序依次解析，
+    // 因此结果与整体分析相同，且与各段完成的先后无关。
+    auto program = std::make_shared<ast::ast_program_t>();
+    std::exception_ptr error;
+    for (auto& future : futures)
+    {
+        try
         {
-            std::cerr << fmt::format("[Error] YACC failed with error code {}.",
-                                     result)
-                      << std::endl;
-            std::exit(result);
+            auto part =
+                std::dynamic_pointer_cast<ast::ast_program_t>(future.get());
+            for (auto& item : part->declaration_or_function_items)
+                program->declaration_or_function_items.push_back(
+                    std::move(item));
+        }
+        catch (...)
+        {
+            // 等待所有段结束后报告第一个错误。
+            if (!error)
+                error = std::current_exception();
         }
     }
-
-    return ast->to_koopa();
+    if (error)
+        std::rethrow_exception(error);
+    return program;
 }
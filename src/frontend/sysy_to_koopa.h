@@ -9,23 +9,91 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdio>
 #include <filesystem>
+#include <memory>
 #include <string>
+#include <string_view>
+
+#include <utility.hpp>
 
 namespace compiler
 {
+    namespace ast
+    {
+        class ast_base_t;
+        using ast_t = std::shared_ptr<ast_base_t>;
+    } // namespace ast
+
     /**
      * @brief Compile SysY to Koopa IR.
      */
     class sysy_to_koopa
     {
+    private:
+        bool prunes_unreachable_functions{};
+        size_t parse_jobs{};
+        bool emits_line_markers{};
+
+    public:
+        /**
+         * @brief Create the compiler.
+         *
+         * @param prunes_unreachable_functions Skip parsing and generating
+         * functions that main cannot call, directly or indirectly.
+         * @param parse_jobs Number of threads parsing the source. The source
+         * is split between top-level declarations and functions, and the
+         * parts are merged in source order.
+         * @param emits_line_markers Put "//@file PATH" at the beginning of
+         * the IR and "//@line N" before the IR of each statement, so that
+         * the backend can emit line information.
+         */
+        explicit sysy_to_koopa(bool prunes_unreachable_functions = false,
+                               size_t parse_jobs = 1,
+                               bool emits_line_markers = false)
+            : prunes_unreachable_functions(prunes_unreachable_functions),
+              parse_jobs(parse_jobs), emits_line_markers(emits_line_markers)
+        {
+        }
+
     public:
         /**
          * @brief Compile SysY to Koopa IR.
          *
+         * If the file cannot be read or parsed, throw an std::runtime_error.
+         * Can be called multiple times in one process.
+         *
          * @param input_file_path SysY source file path.
          * @return std::string Koopa IR in string.
          */
         std::string compile(const std::filesystem::path& input_file_path);
+        /**
+         * @brief Compile SysY source code in memory to Koopa IR.
+         * If the source cannot be parsed, throw an std::runtime_error.
+         *
+         * @param source SysY source code.
+         * @return std::string Koopa IR in string.
+         */
+        std::string compile_source(const std::string& source);
+        /**
+         * @brief Compile SysY source read from a file descriptor, e.g. a pipe
+         * or a socket, until the end of input.
+         * Each top-level declaration or function is parsed and converted as
+         * soon as it has arrived, while the rest is still being read.
+         * Unreachable functions are not pruned and parsing is not parallel.
+         * If the input cannot be read or parsed, throw an std::runtime_error.
+         *
+         * @param input_fd File descriptor to read from.
+         * @return std::string Koopa IR in string.
+         */
+        std::string compile_stream(int input_fd);
+
+    private:
+        std::string compile(FILE* input_file);
+        std::string file_marker(const std::filesystem::path& path) const;
+        static c_file open_source(std::string_view source);
+        static ast::ast_t parse(FILE* input_file, int first_line = 1);
+        ast::ast_t parse_in_parallel(const std::string& source) const;
     };
 } // namespace compiler
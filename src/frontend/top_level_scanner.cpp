@@ -0,0 +1,220 @@
+/**
+ * @file top_level_scanner.cpp
+ * @author UnnamedOrange
+ * @brief Split SysY source into top-level items without parsing.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "top_level_scanner.h"
+
+#include <cctype>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace compiler;
+
+void top_level_scanner::feed(std::string_view chunk)
+{
+    text += chunk;
+    for (; position < text.size(); position++)
+        scan(position);
+}
+std::optional<top_level_item_t> top_level_scanner::next()
+{
+    if (complete_items.empty())
+        return std::nullopt;
+    auto ret = std::move(complete_items.front());
+    complete_items.pop_front();
+    return ret;
+}
+bool top_level_scanner::is_idle() const
+{
+    return !item &&
+           (state == state_t::normal || state == state_t::line_comment);
+}
+
+void top_level_scanner::scan(size_t index)
+{
+    char c = text[index];
+    switch (state)
+    {
+    case state_t::line_comment:
+        if (c == '\n')
+            state = state_t::normal;
+        return;
+    case state_t::block_comment:
+        if (c == '*')
+            state = state_t::block_comment_star;
+        return;
+    case state_t::block_comment_star:
+        if (c == '/')
+            state = state_t::normal;
+        else if (c != '*')
+            state = state_t::block_comment;
+        return;
+    case state_t::slash:
+        if (c == '/')
+        {
+            state = state_t::line_comment;
+            return;
+        }
+        if (c == '*')
+        {
+            state = state_t::block_comment;
+            return;
+        }
+        // 上一个 '/' 是除号。
+        state = state_t::normal;
+        scan_code(index - 1);
+        break;
+    case state_t::normal:
+        break;
+    }
+
+    if (c == '/')
+    {
+        // 还不能确定是注释还是除号。注释和除号都会结束标识符。
+        end_identifier();
+        state = state_t::slash;
+        return;
+    }
+    scan_code(index);
+}
+void top_level_scanner::scan_code(size_t index)
+{
+    char c = text[index];
+    if (std::isalnum(static_cast<unsigned char>(c)) || c == '_')
+    {
+        if (!item)
+            item.emplace().begin = index;
+        identifier += c;
+        return;
+    }
+    end_identifier();
+    if (std::isspace(static_cast<unsigned char>(c)))
+        return;
+
+    if (!item)
+        item.emplace().begin = index;
+    bool is_top_level = !paren_depth && !brace_depth;
+    bool is_called = is_after_identifier;
+    is_after_identifier = false;
+
+    switch (c)
+    {
+    case '(':
+        if (is_called && item->is_function && brace_depth)
+            item->callees.push_back(last_identifier);
+        if (!is_kind_known && is_top_level)
+        {
+            is_kind_known = true;
+            item->is_function = true;
+            item->name = last_identifier;
+        }
+        paren_depth++;
+        break;
+    case ')':
+        if (paren_depth)
+            paren_depth--;
+        break;
+    case '{':
+        if (item->is_function && is_top_level)
+            item->body_begin = index;
+        brace_depth++;
+        break;
+    case '}':
+        if (brace_depth)
+            brace_depth--;
+        if (item->is_function && !paren_depth && !brace_depth)
+        {
+            item->body_end = item->end = index + 1;
+            complete_items.push_back(std::move(*item));
+            item.reset();
+        }
+        break;
+    case '=':
+    case ',':
+        if (is_top_level)
+            is_kind_known = true;
+        break;
+    case ';':
+        if (is_top_level)
+        {
+            // 没有函数体的函数视为声明。
+            item->is_function = false;
+            item->end = index + 1;
+            complete_items.push_back(std::move(*item));
+            item.reset();
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (!item)
+    {
+        is_kind_known = false;
+        paren_depth = brace_depth = 0;
+        last_identifier.clear();
+    }
+}
+void top_level_scanner::end_identifier()
+{
+    if (identifier.empty())
+        return;
+    last_identifier = std::move(identifier);
+    identifier.clear();
+    is_after_identifier = true;
+}
+
+std::string compiler::prune_unreachable_functions(const std::string& source)
+{
+    top_level_scanner scanner;
+    scanner.feed(source);
+    std::vector<top_level_item_t> items;
+    while (auto item = scanner.next())
+        items.push_back(std::move(*item));
+    if (!scanner.is_idle())
+        return source;
+
+    std::unordered_map<std::string, size_t> function_index;
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        if (!items[i].is_function)
+            continue;
+        if (function_index.count(items[i].name))
+            return source; // 重复定义，由语法分析报错。
+        function_index[items[i].name] = i;
+    }
+    if (!function_index.count("main"))
+        return source;
+
+    // 从 main 出发找到所有可能被调用的函数。
+    std::unordered_set<size_t> reachable{function_index.at("main")};
+    std::vector<size_t> stack{function_index.at("main")};
+    while (!stack.empty())
+    {
+        size_t i = stack.back();
+        stack.pop_back();
+        for (const auto& callee : items[i].callees)
+        {
+            auto it = function_index.find(callee);
+            if (it != function_index.end() &&
+                reachable.insert(it->second).second)
+                stack.push_back(it->second);
+        }
+    }
+
+    std::string ret = source;
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        if (!items[i].is_function || reachable.count(i))
+            continue;
+        for (size_t j = items[i].begin; j < items[i].end; j++)
+            if (ret[j] != '\n')
+                ret[j] = ' ';
+    }
+    return ret;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file top_level_scanner.h
+ * @author UnnamedOrange
+ * @brief Split SysY source into top-level items without parsing.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace compiler
+{
+    /**
+     * @brief A top-level item of SysY source: a declaration or a function
+     * definition.
+     */
+    struct top_level_item_t
+    {
+        /**
+         * @brief Byte range [begin, end) of the item in the source.
+         */
+        size_t begin{};
+        size_t end{};
+        bool is_function{};
+        /**
+         * @brief Name of the function. Empty for declarations.
+         */
+        std::string name;
+        /**
+         * @brief Byte range [body_begin, body_end) of the function body,
+         * including the braces.
+         */
+        size_t body_begin{};
+        size_t body_end{};
+        /**
+         * @brief Identifiers followed by "(" in the body.
+         * These include all functions called by the function.
+         */
+        std::vector<std::string> callees;
+    };
+
+    /**
+     * @brief Split SysY source into top-level items by matching braces,
+     * parentheses and semicolons, skipping comments.
+     * Source can be fed in chunks; items are reported once complete.
+     */
+    class top_level_scanner
+    {
+    private:
+        enum class state_t
+        {
+            normal,
+            slash,
+            line_comment,
+            block_comment,
+            block_comment_star,
+        };
+
+    private:
+        std::string text;
+        size_t position{};
+        state_t state = state_t::normal;
+        std::deque<top_level_item_t> complete_items;
+
+        // 当前正在扫描的条目。
+        std::optional<top_level_item_t> item;
+        // 在 "(" "=" ";" "," 中最先遇到的是 "("，则条目是函数。
+        bool is_kind_known{};
+        size_t paren_depth{};
+        size_t brace_depth{};
+        std::string identifier;
+        std::string last_identifier;
+        bool is_after_identifier{};
+
+    public:
+        /**
+         * @brief Append a chunk of source.
+         */
+        void feed(std::string_view chunk);
+        /**
+         * @brief Get the next complete item, if any.
+         */
+        std::optional<top_level_item_t> next();
+        /**
+         * @brief Check whether all fed source belongs to complete items,
+         * apart from whitespace and comments.
+         */
+        bool is_idle() const;
+        /**
+         * @brief Get the source fed so far.
+         */
+        const std::string& source() const { return text; }
+
+    private:
+        void scan(size_t index);
+        void scan_code(size_t index);
+        void end_identifier();
+    };
+
+    /**
+     * @brief Blank out function definitions not reachable from main.
+     * Newlines are kept so that line numbers do not change. If the source
+     * has no main or cannot be split, it is returned unchanged, and the
+     * parser reports the errors.
+     */
+    std::string prune_unreachable_functions(const std::string& source);
+} // namespace compiler
@@ -11,6 +11,8 @@
 
 #include <filesystem>
 
+#include <backend/koopa_to_riscv.h>
+
 namespace compiler::global
 {
     /**
@@ -21,4 +23,8 @@ namespace compiler::global
      * @brief Output file path.
      */
     std::filesystem::path output_file_path;
+    /**
+     * @brief RISC-V target features.
+     */
+    riscv_target_t target;
 }
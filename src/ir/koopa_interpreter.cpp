@@ -0,0 +1,302 @@
+/**
+ * @file koopa_interpreter.cpp
+ * @author UnnamedOrange
+ * @brief Run Koopa IR in the compiler process.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "koopa_interpreter.h"
+
+#include <cctype>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "koopa_program.h"
+
+using namespace compiler::ir;
+
+namespace
+{
+    int32_t evaluate(const std::string& op, int32_t lhs, int32_t rhs)
+    {
+        // 与目标机器相同，加减乘按 32 位补码回绕，移位只取低 5 位。
+        auto u_lhs = static_cast<uint32_t>(lhs);
+        auto u_rhs = static_cast<uint32_t>(rhs);
+        if (op == "add")
+            return static_cast<int32_t>(u_lhs + u_rhs);
+        if (op == "sub")
+            return static_cast<int32_t>(u_lhs - u_rhs);
+        if (op == "mul")
+            return static_cast<int32_t>(u_lhs * u_rhs);
+        if (op == "div" || op == "mod")
+        {
+            if (!rhs)
+                throw std::runtime_error("[Error] Division by zero.");
+            if (lhs == INT32_MIN && rhs == -1)
+                throw std::runtime_error("[Error] Division overflow.");
+            return op == "div" ? lhs / rhs : lhs % rhs;
+        }
+        if (op == "ne")
+            return lhs != rhs;
+        if (op == "eq")
+            return lhs == rhs;
+        if (op == "gt")
+            return lhs > rhs;
+        if (op == "lt")
+            return lhs < rhs;
+        if (op == "ge")
+            return lhs >= rhs;
+        if (op == "le")
+            return lhs <= rhs;
+        if (op == "and")
+            return lhs & rhs;
+        if (op == "or")
+            return lhs | rhs;
+        if (op == "xor")
+            return lhs ^ rhs;
+        if (op == "shl")
+            return static_cast<int32_t>(u_lhs << (u_rhs & 31));
+        if (op == "shr")
+            return static_cast<int32_t>(u_lhs >> (u_rhs & 31));
+        if (op == "sar")
+            return lhs >> (u_rhs & 31);
+        throw std::runtime_error(
+            fmt::format("[Error] Cannot interpret operation {}.", op));
+    }
+
+    /**
+     * @brief State of a run. Every variable is one cell of the memory, and
+     * local variables are popped when their function returns.
+     */
+    class machine_t
+    {
+    private:
+        size_t step_limit;
+        size_t call_depth_limit;
+        size_t step_count{};
+        std::unordered_map<std::string, const function_t*> functions;
+        std::unordered_map<std::string, size_t> global_cells;
+        std::vector<int32_t> memory;
+        const std::string& input;
+        size_t input_pos{};
+
+    public:
+        std::string output;
+
+    public:
+        machine_t(const program_t& program, const std::string& input,
+                  size_t step_limit, size_t call_depth_limit)
+            : step_limit(step_limit), call_depth_limit(call_depth_limit),
+              input(input)
+        {
+            for (const auto& item : program.items)
+            {
+                if (auto function = std::get_if<function_t>(&item))
+                {
+                    // fun @f(@x: i32): i32
+                    const auto& header = function->header;
+                    functions[header.substr(4, header.find('(') - 4)] =
+                        function;
+                    continue;
+                }
+                // global @x = alloc i32, zeroinit
+                const auto& line = std::get<std::string>(item);
+                if (!line.starts_with("global "))
+                    continue;
+                auto equal = line.find(" = alloc i32, ");
+                if (equal == std::string::npos)
+                    throw std::runtime_error(fmt::format(
+                        "[Error] Cannot interpret global variable: {}.",
+                        line));
+                auto initializer =
+                    line.substr(equal + std::string_view(" = alloc i32, ")
+                                            .size());
+                global_cells[line.substr(7, equal - 7)] = memory.size();
+                memory.push_back(initializer == "zeroinit"
+                                     ? 0
+                                     : literal_of(initializer).value_or(0));
+            }
+        }
+
+    public:
+        int32_t call(const std::string& name,
+                     const std::vector<int32_t>& arguments, size_t depth)
+        {
+            if (auto ret = call_library(name, arguments))
+                return *ret;
+            auto it = functions.find(name);
+            if (it == functions.end())
+                throw std::runtime_error(fmt::format(
+                    "[Error] Call to undefined function {}.", name));
+            if (depth >= call_depth_limit)
+                throw step_limit_exceeded_error(
+                    "[Error] Too many nested calls.");
+            const auto& function = *it->second;
+            if (function.parameters.size() != arguments.size())
+                throw std::runtime_error(fmt::format(
+                    "[Error] Wrong number of arguments to {}.", name));
+
+            // 局部变量在返回时出栈。
+            auto memory_size = memory.size();
+            std::unordered_map<std::string, int32_t> values;
+            std::unordered_map<std::string, size_t> cells;
+            for (size_t i = 0; i < arguments.size(); i++)
+                values[function.parameters[i]] = arguments[i];
+            std::unordered_map<std::string, const basic_block_t*> block_of;
+            for (const auto& block : function.blocks)
+                block_of[block.label] = &block;
+
+            auto value_of = [&](const std::string& operand) {
+                if (auto literal = literal_of(operand))
+                    return *literal;
+                auto it = values.find(operand);
+                if (it == values.end())
+                    throw std::runtime_error(fmt::format(
+                        "[Error] Use of undefined value {} in {}.", operand,
+                        name));
+                return it->second;
+            };
+            auto cell_of = [&](const std::string& operand) -> int32_t& {
+                if (auto it = cells.find(operand); it != cells.end())
+                    return memory[it->second];
+                if (auto it = global_cells.find(operand);
+                    it != global_cells.end())
+                    return memory[it->second];
+                throw std::runtime_error(fmt::format(
+                    "[Error] Use of undefined variable {} in {}.", operand,
+                    name));
+            };
+            auto jump = [&](const std::string& label) {
+                auto it = block_of.find(label);
+                if (it == block_of.end())
+                    throw std::runtime_error(fmt::format(
+                        "[Error] Jump to undefined label {} in {}.", label,
+                        name));
+                return it->second;
+            };
+
+            const basic_block_t* block = &function.blocks.at(0);
+            while (true)
+            {
+                const basic_block_t* next = nullptr;
+                for (const auto& instruction : block->instructions)
+                {
+                    if (++step_count > step_limit)
+                        throw step_limit_exceeded_error(
+                            "[Error] Too many instructions executed.");
+                    const auto& op = instruction.op;
+                    const auto& operands = instruction.operands;
+                    if (op == "alloc")
+                    {
+                        if (operands.at(0) != "i32")
+                            throw std::runtime_error(fmt::format(
+                                "[Error] Cannot interpret alloc {}.",
+                                operands.at(0)));
+                        cells[instruction.result] = memory.size();
+                        memory.push_back(0);
+                    }
+                    else if (op == "load")
+                        values[instruction.result] = cell_of(operands.at(0));
+                    else if (op == "store")
+                    {
+                        auto value = value_of(operands.at(0));
+                        cell_of(operands.at(1)) = value;
+                    }
+                    else if (instruction.is_binary())
+                        values[instruction.result] =
+                            evaluate(op, value_of(operands.at(0)),
+                                     value_of(operands.at(1)));
+                    else if (op == "call")
+                    {
+                        std::vector<int32_t> call_arguments;
+                        for (size_t i = 1; i < operands.size(); i++)
+                            call_arguments.push_back(value_of(operands[i]));
+                        auto ret =
+                            call(operands.at(0), call_arguments, depth + 1);
+                        if (!instruction.result.empty())
+                            values[instruction.result] = ret;
+                    }
+                    else if (op == "jump")
+                        next = jump(operands.at(0));
+                    else if (op == "br")
+                        next = jump(value_of(operands.at(0)) ? operands.at(1)
+                                                             : operands.at(2));
+                    else if (op == "ret")
+                    {
+                        auto ret =
+                            operands.empty() ? 0 : value_of(operands.at(0));
+                        memory.resize(memory_size);
+                        return ret;
+                    }
+                    else
+                        throw std::runtime_error(fmt::format(
+                            "[Error] Cannot interpret operation {}.", op));
+                }
+                if (!next)
+                    throw std::runtime_error(fmt::format(
+                        "[Error] Block {} in {} has no terminator.",
+                        block->label, name));
+                block = next;
+            }
+        }
+
+    private:
+        std::optional<int32_t> call_library(
+            const std::string& name, const std::vector<int32_t>& arguments)
+        {
+            if (name == "@getint")
+            {
+                while (input_pos < input.size() &&
+                       std::isspace(static_cast<unsigned char>(
+                           input[input_pos])))
+                    input_pos++;
+                size_t length = 0;
+                int32_t ret = 0;
+                try
+                {
+                    ret = std::stoi(input.substr(input_pos), &length);
+                }
+                catch (const std::exception&)
+                {
+                }
+                input_pos += length;
+                return ret;
+            }
+            if (name == "@getch")
+                return input_pos < input.size()
+                           ? static_cast<unsigned char>(input[input_pos++])
+                           : -1;
+            if (name == "@putint")
+            {
+                output += std::to_string(arguments.at(0));
+                return 0;
+            }
+            if (name == "@putch")
+            {
+                output += static_cast<char>(arguments.at(0));
+                return 0;
+            }
+            if (name == "@starttime" || name == "@stoptime")
+                return 0;
+            return std::nullopt;
+        }
+    };
+} // namespace
+
+execution_result_t koopa_interpreter::run(const std::string& koopa_ir_str,
+                                          const std::string& input) const
+{
+    auto program = program_t::parse(koopa_ir_str);
+    machine_t machine(program, input, step_limit, call_depth_limit);
+    execution_result_t ret;
+    ret.exit_code = machine.call("@main", {}, 0);
+    ret.output = std::move(machine.output);
+    return ret;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file koopa_interpreter.h
+ * @author UnnamedOrange
+ * @brief Run Koopa IR in the compiler process.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace compiler::ir
+{
+    /**
+     * @brief Thrown when a program runs more instructions or nests more
+     * calls than allowed.
+     */
+    class step_limit_exceeded_error : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /**
+     * @brief Output of a finished program.
+     */
+    struct execution_result_t
+    {
+        /**
+         * @brief Everything written by putint and putch.
+         */
+        std::string output;
+        /**
+         * @brief Value returned by main.
+         */
+        int32_t exit_code{};
+
+        bool operator==(const execution_result_t&) const = default;
+    };
+
+    /**
+     * @brief Interpret Koopa IR produced by the frontend, with the same
+     * arithmetic as the target: addition, subtraction and multiplication
+     * wrap around.
+     * Arrays and the array functions of the library are not supported.
+     */
+    class koopa_interpreter
+    {
+    private:
+        size_t step_limit;
+        size_t call_depth_limit;
+
+    public:
+        /**
+         * @brief Create the interpreter.
+         *
+         * @param step_limit Number of instructions a run may execute.
+         * @param call_depth_limit Number of calls a run may nest.
+         */
+        explicit koopa_interpreter(size_t step_limit = 10'000'000,
+                                   size_t call_depth_limit = 10'000)
+            : step_limit(step_limit), call_depth_limit(call_depth_limit)
+        {
+        }
+
+    public:
+        /**
+         * @brief Run main of a program.
+         * If a limit is exceeded, throw a step_limit_exceeded_error. If the
+         * IR cannot be run, e.g. it divides by zero or calls an undefined
+         * function, throw an std::runtime_error.
+         *
+         * @param koopa_ir_str Koopa IR of the program.
+         * @param input What getint and getch read.
+         */
+        execution_result_t run(const std::string& koopa_ir_str,
+                               const std::string& input = "") const;
+    };
+} // namespace compiler::ir
@@ -0,0 +1,248 @@
+/**
+ * @file koopa_linker.cpp
+ * @author UnnamedOrange
+ * @brief Merge the Koopa IR of several compilation units.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "koopa_linker.h"
+
+#include <cctype>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+
+#include <fmt/core.h>
+
+#include "koopa_program.h"
+
+using namespace compiler;
+using namespace compiler::ir;
+
+namespace
+{
+    /**
+     * @brief Get the symbol a line outside functions starts with after a
+     * keyword, e.g. "@x" for "global @x = alloc i32, 1" and "global".
+     * Empty if the line does not start with the keyword.
+     */
+    std::string symbol_after(std::string_view line, std::string_view keyword)
+    {
+        if (line.substr(0, keyword.size()) != keyword ||
+            line.substr(keyword.size(), 2) != " @")
+            return "";
+        line.remove_prefix(keyword.size() + 1);
+        return std::string(line.substr(0, line.find_first_of(" (:")));
+    }
+    /**
+     * @brief Get the parameter and return types of a function header or
+     * declaration without names and spaces, e.g. "(i32,*i32):i32" for both
+     * "fun @f(@x: i32, @y: *i32): i32" and "decl @f(i32, *i32): i32".
+     */
+    std::string type_of(std::string_view line)
+    {
+        auto open = line.find('(');
+        auto close = line.rfind(')');
+        if (open == std::string_view::npos || close == std::string_view::npos)
+            throw std::runtime_error(
+                fmt::format("[Error] Invalid Koopa IR: {}.", line));
+        auto append = [](std::string& str, std::string_view part) {
+            for (auto c : part)
+                if (!std::isspace(static_cast<unsigned char>(c)))
+                    str += c;
+        };
+        std::string ret = "(";
+        auto parameters = line.substr(open + 1, close - open - 1);
+        for (bool is_first = true;; is_first = false)
+        {
+            auto pos = parameters.find(',');
+            auto parameter = parameters.substr(0, pos);
+            // 函数定义中的参数带有名称。
+            if (auto colon = parameter.find(':');
+                colon != std::string_view::npos)
+                parameter.remove_prefix(colon + 1);
+            if (!is_first)
+                ret += ',';
+            append(ret, parameter);
+            if (pos == std::string_view::npos)
+                break;
+            parameters.remove_prefix(pos + 1);
+        }
+        ret += ')';
+        append(ret, line.substr(close + 1));
+        return ret;
+    }
+    std::string name_of(const function_t& function)
+    {
+        return symbol_after(function.header, "fun");
+    }
+    std::vector<std::string> callees_of(function_t& function)
+    {
+        std::vector<std::string> ret;
+        for (auto& block : function.blocks)
+            for (auto& instruction : block.instructions)
+                if (instruction.op == "call")
+                    ret.push_back(instruction.operands[0]);
+        return ret;
+    }
+    /**
+     * @brief Get the symbols used by a function that are not its parameters
+     * or local variables.
+     */
+    std::unordered_set<std::string> globals_used_by(function_t& function)
+    {
+        std::unordered_set<std::string> locals(function.parameters.begin(),
+                                               function.parameters.end());
+        for (auto& block : function.blocks)
+            for (auto& instruction : block.instructions)
+                if (instruction.op == "alloc")
+                    locals.insert(instruction.result);
+        std::unordered_set<std::string> ret;
+        for (auto& block : function.blocks)
+            for (auto& instruction : block.instructions)
+                for (auto operand : instruction.value_operands())
+                    if (operand->starts_with('@') && !locals.count(*operand))
+                        ret.insert(*operand);
+        return ret;
+    }
+} // namespace
+
+std::string koopa_linker::link(const std::vector<std::string>& units)
+{
+    removed_function_count = 0;
+    removed_global_count = 0;
+    std::vector<program_t> programs;
+    for (const auto& unit : units)
+        programs.push_back(program_t::parse(unit));
+
+    // 找到所有定义。
+    std::unordered_set<std::string> functions;
+    std::unordered_set<std::string> globals;
+    // 各函数定义或第一个声明的类型。
+    std::unordered_map<std::string, std::string> function_types;
+    for (auto& program : programs)
+    {
+        for (auto& item : program.items)
+        {
+            std::string name;
+            bool is_new = true;
+            if (auto function = std::get_if<function_t>(&item))
+            {
+                is_new = functions.insert(name = name_of(*function)).second;
+                function_types[name] = type_of(function->header);
+            }
+            else if (!(name = symbol_after(std::get<std::string>(item),
+                                           "global"))
+                          .empty())
+                is_new = globals.insert(name).second;
+            if (!is_new)
+                throw std::runtime_error(
+                    fmt::format("[Error] Multiple definitions of {}.", name));
+        }
+    }
+
+    // 合并。没有定义的函数只保留一个声明，放在所有定义之前。
+    // 多个源文件时行号无法对应到唯一的文件，不保留源文件。
+    // 各单元的空行不保留，只在声明和全局变量后各空一行。
+    program_t merged;
+    std::unordered_set<std::string> declared;
+    std::vector<std::string> lines;
+    std::vector<function_t> definitions;
+    for (auto& program : programs)
+    {
+        for (auto& item : program.items)
+        {
+            if (auto line = std::get_if<std::string>(&item))
+            {
+                if (auto name = symbol_after(*line, "decl"); !name.empty())
+                {
+                    auto type = type_of(*line);
+                    auto [it, is_new] = function_types.emplace(name, type);
+                    if (!is_new && it->second != type)
+                        throw std::runtime_error(fmt::format(
+                            "[Error] Conflicting types for {}.", name));
+                    if (!functions.count(name) && declared.insert(name).second)
+                        merged.items.push_back(std::move(*line));
+                    continue;
+                }
+                if (line->empty() ||
+                    (units.size() > 1 && line->starts_with(file_marker_prefix)))
+                    continue;
+                lines.push_back(std::move(*line));
+            }
+            else
+                definitions.push_back(std::move(std::get<function_t>(item)));
+        }
+    }
+    merged.items.emplace_back(std::string());
+    for (auto& line : lines)
+        merged.items.push_back(std::move(line));
+    if (!lines.empty())
+        merged.items.emplace_back(std::string());
+    for (auto& function : definitions)
+        merged.items.push_back(std::move(function));
+
+    // 检查所有使用的符号都有定义。
+    for (auto& item : merged.items)
+    {
+        auto function = std::get_if<function_t>(&item);
+        if (!function)
+            continue;
+        for (const auto& callee : callees_of(*function))
+            if (!functions.count(callee) && !declared.count(callee))
+                throw std::runtime_error(
+                    fmt::format("[Error] Undefined reference to {}.", callee));
+        for (const auto& name : globals_used_by(*function))
+            if (!globals.count(name))
+                throw std::runtime_error(
+                    fmt::format("[Error] Undefined reference to {}.", name));
+    }
+
+    if (whole_program && functions.count("@main"))
+    {
+        // 从 main 出发找到所有可能被调用的函数。
+        std::unordered_map<std::string, function_t*> function_of;
+        for (auto& item : merged.items)
+            if (auto function = std::get_if<function_t>(&item))
+                function_of[name_of(*function)] = function;
+        std::unordered_set<std::string> reachable{"@main"};
+        std::vector<std::string> stack{"@main"};
+        std::unordered_set<std::string> used_globals;
+        while (!stack.empty())
+        {
+            auto function = function_of.at(stack.back());
+            stack.pop_back();
+            for (const auto& callee : callees_of(*function))
+                if (reachable.insert(callee).second &&
+                    function_of.count(callee))
+                    stack.push_back(callee);
+            for (const auto& name : globals_used_by(*function))
+                used_globals.insert(name);
+        }
+
+        // 删除不会被调用的函数和声明，以及不被使用的全局变量。
+        std::erase_if(merged.items, [&](auto& item) {
+            if (auto function = std::get_if<function_t>(&item))
+            {
+                bool is_removed = !reachable.count(name_of(*function));
+                removed_function_count += is_removed;
+                return is_removed;
+            }
+            const auto& line = std::get<std::string>(item);
+            if (auto name = symbol_after(line, "decl"); !name.empty())
+                return !reachable.count(name);
+            if (auto name = symbol_after(line, "global"); !name.empty())
+            {
+                bool is_removed = !used_globals.count(name);
+                removed_global_count += is_removed;
+                return is_removed;
+            }
+            return false;
+        });
+    }
+    return merged.to_string();
+}
@@ -0,0 +1,70 @@
+/**
+ * @file koopa_linker.h
+ * @author UnnamedOrange
+ * @brief Merge the Koopa IR of several compilation units.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace compiler
+{
+    /**
+     * @brief Merge the Koopa IR of compilation units into one program.
+     *
+     * Functions and global variables defined in one unit resolve the
+     * declarations and references of the others. Declarations of functions
+     * defined in some unit are dropped, and the others are kept once.
+     * Source line markers are kept, but the source file is only kept when
+     * there is a single unit.
+     */
+    class koopa_linker
+    {
+    private:
+        bool whole_program{};
+        size_t removed_function_count{};
+        size_t removed_global_count{};
+
+    public:
+        /**
+         * @brief Create the linker.
+         *
+         * @param whole_program Run whole-program passes over the merged IR:
+         * remove functions that main cannot call and global variables that
+         * no remaining function uses.
+         */
+        explicit koopa_linker(bool whole_program = false)
+            : whole_program(whole_program)
+        {
+        }
+
+    public:
+        /**
+         * @brief Merge compilation units.
+         * If a symbol is defined more than once or used without being
+         * defined, a declaration does not match the types of the definition
+         * or another declaration, or a unit cannot be parsed, throw an
+         * std::runtime_error.
+         *
+         * @param units Koopa IR of each unit, in the order of the inputs.
+         * @return std::string Koopa IR of the program.
+         */
+        std::string link(const std::vector<std::string>& units);
+        /**
+         * @brief Number of functions removed by whole-program passes in the
+         * last link.
+         */
+        size_t functions_removed() const { return removed_function_count; }
+        /**
+         * @brief Number of global variables removed by whole-program passes
+         * in the last link.
+         */
+        size_t globals_removed() const { return removed_global_count; }
+    };
+} // namespace compiler
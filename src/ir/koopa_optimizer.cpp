@@ -0,0 +1,673 @@
+/**
+ * @file koopa_optimizer.cpp
+ * @author UnnamedOrange
+ * @brief Optimize Koopa IR.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "koopa_optimizer.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "koopa_program.h"
+#include <job_budget.hpp>
+
+using namespace compiler;
+using namespace compiler::ir;
+
+namespace
+{
+    using replacements_t = std::unordered_map<std::string, std::string>;
+
+    /**
+     * @brief Follow a chain of replacements.
+     */
+    std::string resolve(const replacements_t& replacements, std::string value)
+    {
+        for (auto it = replacements.find(value); it != replacements.end();
+             it = replacements.find(value))
+            value = it->second;
+        return value;
+    }
+    /**
+     * @brief Replace values in all operands of a function.
+     */
+    void substitute(function_t& function, const replacements_t& replacements)
+    {
+        if (replacements.empty())
+            return;
+        for (auto& block : function.blocks)
+            for (auto& instruction : block.instructions)
+                for (auto operand : instruction.value_operands())
+                    *operand = resolve(replacements, *operand);
+    }
+    /**
+     * @brief Remove instructions whose op is cleared.
+     */
+    void erase_cleared(function_t& function)
+    {
+        for (auto& block : function.blocks)
+            std::erase_if(block.instructions, [](const auto& instruction) {
+                return instruction.op.empty();
+            });
+    }
+    bool is_comparison(const std::string& op)
+    {
+        return op == "ne" || op == "eq" || op == "gt" || op == "lt" ||
+               op == "ge" || op == "le";
+    }
+
+    /**
+     * @brief Evaluate a binary operation on constants as the target does.
+     * Operations with undefined results are not evaluated.
+     */
+    std::optional<int32_t> evaluate(const std::string& op, int32_t lhs,
+                                    int32_t rhs)
+    {
+        // 加减乘按 32 位补码回绕。
+        auto u_lhs = static_cast<uint32_t>(lhs);
+        auto u_rhs = static_cast<uint32_t>(rhs);
+        if (op == "add")
+            return static_cast<int32_t>(u_lhs + u_rhs);
+        if (op == "sub")
+            return static_cast<int32_t>(u_lhs - u_rhs);
+        if (op == "mul")
+            return static_cast<int32_t>(u_lhs * u_rhs);
+        if (op == "div" || op == "mod")
+        {
+            if (!rhs || (lhs == INT32_MIN && rhs == -1))
+                return std::nullopt;
+            return op == "div" ? lhs / rhs : lhs % rhs;
+        }
+        if (op == "ne")
+            return lhs != rhs;
+        if (op == "eq")
+            return lhs == rhs;
+        if (op == "gt")
+            return lhs > rhs;
+        if (op == "lt")
+            return lhs < rhs;
+        if (op == "ge")
+            return lhs >= rhs;
+        if (op == "le")
+            return lhs <= rhs;
+        if (op == "and")
+            return lhs & rhs;
+        if (op == "or")
+            return lhs | rhs;
+        if (op == "xor")
+            return lhs ^ rhs;
+        if (rhs < 0 || rhs >= 32)
+            return std::nullopt;
+        if (op == "shl")
+            return static_cast<int32_t>(u_lhs << rhs);
+        if (op == "shr")
+            return static_cast<int32_t>(u_lhs >> rhs);
+        if (op == "sar")
+            return lhs >> rhs;
+        return std::nullopt;
+    }
+    /**
+     * @brief Simplify a binary operation with at most one constant operand.
+     *
+     * @return std::optional<std::string> The equivalent value, if any.
+     */
+    std::optional<std::string> simplify(
+        const instruction_t& instruction,
+        const std::unordered_set<std::string>& booleans)
+    {
+        const auto& op = instruction.op;
+        const auto& lhs = instruction.operands[0];
+        const auto& rhs = instruction.operands[1];
+        auto l = literal_of(lhs);
+        auto r = literal_of(rhs);
+        if ((op == "add" || op == "or" || op == "xor") && l == 0)
+            return rhs;
+        if ((op == "add" || op == "sub" || op == "or" || op == "xor" ||
+             op == "shl" || op == "shr" || op == "sar") &&
+            r == 0)
+            return lhs;
+        if (op == "mul" && (l == 0 || r == 0))
+            return "0";
+        if (op == "and" && (l == 0 || r == 0))
+            return "0";
+        if (op == "mul" && l == 1)
+            return rhs;
+        if ((op == "mul" || op == "div") && r == 1)
+            return lhs;
+        if ((op == "sub" || op == "xor") && !l && lhs == rhs)
+            return "0";
+        // 比较的结果只有 0 和 1，再与 0 比较不改变其值。
+        if (op == "ne" && r == 0 && booleans.count(lhs))
+            return lhs;
+        if (op == "ne" && l == 0 && booleans.count(rhs))
+            return rhs;
+        return std::nullopt;
+    }
+
+    /**
+     * @brief Fold constants and simplify algebra and branches.
+     */
+    bool fold_constants(function_t& function)
+    {
+        bool changed = false;
+        replacements_t replacements;
+        std::unordered_set<std::string> booleans;
+        for (auto& block : function.blocks)
+        {
+            for (auto& instruction : block.instructions)
+            {
+                for (auto operand : instruction.value_operands())
+                    *operand = resolve(replacements, *operand);
+                if (instruction.is_binary())
+                {
+                    auto l = literal_of(instruction.operands[0]);
+                    auto r = literal_of(instruction.operands[1]);
+                    std::optional<std::string> value;
+                    if (l && r)
+                    {
+                        if (auto result = evaluate(instruction.op, *l, *r))
+                            value = std::to_string(*result);
+                    }
+                    else
+                        value = simplify(instruction, booleans);
+                    if (value)
+                    {
+                        replacements[instruction.result] = *value;
+                        instruction.op.clear();
+                        changed = true;
+                    }
+                    else if (is_comparison(instruction.op))
+                        booleans.insert(instruction.result);
+                }
+                else if (instruction.op == "br")
+                {
+                    auto& operands = instruction.operands;
+                    auto condition = literal_of(operands[0]);
+                    if (condition || operands[1] == operands[2])
+                    {
+                        // 条件已知或两个目标相同，改为无条件跳转。
+                        bool is_false = condition && !*condition;
+                        auto target = is_false ? operands[2] : operands[1];
+                        instruction = instruction_t{
+                            "", "jump", {target}, instruction.line};
+                        changed = true;
+                    }
+                }
+            }
+        }
+        erase_cleared(function);
+        // 值可能在定义之前的基本块中被使用。
+        substitute(function, replacements);
+        return changed;
+    }
+
+    /**
+     * @brief Redirect jumps to blocks that only jump elsewhere.
+     */
+    bool thread_jumps(function_t& function)
+    {
+        std::unordered_map<std::string, std::string> forwards;
+        for (size_t i = 1; i < function.blocks.size(); i++)
+        {
+            const auto& block = function.blocks[i];
+            if (block.instructions.size() == 1 &&
+                block.instructions[0].op == "jump" &&
+                block.instructions[0].operands[0] != block.label)
+                forwards[block.label] = block.instructions[0].operands[0];
+        }
+        bool changed = false;
+        for (auto& block : function.blocks)
+        {
+            for (auto& instruction : block.instructions)
+            {
+                for (auto label : instruction.label_operands())
+                {
+                    // 空循环会形成环，最多跟随块数次。
+                    auto target = *label;
+                    for (size_t i = 0; i < function.blocks.size(); i++)
+                    {
+                        auto it = forwards.find(target);
+                        if (it == forwards.end())
+                            break;
+                        target = it->second;
+                    }
+                    if (target != *label)
+                    {
+                        *label = target;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        return changed;
+    }
+    /**
+     * @brief Remove basic blocks not reachable from the entry.
+     */
+    bool remove_unreachable_blocks(function_t& function)
+    {
+        if (function.blocks.empty())
+            return false;
+        std::unordered_map<std::string, size_t> index_of;
+        for (size_t i = 0; i < function.blocks.size(); i++)
+            index_of[function.blocks[i].label] = i;
+        std::vector<bool> is_reachable(function.blocks.size());
+        std::vector<size_t> stack{0};
+        is_reachable[0] = true;
+        while (!stack.empty())
+        {
+            auto& block = function.blocks[stack.back()];
+            stack.pop_back();
+            for (auto& instruction : block.instructions)
+            {
+                for (auto label : instruction.label_operands())
+                {
+                    auto index = index_of.at(*label);
+                    if (!is_reachable[index])
+                    {
+                        is_reachable[index] = true;
+                        stack.push_back(index);
+                    }
+                }
+            }
+        }
+        std::vector<basic_block_t> blocks;
+        for (size_t i = 0; i < function.blocks.size(); i++)
+            if (is_reachable[i])
+                blocks.push_back(std::move(function.blocks[i]));
+        bool changed = blocks.size() != function.blocks.size();
+        function.blocks = std::move(blocks);
+        return changed;
+    }
+    /**
+     * @brief Merge a block into its only predecessor that jumps to it.
+     */
+    bool merge_blocks(function_t& function)
+    {
+        bool changed = false;
+        while (true)
+        {
+            std::unordered_map<std::string, size_t> predecessor_count;
+            for (auto& block : function.blocks)
+                for (auto& instruction : block.instructions)
+                    for (auto label : instruction.label_operands())
+                        predecessor_count[*label]++;
+
+            bool merged = false;
+            for (size_t i = 0; i < function.blocks.size() && !merged; i++)
+            {
+                auto& block = function.blocks[i];
+                if (block.instructions.empty() ||
+                    block.instructions.back().op != "jump")
+                    continue;
+                auto target = block.instructions.back().operands[0];
+                if (predecessor_count[target] != 1 ||
+                    target == function.blocks[0].label || target == block.label)
+                    continue;
+                for (size_t j = 1; j < function.blocks.size(); j++)
+                {
+                    if (function.blocks[j].label != target)
+                        continue;
+                    block.instructions.pop_back();
+                    auto& successor = function.blocks[j].instructions;
+                    block.instructions.insert(
+                        block.instructions.end(),
+                        std::make_move_iterator(successor.begin()),
+                        std::make_move_iterator(successor.end()));
+                    function.blocks.erase(function.blocks.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+            if (!merged)
+                return changed;
+            changed = true;
+        }
+    }
+    /**
+     * @brief Remove instructions without side effects whose results are not
+     * used.
+     */
+    bool remove_dead_instructions(function_t& function)
+    {
+        bool changed = false;
+        while (true)
+        {
+            std::unordered_map<std::string, size_t> use_count;
+            for (auto& block : function.blocks)
+                for (auto& instruction : block.instructions)
+                    for (auto operand : instruction.value_operands())
+                        use_count[*operand]++;
+
+            bool removed = false;
+            for (auto& block : function.blocks)
+            {
+                for (auto& instruction : block.instructions)
+                {
+                    bool is_pure = instruction.is_binary() ||
+                                   instruction.op == "load" ||
+                                   instruction.op == "alloc";
+                    if (is_pure && !use_count[instruction.result])
+                    {
+                        instruction.op.clear();
+                        removed = true;
+                    }
+                }
+            }
+            if (!removed)
+                return changed;
+            erase_cleared(function);
+            changed = true;
+        }
+    }
+
+    /**
+     * @brief Get the local variables of a function. Their addresses never
+     * escape, so calls cannot access them.
+     */
+    std::unordered_set<std::string> local_variables_of(function_t& function)
+    {
+        std::unordered_set<std::string> ret;
+        for (auto& block : function.blocks)
+            for (auto& instruction : block.instructions)
+                if (instruction.op == "alloc")
+                    ret.insert(instruction.result);
+        return ret;
+    }
+    /**
+     * @brief Forward stored and loaded values to later loads of the same
+     * variable in a basic block.
+     */
+    bool forward_memory(function_t& function)
+    {
+        auto locals = local_variables_of(function);
+        std::unordered_set<std::string> parameters(function.parameters.begin(),
+                                                   function.parameters.end());
+        bool changed = false;
+        replacements_t replacements;
+        for (auto& block : function.blocks)
+        {
+            // 各变量当前的值。
+            std::unordered_map<std::string, std::string> known;
+            for (auto& instruction : block.instructions)
+            {
+                for (auto operand : instruction.value_operands())
+                    *operand = resolve(replacements, *operand);
+                if (instruction.op == "store")
+                {
+                    const auto& value = instruction.operands[0];
+                    const auto& pointer = instruction.operands[1];
+                    // 后端从栈帧中读取参数，参数不作为一般的操作数。
+                    if (parameters.count(value))
+                        known.erase(pointer);
+                    else
+                        known[pointer] = value;
+                }
+                else if (instruction.op == "load")
+                {
+                    const auto& pointer = instruction.operands[0];
+                    if (auto it = known.find(pointer); it != known.end())
+                    {
+                        replacements[instruction.result] = it->second;
+                        instruction.op.clear();
+                        changed = true;
+                    }
+                    else
+                        known[pointer] = instruction.result;
+                }
+                else if (instruction.op == "call")
+                {
+                    // 被调用的函数可能读写全局变量。
+                    std::erase_if(known, [&](const auto& entry) {
+                        return !locals.count(entry.first);
+                    });
+                }
+            }
+        }
+        erase_cleared(function);
+        substitute(function, replacements);
+        return changed;
+    }
+    /**
+     * @brief Remove stores that are never read: all stores to local variables
+     * that are never loaded, and stores overwritten later in the same basic
+     * block before being read.
+     */
+    bool remove_dead_stores(function_t& function)
+    {
+        auto locals = local_variables_of(function);
+        std::unordered_set<std::string> loaded;
+        for (auto& block : function.blocks)
+            for (auto& instruction : block.instructions)
+                if (instruction.op == "load")
+                    loaded.insert(instruction.operands[0]);
+
+        bool changed = false;
+        for (auto& block : function.blocks)
+        {
+            // 各变量尚未被读取的最后一次写入。
+            std::unordered_map<std::string, instruction_t*> pending;
+            for (auto& instruction : block.instructions)
+            {
+                if (instruction.op == "store")
+                {
+                    const auto& pointer = instruction.operands[1];
+                    if (locals.count(pointer) && !loaded.count(pointer))
+                    {
+                        instruction.op.clear();
+                        changed = true;
+                        continue;
+                    }
+                    if (auto it = pending.find(pointer); it != pending.end())
+                    {
+                        it->second->op.clear();
+                        changed = true;
+                    }
+                    pending[pointer] = &instruction;
+                }
+                else if (instruction.op == "load")
+                    pending.erase(instruction.operands[0]);
+                else if (instruction.op == "call")
+                {
+                    std::erase_if(pending, [&](const auto& entry) {
+                        return !locals.count(entry.first);
+                    });
+                }
+            }
+        }
+        erase_cleared(function);
+        return changed;
+    }
+
+    using steady_clock_t = std::chrono::steady_clock;
+
+    /**
+     * @brief Optimize a function with the passes of a tier.
+     *
+     * @param deadline When passed, drop to a cheaper tier after the current
+     * round. Dropping below tier 1 stops optimizing.
+     * @return int The tier the function finished at.
+     */
+    int optimize_function(function_t& function, int tier,
+                          std::optional<steady_clock_t::time_point> deadline)
+    {
+        // 各个优化互相创造机会，反复进行直到不再变化。
+        for (int round = 0; round < 16 && tier > 0; round++)
+        {
+            check_job_budget();
+            bool changed = false;
+            changed |= fold_constants(function);
+            if (tier >= 2)
+            {
+                changed |= forward_memory(function);
+                changed |= remove_dead_stores(function);
+            }
+            changed |= thread_jumps(function);
+            changed |= remove_unreachable_blocks(function);
+            changed |= merge_blocks(function);
+            changed |= remove_dead_instructions(function);
+            if (!changed)
+                break;
+            if (deadline && steady_clock_t::now() > *deadline)
+                tier--;
+        }
+        return tier;
+    }
+
+    /**
+     * @brief Static estimate of the cost and the benefit of optimizing a
+     * function.
+     */
+    struct function_estimate_t
+    {
+        size_t instruction_count{};
+        size_t loop_depth{};
+        /**
+         * @brief Estimated number of instructions executed per call.
+         * Each instruction is weighted by 10 to the power of its loop depth.
+         */
+        double weight{};
+    };
+    function_estimate_t estimate(function_t& function)
+    {
+        // 基本块按源码顺序排列，跳转到之前的块形成循环，
+        // 两者之间的块都在循环中。用差分数组计算每个块的循环深度。
+        std::unordered_map<std::string, size_t> index_of;
+        for (size_t i = 0; i < function.blocks.size(); i++)
+            index_of[function.blocks[i].label] = i;
+        std::vector<long> depth_delta(function.blocks.size() + 1);
+        for (size_t i = 0; i < function.blocks.size(); i++)
+            for (auto& instruction : function.blocks[i].instructions)
+                for (auto label : instruction.label_operands())
+                    if (auto it = index_of.find(*label);
+                        it != index_of.end() && it->second <= i)
+                    {
+                        depth_delta[it->second]++;
+                        depth_delta[i + 1]--;
+                    }
+
+        function_estimate_t ret;
+        long depth = 0;
+        for (size_t i = 0; i < function.blocks.size(); i++)
+        {
+            depth += depth_delta[i];
+            auto size = function.blocks[i].instructions.size();
+            ret.instruction_count += size;
+            ret.loop_depth = std::max(ret.loop_depth, size_t(depth));
+            ret.weight += size * std::pow(10.0, std::min(depth, 6L));
+        }
+        return ret;
+    }
+    /**
+     * @brief Choose the tier a function starts at.
+     */
+    int initial_tier(const function_estimate_t& estimate, int level)
+    {
+        // 没有循环的大函数执行次数少，只使用便宜的优化。
+        constexpr size_t large_function_size = 2000;
+        if (!estimate.loop_depth &&
+            estimate.instruction_count > large_function_size)
+            return std::min(level, 1);
+        return level;
+    }
+} // namespace
+
+std::chrono::milliseconds koopa_optimizer::parse_budget(const std::string& str)
+{
+    auto error = std::invalid_argument(
+        fmt::format("[Error] Invalid compile budget \"{}\".", str));
+    size_t length{};
+    double value{};
+    try
+    {
+        value = std::stod(str, &length);
+    }
+    catch (const std::exception&)
+    {
+        throw error;
+    }
+    auto unit = str.substr(length);
+    if (unit != "s" && unit != "ms")
+        throw error;
+    if (unit == "s")
+        value *= 1000;
+    // 截止时间是 steady_clock 的当前时间加上预算，预算过大会溢出。
+    static const auto max_budget =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::duration::max())
+            .count() /
+        2;
+    if (!std::isfinite(value) || !(value >= 0) ||
+        value > static_cast<double>(max_budget))
+        throw error;
+    return std::chrono::milliseconds(static_cast<int64_t>(value));
+}
+
+std::string koopa_optimizer::optimize(const std::string& koopa_ir_str)
+{
+    if (level <= 0)
+        return koopa_ir_str;
+    auto program = program_t::parse(koopa_ir_str);
+    input_instruction_count = program.instruction_count();
+    tier_counts = {};
+
+    if (!budget.count())
+    {
+        for (auto& item : program.items)
+            if (auto function = std::get_if<function_t>(&item))
+                tier_counts[optimize_function(*function, level, {})]++;
+    }
+    else
+    {
+        auto end_time = steady_clock_t::now() + budget;
+        // 先优化执行次数相对于大小最多的函数，预算先用在收益高的地方。
+        std::vector<std::pair<function_t*, function_estimate_t>> functions;
+        size_t remaining_instructions = 0;
+        for (auto& item : program.items)
+            if (auto function = std::get_if<function_t>(&item))
+            {
+                functions.emplace_back(function, estimate(*function));
+                remaining_instructions +=
+                    functions.back().second.instruction_count;
+            }
+        auto density = [](const function_estimate_t& estimate) {
+            return estimate.weight /
+                   std::max<size_t>(estimate.instruction_count, 1);
+        };
+        std::stable_sort(functions.begin(), functions.end(),
+                         [&](const auto& a, const auto& b) {
+                             return density(a.second) > density(b.second);
+                         });
+        for (auto& [function, estimate] : functions)
+        {
+            // 按大小分配剩余的预算，提前完成的函数剩下的时间留给之后的函数。
+            auto now = steady_clock_t::now();
+            int tier = 0;
+            if (now < end_time)
+            {
+                auto share = (end_time - now) * estimate.instruction_count /
+                             std::max<size_t>(remaining_instructions, 1);
+                tier = optimize_function(
+                    *function, initial_tier(estimate, level), now + share);
+            }
+            remaining_instructions -= estimate.instruction_count;
+            tier_counts[tier]++;
+        }
+    }
+
+    output_instruction_count = program.instruction_count();
+    return program.to_string();
+}
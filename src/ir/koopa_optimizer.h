@@ -0,0 +1,90 @@
+/**
+ * @file koopa_optimizer.h
+ * @author UnnamedOrange
+ * @brief Optimize Koopa IR.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace compiler
+{
+    /**
+     * @brief Optimize Koopa IR produced by the frontend.
+     *
+     * Level 1 folds constants, simplifies algebra and branches, removes dead
+     * instructions and unreachable blocks, and merges straight-line blocks.
+     * Level 2 also forwards stored and loaded values within basic blocks
+     * and removes dead stores.
+     *
+     * With a compile-time budget, each function is optimized at its own
+     * tier (the level of passes it runs). Functions are estimated by size
+     * and loop depth: large functions without loops start at tier 1, and
+     * the budget is shared in proportion to size, going first to small
+     * functions with deep loops. A function that runs out of its share drops
+     * to a cheaper tier, and functions left when the budget is used up are
+     * not optimized.
+     */
+    class koopa_optimizer
+    {
+    private:
+        int level{};
+        std::chrono::milliseconds budget{};
+        size_t input_instruction_count{};
+        size_t output_instruction_count{};
+        std::array<size_t, 3> tier_counts{};
+
+    public:
+        /**
+         * @brief Create the optimizer.
+         *
+         * @param level Optimization level. 0 returns the input unchanged.
+         * @param budget Time allowed for optimizing the whole program. 0
+         * means no limit, and every function is optimized at the level.
+         */
+        explicit koopa_optimizer(int level = 2,
+                                 std::chrono::milliseconds budget = {})
+            : level(level), budget(budget)
+        {
+        }
+
+    public:
+        /**
+         * @brief Parse a budget such as "2s", "1.5s" or "500ms".
+         * If the string is not a valid duration, or the duration is infinite
+         * or too long to add to the current time, throw an
+         * std::invalid_argument.
+         */
+        static std::chrono::milliseconds parse_budget(const std::string& str);
+
+    public:
+        /**
+         * @brief Optimize Koopa IR.
+         * If the IR cannot be parsed, throw an std::runtime_error.
+         *
+         * @param koopa_ir_str Koopa IR in string.
+         * @return std::string Optimized Koopa IR in string.
+         */
+        std::string optimize(const std::string& koopa_ir_str);
+        /**
+         * @brief Number of instructions before the last optimization.
+         */
+        size_t instructions_before() const { return input_instruction_count; }
+        /**
+         * @brief Number of instructions after the last optimization.
+         */
+        size_t instructions_after() const { return output_instruction_count; }
+        /**
+         * @brief Number of functions finished at a tier (0 to 2) in the last
+         * optimization.
+         */
+        size_t functions_at_tier(int tier) const { return tier_counts[tier]; }
+    };
+} // namespace compiler
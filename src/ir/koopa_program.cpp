@@ -0,0 +1,266 @@
+/**
+ * @file koopa_program.cpp
+ * @author UnnamedOrange
+ * @brief Editable model of Koopa IR text.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include "koopa_program.h"
+
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+#include <fmt/core.h>
+
+using namespace compiler::ir;
+
+namespace
+{
+    std::string_view trim(std::string_view str)
+    {
+        while (!str.empty() &&
+               std::isspace(static_cast<unsigned char>(str.front())))
+            str.remove_prefix(1);
+        while (!str.empty() &&
+               std::isspace(static_cast<unsigned char>(str.back())))
+            str.remove_suffix(1);
+        return str;
+    }
+    /**
+     * @brief Split a comma-separated list, e.g. "%1, 2".
+     */
+    std::vector<std::string> split_list(std::string_view str)
+    {
+        std::vector<std::string> ret;
+        str = trim(str);
+        while (!str.empty())
+        {
+            auto pos = str.find(',');
+            ret.emplace_back(trim(str.substr(0, pos)));
+            if (pos == std::string_view::npos)
+                break;
+            str = trim(str.substr(pos + 1));
+        }
+        return ret;
+    }
+    instruction_t parse_instruction(std::string_view line)
+    {
+        instruction_t ret;
+        if (auto pos = line.find(" = "); pos != std::string_view::npos)
+        {
+            ret.result = trim(line.substr(0, pos));
+            line = trim(line.substr(pos + 3));
+        }
+        auto pos = line.find_first_of(" (");
+        ret.op = line.substr(0, pos);
+        auto rest = pos == std::string_view::npos ? std::string_view()
+                                                  : trim(line.substr(pos));
+        if (ret.op == "call")
+        {
+            // call @f(%1, 2)
+            auto open = rest.find('(');
+            auto close = rest.rfind(')');
+            if (open == std::string_view::npos ||
+                close == std::string_view::npos)
+                throw std::runtime_error(
+                    fmt::format("[Error] Invalid Koopa IR: {}.", line));
+            ret.operands.emplace_back(trim(rest.substr(0, open)));
+            auto args = split_list(rest.substr(open + 1, close - open - 1));
+            for (auto& arg : args)
+                ret.operands.push_back(std::move(arg));
+        }
+        else if (ret.op == "alloc")
+            ret.operands.emplace_back(rest);
+        else
+            ret.operands = split_list(rest);
+        return ret;
+    }
+} // namespace
+
+bool instruction_t::is_terminator() const
+{
+    return op == "br" || op == "jump" || op == "ret";
+}
+bool instruction_t::is_binary() const
+{
+    static const std::vector<std::string_view> binary_ops{
+        "ne",  "eq",  "gt",  "lt",  "ge", "le",  "add", "sub", "mul",
+        "div", "mod", "and", "or",  "xor", "shl", "shr", "sar"};
+    for (auto binary_op : binary_ops)
+        if (op == binary_op)
+            return true;
+    return false;
+}
+std::vector<std::string*> instruction_t::value_operands()
+{
+    std::vector<std::string*> ret;
+    if (op == "alloc" || op == "jump")
+        return ret;
+    size_t begin = op == "call" ? 1 : 0;
+    size_t end = op == "br" ? 1 : operands.size();
+    for (size_t i = begin; i < end && i < operands.size(); i++)
+        ret.push_back(&operands[i]);
+    return ret;
+}
+std::vector<std::string*> instruction_t::label_operands()
+{
+    std::vector<std::string*> ret;
+    if (op == "jump")
+        ret.push_back(&operands.at(0));
+    else if (op == "br")
+    {
+        ret.push_back(&operands.at(1));
+        ret.push_back(&operands.at(2));
+    }
+    return ret;
+}
+
+program_t program_t::parse(const std::string& koopa_ir_str)
+{
+    program_t ret;
+    std::istringstream iss(koopa_ir_str);
+    std::string raw_line;
+    function_t* function = nullptr;
+    int source_line = 0;
+    while (std::getline(iss, raw_line))
+    {
+        auto line = trim(raw_line);
+        if (!function)
+        {
+            if (!line.starts_with("fun "))
+            {
+                ret.items.emplace_back(std::string(line));
+                continue;
+            }
+            // fun @f(@x: i32, @y: i32): i32 {
+            auto& item = ret.items.emplace_back(function_t{});
+            function = &std::get<function_t>(item);
+            auto header = line.substr(0, line.rfind('{'));
+            function->header = trim(header);
+            auto open = header.find('(');
+            auto close = header.rfind(')');
+            if (open == std::string_view::npos ||
+                close == std::string_view::npos)
+                throw std::runtime_error(
+                    fmt::format("[Error] Invalid Koopa IR: {}.", line));
+            for (const auto& parameter :
+                 split_list(header.substr(open + 1, close - open - 1)))
+                function->parameters.emplace_back(
+                    trim(std::string_view(parameter).substr(
+                        0, parameter.find(':'))));
+            source_line = 0;
+            continue;
+        }
+
+        if (line.empty())
+            continue;
+        // 行号标记作用于之后的指令，其他注释被丢弃。
+        if (line.starts_with("//"))
+        {
+            if (line.starts_with(line_marker_prefix))
+                source_line = std::stoi(
+                    std::string(line.substr(line_marker_prefix.size())));
+            continue;
+        }
+        if (line == "}")
+        {
+            function = nullptr;
+            continue;
+        }
+        if (line.ends_with(':'))
+        {
+            function->blocks.push_back(
+                basic_block_t{std::string(line.substr(0, line.size() - 1)),
+                              {}});
+            continue;
+        }
+        if (function->blocks.empty())
+            throw std::runtime_error(fmt::format(
+                "[Error] Invalid Koopa IR: instruction before any label: {}.",
+                line));
+        auto& instructions = function->blocks.back().instructions;
+        // 终结指令之后的指令不可达。
+        if (!instructions.empty() && instructions.back().is_terminator())
+            continue;
+        instructions.push_back(parse_instruction(line));
+        instructions.back().line = source_line;
+    }
+    if (function)
+        throw std::runtime_error("[Error] Invalid Koopa IR: missing \"}\".");
+    return ret;
+}
+
+std::string program_t::to_string() const
+{
+    std::string ret;
+    for (const auto& item : items)
+    {
+        if (auto line = std::get_if<std::string>(&item))
+        {
+            ret += *line;
+            ret += '\n';
+            continue;
+        }
+        const auto& function = std::get<function_t>(item);
+        ret += fmt::format("{} {{\n", function.header);
+        int source_line = 0;
+        for (const auto& block : function.blocks)
+        {
+            ret += fmt::format("{}:\n", block.label);
+            for (const auto& instruction : block.instructions)
+            {
+                if (instruction.line && instruction.line != source_line)
+                {
+                    source_line = instruction.line;
+                    ret += fmt::format("    {}{}\n", line_marker_prefix,
+                                       source_line);
+                }
+                ret += "    ";
+                if (!instruction.result.empty())
+                    ret += fmt::format("{} = ", instruction.result);
+                ret += instruction.op;
+                const auto& operands = instruction.operands;
+                if (instruction.op == "call")
+                {
+                    ret += fmt::format(" {}(", operands.at(0));
+                    for (size_t i = 1; i < operands.size(); i++)
+                        ret += fmt::format("{}{}", i > 1 ? ", " : "",
+                                           operands[i]);
+                    ret += ')';
+                }
+                else
+                {
+                    for (size_t i = 0; i < operands.size(); i++)
+                        ret += fmt::format("{}{}", i ? ", " : " ",
+                                           operands[i]);
+                }
+                ret += '\n';
+            }
+        }
+        ret += "}\n";
+    }
+    return ret;
+}
+
+size_t program_t::instruction_count() const
+{
+    size_t ret = 0;
+    for (const auto& item : items)
+        if (auto function = std::get_if<function_t>(&item))
+            for (const auto& block : function->blocks)
+                ret += block.instructions.size();
+    return ret;
+}
+
+std::optional<int32_t> compiler::ir::literal_of(const std::string& operand)
+{
+    if (operand.empty() ||
+        !(std::isdigit(static_cast<unsigned char>(operand[0])) ||
+          operand[0] == '-'))
+        return std::nullopt;
+    return static_cast<int32_t>(std::stoll(operand));
+}
@@ -0,0 +1,135 @@
+/**
+ * @file koopa_program.h
+ * @author UnnamedOrange
+ * @brief Editable model of Koopa IR text.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace compiler::ir
+{
+    /**
+     * @brief Prefix of the comment giving the source line of the following
+     * instructions in a function, e.g. "//@line 12".
+     */
+    inline constexpr std::string_view line_marker_prefix = "//@line ";
+    /**
+     * @brief Prefix of the comment giving the source file of the program,
+     * e.g. "//@file case/001-main.sy".
+     */
+    inline constexpr std::string_view file_marker_prefix = "//@file ";
+
+    /**
+     * @brief An instruction, e.g. "%1 = add %0, 1" or "store %1, @x".
+     */
+    struct instruction_t
+    {
+        /**
+         * @brief Name of the result, e.g. "%1" or "@x". Empty if the
+         * instruction has no result.
+         */
+        std::string result;
+        /**
+         * @brief Operation, e.g. "add", "load", "br" or "call".
+         */
+        std::string op;
+        /**
+         * @brief Operands in the order of the text. For call, the callee is
+         * the first operand. For alloc, the only operand is the type.
+         */
+        std::vector<std::string> operands;
+        /**
+         * @brief Source line given by the last "//@line N" marker before the
+         * instruction. 0 if unknown.
+         */
+        int line{};
+
+        /**
+         * @brief Check whether the instruction ends a basic block.
+         */
+        bool is_terminator() const;
+        /**
+         * @brief Check whether the instruction is a binary operation.
+         */
+        bool is_binary() const;
+        /**
+         * @brief Get the operands that are values, excluding labels, the
+         * callee and the type.
+         */
+        std::vector<std::string*> value_operands();
+        /**
+         * @brief Get the operands that are labels of basic blocks.
+         */
+        std::vector<std::string*> label_operands();
+    };
+
+    /**
+     * @brief A basic block.
+     */
+    struct basic_block_t
+    {
+        /**
+         * @brief Label including "%", e.g. "%main_entry".
+         */
+        std::string label;
+        std::vector<instruction_t> instructions;
+    };
+
+    /**
+     * @brief A function definition.
+     */
+    struct function_t
+    {
+        /**
+         * @brief The line before "{", e.g. "fun @f(@x: i32): i32".
+         */
+        std::string header;
+        /**
+         * @brief Names of the parameters, e.g. "@x".
+         */
+        std::vector<std::string> parameters;
+        /**
+         * @brief Basic blocks. The first one is the entry.
+         */
+        std::vector<basic_block_t> blocks;
+    };
+
+    /**
+     * @brief A program. Lines outside functions, e.g. declarations, global
+     * variables and blank lines, are kept as they are.
+     */
+    struct program_t
+    {
+        std::vector<std::variant<std::string, function_t>> items;
+
+        /**
+         * @brief Parse Koopa IR text produced by the frontend.
+         * If the text cannot be parsed, throw an std::runtime_error.
+         */
+        static program_t parse(const std::string& koopa_ir_str);
+        /**
+         * @brief Print the program as Koopa IR text.
+         */
+        std::string to_string() const;
+        /**
+         * @brief Count the instructions of all functions.
+         */
+        size_t instruction_count() const;
+    };
+
+    /**
+     * @brief Get the value of an integer literal operand.
+     */
+    std::optional<int32_t> literal_of(const std::string& operand);
+} // namespace compiler::ir
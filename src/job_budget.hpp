@@ -0,0 +1,165 @@
+/**
+ * @file job_budget.hpp
+ * @author UnnamedOrange
+ * @brief Time and memory budget of a compilation.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace compiler
+{
+    /**
+     * @brief Thrown at a checkpoint when the compilation has exceeded its
+     * budget.
+     */
+    class budget_exceeded_error : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /**
+     * @brief Wall-time and heap budget of one compilation.
+     * The parser, IR generation and each backend call check_job_budget at
+     * checkpoints, which throws budget_exceeded_error once the budget of the
+     * current thread is used up. Worker threads of a compilation share its
+     * budget through shared_job_budget_scope.
+     */
+    class job_budget
+    {
+    private:
+        // 每隔若干个检查点才读取时钟和堆的使用量，使检查点足够便宜。
+        static constexpr uint64_t time_check_interval = 32;
+        static constexpr uint64_t memory_check_interval = 1024;
+
+        std::chrono::steady_clock::time_point start_time;
+        std::chrono::milliseconds time_limit;
+        size_t memory_limit;
+        size_t base_memory;
+        std::atomic<uint64_t> checkpoint_count{};
+
+    public:
+        /**
+         * @brief Start a budget now.
+         *
+         * @param time_limit Wall time allowed. 0 means no limit.
+         * @param memory_limit Growth of the heap allowed in bytes. 0 means no
+         * limit. The heap is shared by the whole process, so the limit is
+         * only accurate when one compilation runs at a time.
+         */
+        job_budget(std::chrono::milliseconds time_limit, size_t memory_limit)
+            : start_time(std::chrono::steady_clock::now()),
+              time_limit(time_limit), memory_limit(memory_limit),
+              base_memory(memory_limit ? heap_in_use() : 0)
+        {
+        }
+
+    public:
+        /**
+         * @brief Throw budget_exceeded_error if the budget is used up.
+         */
+        void check()
+        {
+            auto count =
+                checkpoint_count.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (time_limit.count() && count % time_check_interval == 0 &&
+                std::chrono::steady_clock::now() - start_time > time_limit)
+                throw budget_exceeded_error(
+                    fmt::format("[Error] Time limit of {} ms exceeded.",
+                                time_limit.count()));
+            if (memory_limit && count % memory_check_interval == 0)
+            {
+                auto used = heap_in_use();
+                if (used > base_memory && used - base_memory > memory_limit)
+                    throw budget_exceeded_error(fmt::format(
+                        "[Error] Memory limit of {} bytes exceeded.",
+                        memory_limit));
+            }
+        }
+        /**
+         * @brief Bytes of heap in use by the process, or 0 if unknown.
+         */
+        static size_t heap_in_use()
+        {
+#if defined(__GLIBC__) &&                                                      \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+            auto info = mallinfo2();
+            return info.uordblks + info.hblkhd;
+#else
+            return 0;
+#endif
+        }
+    };
+
+    /**
+     * @brief Budget checked by check_job_budget on this thread.
+     */
+    inline thread_local job_budget* current_job_budget;
+
+    /**
+     * @brief Make a budget current on this thread during its lifetime.
+     */
+    class job_budget_scope
+    {
+    private:
+        job_budget budget;
+        job_budget* previous;
+
+    public:
+        job_budget_scope(std::chrono::milliseconds time_limit,
+                         size_t memory_limit)
+            : budget(time_limit, memory_limit), previous(current_job_budget)
+        {
+            current_job_budget = &budget;
+        }
+        ~job_budget_scope() { current_job_budget = previous; }
+        job_budget_scope(const job_budget_scope&) = delete;
+        job_budget_scope& operator=(const job_budget_scope&) = delete;
+    };
+
+    /**
+     * @brief Make a budget of another thread current on this thread during
+     * its lifetime, e.g. current_job_budget of the thread starting a worker.
+     * The budget must outlive the scope. nullptr means no budget.
+     */
+    class shared_job_budget_scope
+    {
+    private:
+        job_budget* previous;
+
+    public:
+        explicit shared_job_budget_scope(job_budget* budget)
+            : previous(current_job_budget)
+        {
+            current_job_budget = budget;
+        }
+        ~shared_job_budget_scope() { current_job_budget = previous; }
+        shared_job_budget_scope(const shared_job_budget_scope&) = delete;
+        shared_job_budget_scope& operator=(const shared_job_budget_scope&) =
+            delete;
+    };
+
+    /**
+     * @brief Cancellation checkpoint. Does nothing if no budget is current.
+     */
+    inline void check_job_budget()
+    {
+        if (current_job_budget)
+            current_job_budget->check();
+    }
+} // namespace compiler
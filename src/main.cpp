@@ -7,18 +7,42 @@
  * See the LICENSE file in the repository root for full license text.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
 
 #include <argparse/argparse.hpp>
 #include <fmt/core.h>
 
+#include <backend/koopa_to_c.h>
 #include <backend/koopa_to_riscv.h>
+#include <backend/koopa_to_x86.h>
+#include <driver/batch.h>
+#include <driver/compile_cache.h>
+#include <driver/emit.h>
+#include <driver/fuzz.h>
+#include <driver/metrics.h>
+#include <driver/profile_report.h>
+#include <driver/watch.h>
 #include <frontend/sysy_to_koopa.h>
+#include <ir/koopa_linker.h>
+#include <ir/koopa_optimizer.h>
 #include <global_variables.hpp>
+#include <job_budget.hpp>
 
 #pragma region "Define default values for DEBUG."
 /**
@@ -39,6 +63,10 @@ enum class compiler_mode_t
      * @brief Compile SysY to RISC-V, with performance optimization.
      */
     perf,
+    /**
+     * @brief Compile SysY to x86-64 for running on the host.
+     */
+    x86,
 };
 /**
  * @brief Default compiler mode for debug.
@@ -76,17 +104,146 @@ int main(int argn, char** argv)
             .default_value(false)
             .implicit_value(true)
             .help("Run in performance test mode.");
+        program.add_argument("-x86")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Run in x86-64 mode. The output links with "
+                  "runtime/sysy_host.c.");
+
+        program.add_argument("-O0")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Do not optimize Koopa IR. Default except in perf mode.");
+        program.add_argument("-O1")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Optimize Koopa IR: fold constants and remove dead code "
+                  "and unreachable blocks.");
+        program.add_argument("-O2")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Also forward values through memory and remove dead "
+                  "stores. Default in perf mode.");
+        program.add_argument("-compile-budget")
+            .default_value(std::string())
+            .metavar("DURATION")
+            .help("Spend at most DURATION, e.g. 2s or 500ms, optimizing. "
+                  "Each function gets a share and falls back to cheaper "
+                  "optimizations when it runs out.");
+        program.add_argument("-whole-program")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Remove functions that main cannot call and unused global "
+                  "variables after linking multiple inputs. Default in perf "
+                  "mode.");
 
         program.add_argument("input")
             .required()
-            .default_value(std::string(DEBUG_USE_INPUT_FILE_PATH))
+            .nargs(argparse::nargs_pattern::at_least_one)
+            .default_value(
+                std::vector{std::string(DEBUG_USE_INPUT_FILE_PATH)})
             .metavar("INPUT_FILE")
-            .help("Specify the input file.");
+            .help("Specify the input files. Multiple files are compiled in "
+                  "parallel and linked. \"-\" reads the standard input "
+                  "and compiles it while it arrives.");
 
         program.add_argument("-o")
             .default_value(std::string("a.out"))
             .metavar("OUTPUT_FILE")
             .help("Specify the output file name.");
+
+        program.add_argument("-emit")
+            .default_value(std::vector<std::string>())
+            .append()
+            .metavar("KIND=PATH")
+            .help("Write an output of KIND (koopa, riscv, c or obj) to PATH "
+                  "instead of -o. Can be repeated; all outputs come from "
+                  "one compilation.");
+
+        program.add_argument("-cache")
+            .default_value(std::string())
+            .metavar("CACHE_FILE")
+            .help("Share compiled outputs with other compiler processes "
+                  "through a memory-mapped cache file.");
+
+        program.add_argument("-batch")
+            .default_value(std::string())
+            .metavar("MANIFEST")
+            .help("Compile the files listed in MANIFEST, one \"INPUT OUTPUT\" "
+                  "pair per line, instead of INPUT_FILE.");
+        program.add_argument("-metrics")
+            .default_value(std::string())
+            .metavar("ENDPOINT")
+            .help("Serve metrics in Prometheus text format over HTTP while "
+                  "running. ENDPOINT is a TCP port on 127.0.0.1 or the path "
+                  "of a Unix socket.");
+        program.add_argument("-job-time-limit")
+            .default_value(0)
+            .scan<'i', int>()
+            .metavar("MS")
+            .help("Give up compiling a file after MS milliseconds. "
+                  "0 means no limit.");
+        program.add_argument("-job-memory-limit")
+            .default_value(0)
+            .scan<'i', int>()
+            .metavar("MB")
+            .help("Give up compiling a file once it has allocated MB "
+                  "megabytes. 0 means no limit.");
+        program.add_argument("-watch")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Keep running and recompile whenever the input file "
+                  "changes.");
+
+        program.add_argument("-parse-jobs")
+            .default_value(1)
+            .scan<'i', int>()
+            .metavar("N")
+            .help("Parse the input with N threads, splitting it between "
+                  "top-level declarations and functions.");
+
+        program.add_argument("-march")
+            .default_value(std::string("rv32im"))
+            .metavar("ISA")
+            .help("Specify the target RISC-V ISA, e.g. rv32im_zba_zbb.");
+        program.add_argument("-msmall-data-limit")
+            .default_value(8)
+            .scan<'i', int>()
+            .metavar("SIZE")
+            .help("Put global variables not larger than SIZE bytes into the "
+                  "small data section. 0 disables it.");
+        program.add_argument("-runtime-shim")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Emit a buffered I/O runtime instead of calling the I/O "
+                  "functions of libsysy.");
+        program.add_argument("-instrument-functions")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Count cycles and calls of every function. The program "
+                  "writes sysy.prof when main returns.");
+        program.add_argument("-g")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Emit line information (.file and .loc) of the source.");
+        program.add_argument("-profile-report")
+            .default_value(std::string())
+            .metavar("PROFILE")
+            .help("Print the report of a profile written by a program "
+                  "compiled with -instrument-functions, and exit.");
+        program.add_argument("-fuzz")
+            .default_value(0)
+            .scan<'i', int>()
+            .metavar("COUNT")
+            .help("Compile COUNT random programs at every optimization "
+                  "level, run them and compare the results, and exit. "
+                  "Programs that differ are minimized and written to the "
+                  "current directory.");
+        program.add_argument("-fuzz-seed")
+            .default_value(1)
+            .scan<'i', int>()
+            .metavar("SEED")
+            .help("Seed of the first random program of -fuzz.");
     }
 
     // Parse the arguments.
@@ -103,16 +260,59 @@ int main(int argn, char** argv)
         }
     }
 
+    // Print the report of a profile instead of compiling.
+    if (auto profile_path = program.get<std::string>("-profile-report");
+        !profile_path.empty())
+    {
+        try
+        {
+            std::cout << profile_report(profile_path);
+        }
+        catch (const std::runtime_error& err)
+        {
+            std::cerr << err.what() << std::endl;
+            std::exit(1);
+        }
+        return 0;
+    }
+
+    // Compare the optimization levels on random programs instead of
+    // compiling.
+    if (auto fuzz_count = program.get<int>("-fuzz"); fuzz_count > 0)
+    {
+        try
+        {
+            size_t failure_count = run_fuzz(
+                fuzz_count,
+                static_cast<uint64_t>(program.get<int>("-fuzz-seed")),
+                [](const std::string& source, int level) {
+                    return koopa_optimizer(level).optimize(
+                        sysy_to_koopa().compile_source(source));
+                },
+                std::filesystem::current_path());
+            return failure_count ? 1 : 0;
+        }
+        catch (const std::runtime_error& err)
+        {
+            std::cerr << err.what() << std::endl;
+            std::exit(1);
+        }
+    }
+
     // Get mode from the arguments.
     {
         int mode_count = 0;
         mode_count += program.get<bool>("-koopa");
         mode_count += program.get<bool>("-riscv");
         mode_count += program.get<bool>("-perf");
+        mode_count += program.get<bool>("-x86");
+        // -emit 指定了输出的种类，此时模式可以省略。
+        bool has_emit =
+            !program.get<std::vector<std::string>>("-emit").empty();
         if ((DEBUG_USE_COMPILER_MODE != compiler_mode_t::unknown &&
              mode_count > 1) ||
             (DEBUG_USE_COMPILER_MODE == compiler_mode_t::unknown &&
-             mode_count != 1))
+             mode_count != 1 && !(has_emit && !mode_count)))
         {
             std::cerr << "Please specify exactly one mode." << std::endl;
             std::cerr << program;
@@ -124,50 +324,484 @@ int main(int argn, char** argv)
             mode = compiler_mode_t::riscv;
         else if (program.get<bool>("-perf"))
             mode = compiler_mode_t::perf;
+        else if (program.get<bool>("-x86"))
+            mode = compiler_mode_t::x86;
+        else if (has_emit)
+            mode = compiler_mode_t::riscv;
+    }
+
+    // Get optimization level from the arguments.
+    int optimization_level = mode == compiler_mode_t::perf ? 2 : 0;
+    std::chrono::milliseconds compile_budget{};
+    {
+        for (int level = 0; level <= 2; level++)
+            if (program.get<bool>(fmt::format("-O{}", level)))
+                optimization_level = level;
+        try
+        {
+            if (auto budget = program.get<std::string>("-compile-budget");
+                !budget.empty())
+                compile_budget = koopa_optimizer::parse_budget(budget);
+        }
+        catch (const std::invalid_argument& err)
+        {
+            std::cerr << err.what() << std::endl;
+            std::exit(1);
+        }
     }
 
     // Get file paths from the arguments.
+    std::vector<emit_request_t> emit_requests;
+    auto input_file_paths = program.get<std::vector<std::string>>("input");
+    bool is_linked = input_file_paths.size() > 1;
     {
-        global::input_file_path = program.get<std::string>("input");
+        global::input_file_path = input_file_paths.front();
         global::output_file_path = program.get<std::string>("-o");
+        if (global::input_file_path == "-" && program.get<bool>("-watch"))
+        {
+            std::cerr << "[Error] Cannot watch the standard input."
+                      << std::endl;
+            std::exit(1);
+        }
+        if (is_linked &&
+            (program.get<bool>("-watch") ||
+             !program.get<std::string>("-batch").empty() ||
+             std::count(input_file_paths.begin(), input_file_paths.end(),
+                        "-")))
+        {
+            std::cerr << "[Error] Multiple input files cannot be watched, "
+                         "batched or read from the standard input."
+                      << std::endl;
+            std::exit(1);
+        }
+        try
+        {
+            for (const auto& str :
+                 program.get<std::vector<std::string>>("-emit"))
+                emit_requests.push_back(emit_request_t::parse(str));
+        }
+        catch (const std::invalid_argument& err)
+        {
+            std::cerr << err.what() << std::endl;
+            std::exit(1);
+        }
     }
 
-    // Compile.
+    // Get target from the arguments.
     {
-        sysy_to_koopa compiler_koopa;
-        std::ofstream ofs(global::output_file_path);
+        try
+        {
+            global::target =
+                riscv_target_t::parse(program.get<std::string>("-march"));
+            auto small_data_limit = program.get<int>("-msmall-data-limit");
+            if (small_data_limit < 0)
+                throw std::invalid_argument(
+                    "[Error] -msmall-data-limit must not be negative.");
+            global::target.small_data_limit = small_data_limit;
+            global::target.runtime_shim = program.get<bool>("-runtime-shim");
+            global::target.instrument_functions =
+                program.get<bool>("-instrument-functions");
+        }
+        catch (const std::invalid_argument& err)
+        {
+            std::cerr << err.what() << std::endl;
+            std::exit(1);
+        }
+    }
 
+    auto read_input = []() {
+        std::ifstream ifs(global::input_file_path, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(ifs)),
+                           std::istreambuf_iterator<char>());
+    };
+
+    // Serve metrics while running, e.g. in batch and watch modes.
+    metrics_registry metrics;
+    std::unique_ptr<metrics_server> metrics_endpoint;
+    if (auto endpoint = program.get<std::string>("-metrics"); !endpoint.empty())
+    {
+        try
+        {
+            metrics_endpoint =
+                std::make_unique<metrics_server>(endpoint, metrics);
+        }
+        catch (const std::runtime_error& err)
+        {
+            std::cerr << err.what() << std::endl;
+            std::exit(1);
+        }
+    }
+
+    // Look up the cache.
+    std::unique_ptr<compile_cache> cache;
+    compile_cache::key_t cache_key{};
+    {
+        auto cache_path = program.get<std::string>("-cache");
+        // 批量编译、从标准输入读取、链接多个文件和同时生成多种输出时不使用
+        // 缓存。缓存只保存一种输出，命中时也不会生成其他输出。
+        // 监视模式命中缓存后仍要继续监视，也不使用缓存。
+        if (!cache_path.empty() && program.get<std::string>("-batch").empty() &&
+            global::input_file_path != "-" && !is_linked &&
+            program.get<std::vector<std::string>>("-emit").empty() &&
+            !program.get<bool>("-watch"))
+        {
+            try
+            {
+                cache = std::make_unique<compile_cache>(cache_path);
+            }
+            catch (const std::runtime_error& err)
+            {
+                // 缓存不可用时照常编译。
+                std::cerr << err.what() << std::endl;
+            }
+        }
+        if (cache)
+        {
+            auto config = fmt::format(
+                "mode={} O={} march={} small-data-limit={} runtime-shim={} "
+                "instrument-functions={} g={} compile-budget={}",
+                static_cast<int>(mode), optimization_level,
+                program.get<std::string>("-march"),
+                global::target.small_data_limit, global::target.runtime_shim,
+                global::target.instrument_functions, program.get<bool>("-g"),
+                compile_budget.count());
+            // 带调试信息的输出含有源文件路径。
+            if (program.get<bool>("-g"))
+                config += fmt::format(" input={}",
+                                      global::input_file_path.string());
+            cache_key = compile_cache::make_key(config, read_input());
+            auto output = cache->find(cache_key);
+            metrics.add_cache_lookups("output", output.has_value(),
+                                      !output.has_value());
+            if (output)
+            {
+                std::cout << fmt::format("[Main] Uses cached output.")
+                          << std::endl;
+                std::ofstream ofs(global::output_file_path);
+                ofs << *output << std::endl;
+                return 0;
+            }
+        }
+    }
+
+    // Compile.
+    switch (mode)
+    {
+    case compiler_mode_t::koopa:
+        std::cout << fmt::format("[Main] Runs in Koopa mode.") << std::endl;
+        break;
+    case compiler_mode_t::riscv:
+        std::cout << fmt::format("[Main] Runs in RISC-V mode.") << std::endl;
+        break;
+    case compiler_mode_t::perf:
+        std::cout << fmt::format("[Main] Runs in perf mode.") << std::endl;
+        break;
+    case compiler_mode_t::x86:
+        std::cout << fmt::format("[Main] Runs in x86-64 mode.") << std::endl;
+        break;
+    default:
+        break;
+    }
+    // 性能模式下不编译 main 无法调用的函数。
+    sysy_to_koopa compiler_koopa(
+        mode == compiler_mode_t::perf,
+        static_cast<size_t>(std::max(program.get<int>("-parse-jobs"), 1)),
+        program.get<bool>("-g"));
+    // 在监视模式下复用，使未改变的函数不必重新生成。
+    koopa_to_riscv compiler_riscv(global::target);
+    auto compile_koopa = [&](const std::string& koopa_ir_str) {
+        phase_timer timer(metrics, "backend");
+        std::string output;
         switch (mode)
         {
         case compiler_mode_t::koopa:
-        {
-            std::cout << fmt::format("[Main] Runs in Koopa mode.") << std::endl;
-            auto koopa_ir_str = compiler_koopa.compile(global::input_file_path);
-            ofs << koopa_ir_str << std::endl;
+            output = koopa_ir_str;
             break;
-        }
         case compiler_mode_t::riscv:
-        {
-            std::cout << fmt::format("[Main] Runs in RISC-V mode.")
-                      << std::endl;
-            auto koopa_ir_str = compiler_koopa.compile(global::input_file_path);
-            koopa_to_riscv compiler_riscv;
-            auto riscv_str = compiler_riscv.compile(koopa_ir_str);
-            ofs << riscv_str << std::endl;
+            output = compiler_riscv.compile(koopa_ir_str);
+            metrics.add_cache_lookups("function",
+                                      compiler_riscv.functions_reused(),
+                                      compiler_riscv.functions_generated());
             break;
-        }
         case compiler_mode_t::perf:
-        {
-            std::cout << fmt::format("[Main] Runs in perf mode.") << std::endl;
             // TODO: Modify perf mode.
-            auto koopa_ir_str = compiler_koopa.compile(global::input_file_path);
-            koopa_to_riscv compiler_riscv;
-            auto riscv_str = compiler_riscv.compile(koopa_ir_str);
-            ofs << riscv_str << std::endl;
+            output = compiler_riscv.compile(koopa_ir_str);
+            metrics.add_cache_lookups("function",
+                                      compiler_riscv.functions_reused(),
+                                      compiler_riscv.functions_generated());
+            break;
+        case compiler_mode_t::x86:
+            output = koopa_to_x86().compile(koopa_ir_str);
             break;
-        }
         default:
             break;
         }
+        return output;
+    };
+    koopa_optimizer optimizer(optimization_level, compile_budget);
+    bool is_batch = !program.get<std::string>("-batch").empty();
+    auto optimize = [&](const std::string& koopa_ir_str) {
+        phase_timer timer(metrics, "optimize");
+        auto ret = optimizer.optimize(koopa_ir_str);
+        if (optimization_level && !is_batch)
+            std::cout << fmt::format(
+                             "[Main] Optimized Koopa IR from {} to {} "
+                             "instructions.",
+                             optimizer.instructions_before(),
+                             optimizer.instructions_after())
+                      << std::endl;
+        if (optimization_level && compile_budget.count() && !is_batch)
+            std::cout << fmt::format(
+                             "[Main] Optimized {} functions at tier 2, {} at "
+                             "tier 1 and {} at tier 0 within the budget.",
+                             optimizer.functions_at_tier(2),
+                             optimizer.functions_at_tier(1),
+                             optimizer.functions_at_tier(0))
+                      << std::endl;
+        return ret;
+    };
+    // 多个文件各自在一个线程中编译和优化，最后链接。各线程共享整个编译的
+    // 预算。
+    // 各文件可能调用其他文件的函数，只在链接后删除 main 无法调用的函数。
+    koopa_linker linker(program.get<bool>("-whole-program") ||
+                        mode == compiler_mode_t::perf);
+    auto compile_and_link = [&]() {
+        bool emits_line_info = program.get<bool>("-g");
+        std::vector<std::future<std::string>> units;
+        for (const auto& path : input_file_paths)
+            units.push_back(std::async(
+                std::launch::async, [&, path, budget = current_job_budget] {
+                    shared_job_budget_scope scope(budget);
+                    std::string koopa_ir_str;
+                    {
+                        phase_timer timer(metrics, "frontend");
+                        koopa_ir_str = sysy_to_koopa(false, 1, emits_line_info)
+                                           .compile(path);
+                    }
+                    phase_timer timer(metrics, "optimize");
+                    return koopa_optimizer(optimization_level, compile_budget)
+                        .optimize(koopa_ir_str);
+                }));
+        std::vector<std::string> koopa_ir_strs;
+        std::exception_ptr error;
+        for (auto& unit : units)
+        {
+            try
+            {
+                koopa_ir_strs.push_back(unit.get());
+            }
+            catch (...)
+            {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        if (error)
+            std::rethrow_exception(error);
+
+        phase_timer timer(metrics, "link");
+        auto ret = linker.link(koopa_ir_strs);
+        if (linker.functions_removed() || linker.globals_removed())
+            std::cout << fmt::format("[Main] Removed {} functions and {} "
+                                     "global variables after linking.",
+                                     linker.functions_removed(),
+                                     linker.globals_removed())
+                      << std::endl;
+        return ret;
+    };
+    auto compile_sysy = [&]() {
+        if (is_linked)
+            return compile_and_link();
+        std::string koopa_ir_str;
+        {
+            phase_timer timer(metrics, "frontend");
+            // 标准输入可能是管道，边读取边编译。
+            if (global::input_file_path == "-")
+                koopa_ir_str = compiler_koopa.compile_stream(STDIN_FILENO);
+            else
+                koopa_ir_str = compiler_koopa.compile(global::input_file_path);
+        }
+        return optimize(koopa_ir_str);
+    };
+    // 每次编译有各自的时间和内存预算，超出时以错误结束。
+    auto job_time_limit = std::chrono::milliseconds(
+        std::max(program.get<int>("-job-time-limit"), 0));
+    auto job_memory_limit =
+        static_cast<size_t>(std::max(program.get<int>("-job-memory-limit"), 0))
+        << 20;
+    // 记录每次编译的耗时、输入输出的字节数和堆的大小。
+    std::string_view mode_name = mode == compiler_mode_t::koopa   ? "koopa"
+                                 : mode == compiler_mode_t::riscv ? "riscv"
+                                 : mode == compiler_mode_t::perf  ? "perf"
+                                                                  : "x86";
+    auto observe = [&](size_t input_size, const auto& compile_once) {
+        auto start_time = std::chrono::steady_clock::now();
+        auto elapsed = [&] {
+            return std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start_time)
+                .count();
+        };
+        std::string output;
+        try
+        {
+            output = compile_once();
+        }
+        catch (...)
+        {
+            metrics.observe_compile(mode_name, elapsed(), false);
+            metrics.add_bytes(input_size, 0);
+            throw;
+        }
+        metrics.observe_compile(mode_name, elapsed(), true);
+        metrics.add_bytes(input_size, output.size());
+        metrics.sample_heap();
+        return output;
+    };
+    auto compile = [&]() {
+        size_t input_size = 0;
+        for (const auto& path : input_file_paths)
+        {
+            std::error_code ec;
+            auto size = path == "-" ? 0 : std::filesystem::file_size(path, ec);
+            input_size += ec ? 0 : size;
+        }
+        return observe(input_size, [&] {
+            job_budget_scope budget(job_time_limit, job_memory_limit);
+            return compile_koopa(compile_sysy());
+        });
+    };
+
+    // Write all requested outputs from one compilation.
+    if (!emit_requests.empty())
+    {
+        try
+        {
+            output_writer writer;
+            auto koopa_ir_str = compile_sysy();
+            // Koopa IR 和 C 在生成 RISC-V 的同时写入。
+            std::optional<std::string> c_str;
+            for (const auto& request : emit_requests)
+            {
+                if (request.kind == emit_kind_t::koopa)
+                    writer.write(request.path, koopa_ir_str);
+                else if (request.kind == emit_kind_t::c)
+                {
+                    if (!c_str)
+                        c_str = koopa_to_c().compile(koopa_ir_str);
+                    writer.write(request.path, *c_str);
+                }
+            }
+            std::optional<std::string> riscv_str;
+            for (const auto& request : emit_requests)
+            {
+                if (request.kind == emit_kind_t::koopa ||
+                    request.kind == emit_kind_t::c)
+                    continue;
+                if (!riscv_str)
+                    riscv_str = compiler_riscv.compile(koopa_ir_str);
+                if (request.kind == emit_kind_t::riscv)
+                    writer.write(request.path, *riscv_str);
+                else
+                    writer.assemble(request.path, *riscv_str,
+                                    program.get<std::string>("-march"));
+            }
+            writer.join();
+        }
+        catch (const std::runtime_error& err)
+        {
+            std::cerr << err.what() << std::endl;
+            std::exit(1);
+        }
+        return 0;
+    }
+
+    // Compile the files listed in the manifest.
+    if (auto manifest_path = program.get<std::string>("-batch");
+        !manifest_path.empty())
+    {
+        try
+        {
+            size_t failure_count =
+                run_batch(
+                    manifest_path,
+                    [&](const std::string& source) {
+                        return observe(source.size(), [&] {
+                            job_budget_scope budget(job_time_limit,
+                                                    job_memory_limit);
+                            std::string koopa_ir_str;
+                            {
+                                phase_timer timer(metrics, "frontend");
+                                koopa_ir_str =
+                                    compiler_koopa.compile_source(source);
+                            }
+                            return compile_koopa(optimize(koopa_ir_str));
+                        });
+                    },
+                    &metrics);
+            return failure_count ? 1 : 0;
+        }
+        catch (const std::runtime_error& err)
+        {
+            std::cerr << err.what() << std::endl;
+            std::exit(1);
+        }
+    }
+
+    if (!program.get<bool>("-watch"))
+    {
+        std::string output;
+        try
+        {
+            output = compile();
+        }
+        catch (const std::runtime_error& err)
+        {
+            std::cerr << err.what() << std::endl;
+            std::exit(1);
+        }
+        std::ofstream ofs(global::output_file_path);
+        ofs << output << std::endl;
+        if (cache)
+            cache->insert(cache_key, output);
+        return 0;
+    }
+
+    // Watch the input file and recompile it whenever it changes.
+    try
+    {
+        file_watcher watcher(global::input_file_path);
+        std::string last_source;
+        while (true)
+        {
+            // 保存文件可能产生多个事件，内容不变时不重新编译。
+            auto source = read_input();
+            if (source != last_source)
+            {
+                last_source = std::move(source);
+                auto start_time = std::chrono::steady_clock::now();
+                try
+                {
+                    write_file_atomically(global::output_file_path,
+                                          compile() + "\n");
+                    auto duration =
+                        std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - start_time);
+                    std::cout << fmt::format("[Main] Compiled in {} ms.",
+                                             duration.count())
+                              << std::endl;
+                }
+                catch (const std::exception& err)
+                {
+                    // 编译失败时保留之前的输出，继续等待修改。
+                    std::cerr << err.what() << std::endl;
+                }
+            }
+            watcher.wait();
+        }
+    }
+    catch (const std::runtime_error& err)
+    {
+        std::cerr << err.what() << std::endl;
+        std::exit(1);
     }
 }
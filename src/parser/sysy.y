@@ -28,11 +28,22 @@ using symbol_type = std::variant<ast_t, string, int>;
 
 #define YYSTYPE symbol_type
 
+// 词法分析器的状态。与 Lex 生成的定义相同。
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+
+}
+
+// YYLTYPE 在 %code requires 之后才定义，因此在此声明使用它的函数。
+%code provides {
 // 声明词法分析外部函数。YACC 默认使用 yylex。
-int yylex();
+// 分析器是可重入的，词法单元和状态都通过参数传递，以便多个线程同时分析。
+int yylex(YYSTYPE* yylval, YYLTYPE* yylloc, yyscan_t scanner);
 
-// 前向声明错误处理函数。其中参数一默认是 parse-param。
-void yyerror(ast_t& ast, const char* s);
+// 前向声明错误处理函数。其参数默认是位置和 parse-param。
+void yyerror(YYLTYPE* yylloc, yyscan_t scanner, ast_t& ast, const char* s);
 }
 
 /* 第二部分（一）：起始符号翻译结果定义 */
@@ -40,7 +51,13 @@ void yyerror(ast_t& ast, const char* s);
 // 起始符号翻译结果以函数参数的形式存在，
 // 在起始符号的产生式动作中对该参数进行赋值，
 // 实现翻译结果的返回。
-%parse-param { ast_t& ast }
+%parse-param { yyscan_t scanner } { ast_t& ast }
+
+// 不使用全局变量，使分析器可重入。
+%define api.pure full
+%lex-param { yyscan_t scanner }
+// 记录符号在源码中的位置，用于生成调试信息和报告错误。
+%locations
 
 /* 第二部分（二）：类型定义 */
 
@@ -71,7 +88,7 @@ void yyerror(ast_t& ast, const char* s);
  * %token <<<类型>>> { <终结符枚举名> ... } // 类型在 union 中定义。
  */
 
-%token INT VOID RETURN CONST IF ELSE WHILE BREAK CONTINUE
+%token INT VOID RETURN CONST IF ELSE WHILE BREAK CONTINUE EXTERN
 %token IDENTIFIER
 %token INT_LITERAL
 %token LT GT LE GE EQ NE
@@ -90,6 +107,7 @@ void yyerror(ast_t& ast, const char* s);
 %type nt_declaration_or_function nt_declaration_or_function_list
 %type nt_type
 %type nt_function nt_parameter nt_parameter_list
+%type nt_external_declaration
 %type nt_number
 %type nt_block
 %type nt_block_item nt_block_item_list
@@ -157,8 +175,38 @@ nt_declaration_or_function : nt_declaration {
 | nt_function {
     $$ = $1;
 }
+| nt_external_declaration {
+    $$ = $1;
+}
+nt_external_declaration : EXTERN nt_type IDENTIFIER ';' {
+    auto ast_external_declaration = std::make_shared<ast_external_declaration_t>();
+    ast_external_declaration->type = std::get<ast_t>($2);
+    ast_external_declaration->raw_name = std::get<string>($3);
+    $$ = ast_external_declaration;
+}
+| EXTERN nt_type IDENTIFIER '(' ')' ';' {
+    auto ast_external_declaration = std::make_shared<ast_external_declaration_t>();
+    ast_external_declaration->type = std::get<ast_t>($2);
+    ast_external_declaration->raw_name = std::get<string>($3);
+    ast_external_declaration->is_function = true;
+    $$ = ast_external_declaration;
+}
+| EXTERN nt_type IDENTIFIER '(' nt_parameter_list ')' ';' {
+    auto ast_external_declaration = std::make_shared<ast_external_declaration_t>();
+    ast_external_declaration->type = std::get<ast_t>($2);
+    ast_external_declaration->raw_name = std::get<string>($3);
+    ast_external_declaration->is_function = true;
+    auto current_list = std::dynamic_pointer_cast<ast_parameter_list_t>(std::get<ast_t>($5));
+    while (current_list)
+    {
+        ast_external_declaration->parameters.push_back(std::move(current_list->parameter));
+        current_list = current_list->parameter_list;
+    }
+    $$ = ast_external_declaration;
+}
 nt_function : nt_type IDENTIFIER '(' ')' nt_block {
     auto ast_function = std::make_shared<ast_function_t>();
+    ast_function->line = @2.first_line;
     ast_function->function_type = std::get<ast_t>($1);
     ast_function->function_name = std::get<string>($2);
     ast_function->block = std::get<ast_t>($5);
@@ -166,6 +214,7 @@ nt_function : nt_type IDENTIFIER '(' ')' nt_block {
 }
 | nt_type IDENTIFIER '(' nt_parameter_list ')' nt_block {
     auto ast_function = std::make_shared<ast_function_t>();
+    ast_function->line = @2.first_line;
     ast_function->function_type = std::get<ast_t>($1);
     ast_function->function_name = std::get<string>($2);
     auto current_list = std::dynamic_pointer_cast<ast_parameter_list_t>(std::get<ast_t>($4));
@@ -220,11 +269,13 @@ nt_block : '{' '}' {
 nt_block_item_list : nt_block_item {
     auto ast_block_item_list = std::make_shared<ast_block_item_list_t>();
     ast_block_item_list->block_item = std::get<ast_t>($1);
+    ast_block_item_list->block_item->line = @1.first_line;
     $$ = ast_block_item_list;
 }
 | nt_block_item nt_block_item_list {
     auto ast_block_item_list = std::make_shared<ast_block_item_list_t>();
     ast_block_item_list->block_item = std::get<ast_t>($1);
+    ast_block_item_list->block_item->line = @1.first_line;
     ast_block_item_list->block_item_list = std::dynamic_pointer_cast<ast_block_item_list_t>(std::get<ast_t>($2));
     $$ = ast_block_item_list;
 }
@@ -273,6 +324,7 @@ nt_statement : RETURN nt_expression ';' {
 }
 | WHILE '(' nt_expression ')' nt_statement {
     auto ast_statement = std::make_shared<ast_statement_6_t>();
+    ast_statement->line = @1.first_line;
     ast_statement->condition_expression = std::get<ast_t>($3);
     ast_statement->while_branch = std::get<ast_t>($5);
     $$ = ast_statement;
@@ -554,7 +606,9 @@ nt_lvalue : IDENTIFIER {
 %%
 
 /* 第四部分：辅助函数 */
-void yyerror(ast_t& ast, const char* s)
+void yyerror(YYLTYPE* yylloc, yyscan_t, ast_t&, const char* s)
 {
-    std::cerr << fmt::format("[Error] YACC: {}.", s) << std::endl;
+    std::cerr << fmt::format("[Error] YACC: line {}: {}.", yylloc->first_line,
+                             s)
+              << std::endl;
 }
@@ -11,8 +11,11 @@
 
 #include <cstdio>
 
-// Lex interface.
-extern FILE* yyin;
-
 // YACC interface.
 #include "sysy.tab.hpp"
+
+// Lex interface. The scanner is reentrant: each parse owns a yyscan_t.
+int yylex_init(yyscan_t* scanner);
+void yyset_in(FILE* input_file, yyscan_t scanner);
+void yyset_lineno(int line_number, yyscan_t scanner);
+int yylex_destroy(yyscan_t scanner);
@@ -13,6 +13,7 @@
 #include <filesystem>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 
 #include <fmt/core.h>
 
@@ -65,6 +66,24 @@ public:
             throw std::runtime_error("Failed to open file.");
         return ret;
     }
+    /**
+     * @brief Open a read-only stream on a string using fmemopen.
+     * The string must outlive the file.
+     * If failed, throw an std::runtime_error.
+     */
+    static c_file open_string(std::string_view content)
+    {
+        c_file ret;
+        // fmemopen 不接受大小为 0 的缓冲区，空字符串用一个空白字符代替。
+        static char blank[] = "\n";
+        ret.file = content.empty()
+                       ? fmemopen(blank, 1, "r")
+                       : fmemopen(const_cast<char*>(content.data()),
+                                  content.size(), "r");
+        if (!ret.file)
+            throw std::runtime_error("Failed to open string.");
+        return ret;
+    }
 
 public:
     /**